@@ -0,0 +1,313 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "utils.h"
+
+// Generic pre order walk over the AST, callbacks return false to skip 
+// the children of the visited node. Analyses embed the visitor as their
+// first member to carry state.
+typedef struct AstVisitor AstVisitor_t;
+typedef bool (*AstVisitExpressionFn_t) (AstVisitor_t* visitor, const Expression_t* expr);
+typedef bool (*AstVisitStatementFn_t) (AstVisitor_t* visitor, const Statement_t* stmt);
+
+struct AstVisitor {
+    AstVisitExpressionFn_t expression;
+    AstVisitStatementFn_t statement;
+};
+
+static void walkExpression(AstVisitor_t* visitor, const Expression_t* expr);
+static void walkStatement(AstVisitor_t* visitor, const Statement_t* stmt);
+static void walkBlock(AstVisitor_t* visitor, const BlockStatement_t* block);
+
+static bool containsName(Vector_t* names, const char* name);
+static int32_t findName(Vector_t* names, const char* name);
+
+/************************************ 
+ *         ESCAPE ANALYSIS          *
+ ************************************/
+
+typedef struct EscapeVisitor {
+    AstVisitor_t base;
+    bool escapes;
+} EscapeVisitor_t;
+
+static bool escapeVisitExpression(AstVisitor_t* visitor, const Expression_t* expr) {
+    if (expr->type == EXPRESSION_FUNCTION_LITERAL) {
+        ((EscapeVisitor_t*)visitor)->escapes = true;
+        return false;
+    }
+    return !((EscapeVisitor_t*)visitor)->escapes;
+}
+
+bool analysisFrameMayEscape(const BlockStatement_t* body) {
+    EscapeVisitor_t visitor = {
+        .base = { .expression = escapeVisitExpression, .statement = NULL },
+        .escapes = false
+    };
+    walkBlock(&visitor.base, body);
+    return visitor.escapes;
+}
+
+/************************************ 
+ *          LET BINDINGS            *
+ ************************************/
+
+typedef struct LetVisitor {
+    AstVisitor_t base;
+    Vector_t* names;
+} LetVisitor_t;
+
+static bool letVisitExpression(AstVisitor_t* visitor, const Expression_t* expr) {
+    // nested functions bind in their own frames
+    return expr->type != EXPRESSION_FUNCTION_LITERAL;
+}
+
+static bool letVisitStatement(AstVisitor_t* visitor, const Statement_t* stmt) {
+    // names are borrowed from the AST, they share its arena
+    if (stmt->type == STATEMENT_LET) 
+        vectorAppend(((LetVisitor_t*)visitor)->names, (char*)((LetStatement_t*)stmt)->name->value);
+    return true;
+}
+
+Vector_t* analysisLetBindings(Arena_t* arena, const BlockStatement_t* body) {
+    LetVisitor_t visitor = {
+        .base = { .expression = letVisitExpression, .statement = letVisitStatement },
+        .names = createArenaVector(arena)
+    };
+    walkBlock(&visitor.base, body);
+    return visitor.names;
+}
+
+/************************************ 
+ *         FREE VARIABLES           *
+ ************************************/
+
+typedef struct FreeVisitor {
+    AstVisitor_t base;
+    Vector_t* bound;
+    Vector_t* free; // in the arena of the analysed function
+} FreeVisitor_t;
+
+static void freeAddReference(FreeVisitor_t* visitor, const char* name) {
+    // names are borrowed from the AST, they share its arena
+    if (!containsName(visitor->bound, name) && !containsName(visitor->free, name)) 
+        vectorAppend(visitor->free, (char*)name);
+}
+
+static bool freeVisitExpression(AstVisitor_t* visitor, const Expression_t* expr) {
+    FreeVisitor_t* freeVisitor = (FreeVisitor_t*)visitor;
+    if (expr->type == EXPRESSION_IDENTIFIER) {
+        freeAddReference(freeVisitor, ((Identifier_t*)expr)->value);
+        return false;
+    }
+
+    if (expr->type == EXPRESSION_FUNCTION_LITERAL) {
+        // whatever the nested function needs from outside has to come through us
+        FunctionLiteral_t* func = (FunctionLiteral_t*)expr;
+        Vector_t* nested = func->freeVariables ? func->freeVariables : analysisFreeVariables(func);
+        uint32_t cnt = vectorGetCount(nested);
+        char** names = (char**)vectorGetBuffer(nested);
+        for (uint32_t i = 0; i < cnt; i++) {
+            freeAddReference(freeVisitor, names[i]);
+        }
+        return false;
+    }
+    return true;
+}
+
+Vector_t* analysisFreeVariables(const FunctionLiteral_t* func) {
+    FreeVisitor_t visitor = {
+        .base = { .expression = freeVisitExpression, .statement = NULL },
+        .bound = createVector(),
+        .free = createArenaVector(func->arena)
+    };
+
+    uint32_t paramCnt = functionLiteralGetParameterCount(func);
+    Identifier_t** paramBuf = functionLiteralGetParameters(func);
+    for (uint32_t i = 0; i < paramCnt; i++) {
+        vectorAppend(visitor.bound, (char*)paramBuf[i]->value);
+    }
+
+    // only unconditional top level lets are known to be bound for the
+    // statements after them, lets inside if blocks may never run
+    uint32_t cnt = blockStatementGetStatementCount(func->body);
+    Statement_t** stmts = blockStatementGetStatements(func->body);
+    for (uint32_t i = 0; i < cnt; i++) {
+        walkStatement(&visitor.base, stmts[i]);
+        if (stmts[i]->type == STATEMENT_LET) 
+            vectorAppend(visitor.bound, (char*)((LetStatement_t*)stmts[i])->name->value);
+    }
+
+    cleanupVector(&visitor.bound, NULL);
+    return visitor.free;
+}
+
+/************************************ 
+ *         SLOT RESOLUTION          *
+ ************************************/
+
+typedef struct SlotVisitor {
+    AstVisitor_t base;
+    const FunctionLiteral_t* func;
+    Vector_t* params; // names of the parameters of func
+} SlotVisitor_t;
+
+static void slotResolve(SlotVisitor_t* visitor, Identifier_t* ident) {
+    ident->paramSlot = findName(visitor->params, ident->value);
+    ident->captureSlot = findName(visitor->func->freeVariables, ident->value);
+}
+
+static bool slotVisitExpression(AstVisitor_t* visitor, const Expression_t* expr) {
+    if (expr->type == EXPRESSION_IDENTIFIER) {
+        slotResolve((SlotVisitor_t*)visitor, (Identifier_t*)expr);
+        return false;
+    }
+    // nested literals resolve against their own slots
+    return expr->type != EXPRESSION_FUNCTION_LITERAL;
+}
+
+static bool slotVisitStatement(AstVisitor_t* visitor, const Statement_t* stmt) {
+    // a let rebinding a parameter writes its slot
+    if (stmt->type == STATEMENT_LET) 
+        slotResolve((SlotVisitor_t*)visitor, ((LetStatement_t*)stmt)->name);
+    return true;
+}
+
+void analysisResolveSlots(FunctionLiteral_t* func) {
+    SlotVisitor_t visitor = {
+        .base = { .expression = slotVisitExpression, .statement = slotVisitStatement },
+        .func = func,
+        .params = createVector()
+    };
+
+    uint32_t paramCnt = functionLiteralGetParameterCount(func);
+    Identifier_t** paramBuf = functionLiteralGetParameters(func);
+    for (uint32_t i = 0; i < paramCnt; i++) {
+        vectorAppend(visitor.params, (char*)paramBuf[i]->value);
+    }
+
+    walkBlock(&visitor.base, func->body);
+    cleanupVector(&visitor.params, NULL);
+}
+
+void analysisFunctionLiteral(FunctionLiteral_t* func) {
+    func->frameEscapes = analysisFrameMayEscape(func->body);
+    func->freeVariables = analysisFreeVariables(func);
+    func->letBindings = analysisLetBindings(func->arena, func->body);
+    analysisResolveSlots(func);
+}
+
+/************************************ 
+ *             WALKER               *
+ ************************************/
+
+static void walkExpressions(AstVisitor_t* visitor, Vector_t* exprs) {
+    uint32_t cnt = vectorGetCount(exprs);
+    Expression_t** buf = (Expression_t**)vectorGetBuffer(exprs);
+    for (uint32_t i = 0; i < cnt; i++) {
+        walkExpression(visitor, buf[i]);
+    }
+}
+
+static void walkExpression(AstVisitor_t* visitor, const Expression_t* expr) {
+    if (!expr) 
+        return;
+    if (visitor->expression && !visitor->expression(visitor, expr))
+        return;
+
+    switch (expr->type) {
+        case EXPRESSION_PREFIX_EXPRESSION: 
+            walkExpression(visitor, ((PrefixExpression_t*)expr)->right);
+            break;
+
+        case EXPRESSION_INFIX_EXPRESSION: 
+            walkExpression(visitor, ((InfixExpression_t*)expr)->left);
+            walkExpression(visitor, ((InfixExpression_t*)expr)->right);
+            break;
+
+        case EXPRESSION_IF_EXPRESSION: 
+            walkExpression(visitor, ((IfExpression_t*)expr)->condition);
+            walkBlock(visitor, ((IfExpression_t*)expr)->consequence);
+            walkBlock(visitor, ((IfExpression_t*)expr)->alternative);
+            break;
+
+        case EXPRESSION_FUNCTION_LITERAL: 
+            walkBlock(visitor, ((FunctionLiteral_t*)expr)->body);
+            break;
+
+        case EXPRESSION_CALL_EXPRESSION: 
+            walkExpression(visitor, ((CallExpression_t*)expr)->function);
+            walkExpressions(visitor, ((CallExpression_t*)expr)->arguments);
+            break;
+
+        case EXPRESSION_INDEX_EXPRESSION: 
+            walkExpression(visitor, ((IndexExpression_t*)expr)->left);
+            walkExpression(visitor, ((IndexExpression_t*)expr)->right);
+            break;
+
+        case EXPRESSION_ARRAY_LITERAL: 
+            walkExpressions(visitor, ((ArrayLiteral_t*)expr)->elements);
+            break;
+
+        case EXPRESSION_HASH_LITERAL: 
+            walkExpressions(visitor, ((HashLiteral_t*)expr)->keys);
+            walkExpressions(visitor, ((HashLiteral_t*)expr)->values);
+            break;
+
+        default: 
+            // identifiers and scalar literals have no children
+            break;
+    }
+}
+
+static void walkStatement(AstVisitor_t* visitor, const Statement_t* stmt) {
+    if (visitor->statement && !visitor->statement(visitor, stmt))
+        return;
+
+    switch (stmt->type) {
+        case STATEMENT_LET:
+            walkExpression(visitor, ((LetStatement_t*)stmt)->value);
+            break;
+        case STATEMENT_RETURN:
+            walkExpression(visitor, ((ReturnStatement_t*)stmt)->returnValue);
+            break;
+        case STATEMENT_EXPRESSION:
+            walkExpression(visitor, ((ExpressionStatement_t*)stmt)->expression);
+            break;
+        case STATEMENT_BLOCK:
+            walkBlock(visitor, (BlockStatement_t*)stmt);
+            break;
+        default:
+            break;
+    }
+}
+
+static void walkBlock(AstVisitor_t* visitor, const BlockStatement_t* block) {
+    if (!block) 
+        return;
+
+    uint32_t cnt = blockStatementGetStatementCount(block);
+    Statement_t** stmts = blockStatementGetStatements(block);
+    for (uint32_t i = 0; i < cnt; i++) {
+        walkStatement(visitor, stmts[i]);
+    }
+}
+
+/************************************ 
+ *             UTILS                *
+ ************************************/
+
+static bool containsName(Vector_t* names, const char* name) {
+    return findName(names, name) >= 0;
+}
+
+static int32_t findName(Vector_t* names, const char* name) {
+    uint32_t cnt = vectorGetCount(names);
+    char** buf = (char**)vectorGetBuffer(names);
+    for (uint32_t i = 0; i < cnt; i++) {
+        if (strcmp(buf[i], name) == 0) 
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,37 @@
+#ifndef _ANALYSIS_H_
+#define _ANALYSIS_H_
+
+#include <stdbool.h>
+#include "ast.h"
+#include "vector.h"
+
+// Static checks run over function bodies before they are evaluated.
+
+// True when a call frame running body can be referenced after the call
+// returns. The only way a frame escapes is by being captured as the
+// defining environment of a function literal evaluated inside the body.
+bool analysisFrameMayEscape(const BlockStatement_t* body);
+
+// Names referenced by a function that are neither parameters nor bound
+// by a preceding top level let of its body. Nested function literals
+// contribute their own free variables, already analysed ones are not
+// walked again. Returns a vector without duplicates (may over approximate,
+// never under approximate). Vector and names live in the function's arena.
+Vector_t* analysisFreeVariables(const FunctionLiteral_t* func);
+
+// Names bound by let statements anywhere in body, excluding nested
+// function literals. A name bound twice appears twice. Vector and names
+// live in arena.
+Vector_t* analysisLetBindings(Arena_t* arena, const BlockStatement_t* body);
+
+// Sets the slot indexes of every identifier in the body of func, nested
+// function literals excluded, to the position of the name among the
+// parameters and free variables of func. Needs func->freeVariables.
+void analysisResolveSlots(FunctionLiteral_t* func);
+
+// Runs the analyses above once and stores the results on the literal,
+// every function created from it shares them. The parser calls this as
+// soon as a literal is complete, nested literals come first.
+void analysisFunctionLiteral(FunctionLiteral_t* func);
+
+#endif
@@ -9,7 +9,6 @@
  *       COMMON UTILS DEF           *
  ************************************/
 
-static void cleanupStatementVec(Vector_t** statements);
 static char* statementVecToString(Vector_t* statements, bool indent);
 
 
@@ -17,39 +16,6 @@ static char* statementVecToString(Vector_t* statements, bool indent);
  *         EXPRESSION NODE          *
  ************************************/
 
-static ExpressionCleanupFn_t expressionCleanupFns[] = {
-    [EXPRESSION_IDENTIFIER]=(ExpressionCleanupFn_t)cleanupIdentifier,
-    [EXPRESSION_INTEGER_LITERAL]=(ExpressionCleanupFn_t)cleanupIntegerLiteral,
-    [EXPRESSION_STRING_LITERAL]=(ExpressionCleanupFn_t)cleanupStringLiteral,
-    [EXPRESSION_BOOLEAN_LITERAL]=(ExpressionCleanupFn_t)cleanupBooleanLiteral,
-    [EXPRESSION_ARRAY_LITERAL]=(ExpressionCleanupFn_t)cleanupArrayLiteral,
-    [EXPRESSION_INDEX_EXPRESSION]=(ExpressionCleanupFn_t)cleanupIndexExpression,
-    [EXPRESSION_PREFIX_EXPRESSION]=(ExpressionCleanupFn_t)cleanupPrefixExpression,
-    [EXPRESSION_INFIX_EXPRESSION]=(ExpressionCleanupFn_t)cleanupInfixExpression,
-    [EXPRESSION_IF_EXPRESSION]=(ExpressionCleanupFn_t)cleanupIfExpression,
-    [EXPRESSION_FUNCTION_LITERAL]=(ExpressionCleanupFn_t)cleanupFunctionLiteral,
-    [EXPRESSION_CALL_EXPRESSION]=(ExpressionCleanupFn_t)cleanupCallExpression,
-    [EXPRESSION_HASH_LITERAL]=(ExpressionCleanupFn_t)cleanupHashLiteral,
-    [EXPRESSION_INVALID]=NULL
-};
-
-static ExpressionCopyFn_t expressionCopyFns[] = {
-    [EXPRESSION_IDENTIFIER]=(ExpressionCopyFn_t)copyIdentifier,
-    [EXPRESSION_INTEGER_LITERAL]=(ExpressionCopyFn_t)copyIntegerLiteral,
-    [EXPRESSION_STRING_LITERAL]=(ExpressionCopyFn_t)copyStringLiteral,
-    [EXPRESSION_BOOLEAN_LITERAL]=(ExpressionCopyFn_t)copyBooleanLiteral,
-    [EXPRESSION_ARRAY_LITERAL]=(ExpressionCopyFn_t)copyArrayLiteral,
-    [EXPRESSION_INDEX_EXPRESSION]=(ExpressionCopyFn_t)copyIndexExpression,
-    [EXPRESSION_PREFIX_EXPRESSION]=(ExpressionCopyFn_t)copyPrefixExpression,
-    [EXPRESSION_INFIX_EXPRESSION]=(ExpressionCopyFn_t)copyInfixExpression,
-    [EXPRESSION_IF_EXPRESSION]=(ExpressionCopyFn_t)copyIfExpression,
-    [EXPRESSION_FUNCTION_LITERAL]=(ExpressionCopyFn_t)copyFunctionLiteral,
-    [EXPRESSION_CALL_EXPRESSION]=(ExpressionCopyFn_t)copyCallExpression,
-    [EXPRESSION_HASH_LITERAL]=(ExpressionCopyFn_t)copyHashLiteral,
-    [EXPRESSION_INVALID]=NULL
-};
-
-
 static ExpressionToStringFn_t expressionToStringFns[] = {
     [EXPRESSION_IDENTIFIER]=(ExpressionToStringFn_t)identifierToString,
     [EXPRESSION_INTEGER_LITERAL]=(ExpressionToStringFn_t)integerLiteralToString,
@@ -67,24 +33,6 @@ static ExpressionToStringFn_t expressionToStringFns[] = {
 };
 
 
-void cleanupExpression(Expression_t** expr) { 
-    if (*expr == NULL)
-        return;
-    
-    if ((*expr)->type  >= 0  && (*expr)->type < EXPRESSION_INVALID) {
-        ExpressionCleanupFn_t cleanupFn = expressionCleanupFns[(*expr)->type];
-        cleanupFn((void**)expr);
-    }
-}
-
-Expression_t* copyExpression(Expression_t* expr) {
-    if (expr && expr->type  >= 0 && expr->type < EXPRESSION_INVALID) {
-        ExpressionCopyFn_t copyFn = expressionCopyFns[expr->type];
-        return copyFn((void*)expr);
-    }
-    return NULL;
-}
-
 char* expressionToString(Expression_t* expr) {
     if (expr && expr->type  >= 0 && expr->type < EXPRESSION_INVALID) {
         ExpressionToStringFn_t toStringFn = expressionToStringFns[expr->type];
@@ -93,11 +41,11 @@ char* expressionToString(Expression_t* expr) {
     return cloneString("");
 }
 
-const char* expressionTokenLiteral(Expression_t* expr) {
+char* expressionTokenLiteral(Expression_t* expr) {
     if (expr && expr->type  >= 0 && expr->type < EXPRESSION_INVALID) {
-        return expr->token->literal; 
+        return tokenToString(expr->token); 
     }
-    return "";
+    return cloneString("");
 }
 
 
@@ -105,33 +53,20 @@ const char* expressionTokenLiteral(Expression_t* expr) {
  *           IDENTIFIER             *
  ************************************/
 
-Identifier_t* createIdentifier(const Token_t* tok, const char* val) {
-    Identifier_t* ident = mallocChk(sizeof(Identifier_t));
+Identifier_t* createIdentifier(Arena_t* arena, const Token_t* tok) {
+    Identifier_t* ident = arenaAlloc(arena, sizeof(Identifier_t));
 
     *ident =  (Identifier_t) {
         .type = EXPRESSION_IDENTIFIER,
-        .token = copyToken(tok),
-        .value = cloneString(val)
+        .token = tok,
+        .value = arenaCloneSubstring(arena, tokenText(tok), tok->length),
+        .paramSlot = -1,
+        .captureSlot = -1
     };
 
     return ident;
 }
 
-Identifier_t* copyIdentifier(const Identifier_t* ident){
-    return createIdentifier(ident->token, ident->value);
-}
-
-void cleanupIdentifier(Identifier_t** ident) {
-    if (!(*ident))
-        return;
-
-    cleanupToken(&(*ident)->token);
-    free((void*)(*ident)->value);
-    
-    free(*ident);
-    *ident = NULL;
-}
-
 char* identifierToString(const Identifier_t* ident) {
     // Return a copy to avoid free errors
     return cloneString(ident->value);
@@ -142,33 +77,19 @@ char* identifierToString(const Identifier_t* ident) {
  *      INTEGER LITERAL             *
  ************************************/
 
-IntegerLiteral_t* createIntegerLiteral(const Token_t* tok) {
-    IntegerLiteral_t* il = mallocChk(sizeof(IntegerLiteral_t));
+IntegerLiteral_t* createIntegerLiteral(Arena_t* arena, const Token_t* tok) {
+    IntegerLiteral_t* il = arenaAlloc(arena, sizeof(IntegerLiteral_t));
 
     *il = (IntegerLiteral_t) {
         .type = EXPRESSION_INTEGER_LITERAL,
-        .token = copyToken(tok),
+        .token = tok,
         .value = 0
     };
     return il;
 }
 
-IntegerLiteral_t* copyIntegerLiteral(const IntegerLiteral_t* il){
-    IntegerLiteral_t* newIl = createIntegerLiteral(il->token);
-    newIl->value = il->value;
-    return newIl;
-}
-
-void cleanupIntegerLiteral(IntegerLiteral_t** il) {
-    if (!(*il)) return;
-    
-    cleanupToken(&(*il)->token);
-    free(*il);
-    *il = NULL;
-}
-
 char* integerLiteralToString(const IntegerLiteral_t* il) {
-    return cloneString(il->token->literal);
+    return tokenToString(il->token);
 }
 
 
@@ -176,33 +97,18 @@ char* integerLiteralToString(const IntegerLiteral_t* il) {
  *          BOOLEAN                 *
  ************************************/
 
-BooleanLiteral_t* createBooleanLiteral(const Token_t* tok) {
-    BooleanLiteral_t* bl = mallocChk(sizeof(BooleanLiteral_t));
+BooleanLiteral_t* createBooleanLiteral(Arena_t* arena, const Token_t* tok) {
+    BooleanLiteral_t* bl = arenaAlloc(arena, sizeof(BooleanLiteral_t));
 
     *bl = (BooleanLiteral_t) {
         .type = EXPRESSION_BOOLEAN_LITERAL,
-        .token = copyToken(tok),
+        .token = tok,
         .value = false
     };
 
     return bl;
 }
 
-BooleanLiteral_t* copyBooleanLiteral(const BooleanLiteral_t* bl) {
-    BooleanLiteral_t* newBl = createBooleanLiteral(bl->token);
-    newBl->value = bl->value;
-    return newBl;
-}
-
-void cleanupBooleanLiteral(BooleanLiteral_t** bl) {
-    if (!(*bl)) return;
-    
-    cleanupToken(&(*bl)->token);
-
-    free(*bl);
-    *bl = NULL;
-}
-
 char* booleanLiteralToString(const BooleanLiteral_t* bl) {
     return bl->value ? cloneString("true") : cloneString("false");
 }
@@ -211,33 +117,16 @@ char* booleanLiteralToString(const BooleanLiteral_t* bl) {
  *        STRING LITERAL            *
  ************************************/
 
-StringLiteral_t* createStringLiteral(const Token_t* tok) {
-    StringLiteral_t* sl = mallocChk(sizeof(StringLiteral_t));
+StringLiteral_t* createStringLiteral(Arena_t* arena, const Token_t* tok) {
+    StringLiteral_t* sl = arenaAlloc(arena, sizeof(StringLiteral_t));
     *sl = (StringLiteral_t) {
         .type = EXPRESSION_STRING_LITERAL, 
-        .token = copyToken(tok),
+        .token = tok,
         .value = NULL
     };
     return sl;
 }
 
-StringLiteral_t* copyStringLiteral(const StringLiteral_t* sl) {
-    StringLiteral_t* newSl = createStringLiteral(sl->token);
-    newSl->value = cloneString(sl->value);
-    return newSl;
-}
-
-void cleanupStringLiteral(StringLiteral_t** sl) {
-    if(!(*sl)) return;
-
-    cleanupToken(&(*sl)->token); 
-    if((*sl)->value) 
-        free((*sl)->value);
-    
-    free((*sl));
-    *sl = NULL;
-}
-
 char* stringLiteralToString(const StringLiteral_t* sl) {
     return cloneString(sl->value);    
 }
@@ -247,31 +136,16 @@ char* stringLiteralToString(const StringLiteral_t* sl) {
  *        ARRAY LITERAL             *
  ************************************/
 
-ArrayLiteral_t* createArrayLiteral(const Token_t* tok) {
-    ArrayLiteral_t* al = mallocChk(sizeof(ArrayLiteral_t));
+ArrayLiteral_t* createArrayLiteral(Arena_t* arena, const Token_t* tok) {
+    ArrayLiteral_t* al = arenaAlloc(arena, sizeof(ArrayLiteral_t));
     *al = (ArrayLiteral_t) {
         .type = EXPRESSION_ARRAY_LITERAL,
-        .token = copyToken(tok),
+        .token = tok,
         .elements = NULL
     };
     return al;
 }
 
-ArrayLiteral_t* copyArrayLiteral(const ArrayLiteral_t* al) {
-    ArrayLiteral_t* newAl = createArrayLiteral(al->token);
-    newAl->elements = copyVector(al->elements, (VectorElemCopyFn_t)copyExpression);
-    return newAl;
-}
-
-void cleanupArrayLiteral(ArrayLiteral_t** al) {
-    if (!(*al)) return;
-
-    cleanupToken(&(*al)->token);
-    cleanupVector(&(*al)->elements, (VectorElemCleanupFn_t)cleanupExpression);
-    free(*al);
-    *al = NULL;
-}
-
 char* arrayLiteralToString(const ArrayLiteral_t* al) {
     Strbuf_t* sbuf = createStrbuf();
     strbufWrite(sbuf, "[");
@@ -301,37 +175,17 @@ Expression_t** arrayLiteralGetElements(const ArrayLiteral_t* al) {
  *         HASH LITERAL             *
  ************************************/
 
-HashLiteral_t *createHashLiteral(const Token_t *tok) {
-    HashLiteral_t* hash = mallocChk(sizeof(HashLiteral_t));
+HashLiteral_t *createHashLiteral(Arena_t* arena, const Token_t *tok) {
+    HashLiteral_t* hash = arenaAlloc(arena, sizeof(HashLiteral_t));
     *hash = (HashLiteral_t) {
         .type = EXPRESSION_HASH_LITERAL,
-        .token = copyToken(tok),
-        .keys = createVector(),
-        .values = createVector()
+        .token = tok,
+        .keys = createArenaVector(arena),
+        .values = createArenaVector(arena)
     };
     return hash;
 }
 
-HashLiteral_t *copyHashLiteral(const HashLiteral_t *hl) {
-    HashLiteral_t* newHash = mallocChk(sizeof(HashLiteral_t));
-    *newHash = (HashLiteral_t) {
-        .type = EXPRESSION_HASH_LITERAL,
-        .token = copyToken(hl->token),
-        .keys = copyVector(hl->keys, (VectorElemCopyFn_t)copyExpression),
-        .values = copyVector(hl->values, (VectorElemCopyFn_t)copyExpression),
-    };
-    return newHash;
-}
-
-void cleanupHashLiteral(HashLiteral_t **hl) {
-    if(!(*hl)) return;
-    cleanupToken(&(*hl)->token);
-    cleanupVector(&(*hl)->keys, (VectorElemCleanupFn_t)cleanupExpression);
-    cleanupVector(&(*hl)->values, (VectorElemCleanupFn_t)cleanupExpression);
-    free(*hl);
-    *hl = NULL;
-}
-
 char *hashLiteralToString(const HashLiteral_t *al) {
     Strbuf_t* sbuf = createStrbuf();
 
@@ -378,35 +232,17 @@ void hashLiteralSetPair(HashLiteral_t* hl, Expression_t* key, Expression_t* valu
  *       INDEX EXPRESSION           *
  ************************************/
 
-IndexExpression_t* createIndexExpression(const Token_t* tok) {
-    IndexExpression_t* expr = mallocChk(sizeof(IndexExpression_t));
+IndexExpression_t* createIndexExpression(Arena_t* arena, const Token_t* tok) {
+    IndexExpression_t* expr = arenaAlloc(arena, sizeof(IndexExpression_t));
     *expr = (IndexExpression_t) {
         .type = EXPRESSION_INDEX_EXPRESSION,
-        .token = copyToken(tok),
+        .token = tok,
         .left = NULL, 
         .right = NULL,
     };
     return expr; 
 }
 
-IndexExpression_t* copyIndexExpression(const IndexExpression_t* al) {
-    IndexExpression_t* newExpr = createIndexExpression(al->token);
-    newExpr->left = copyExpression(al->left);
-    newExpr->right = copyExpression(al->right);
-    return newExpr; 
-}
-
-void cleanupIndexExpression(IndexExpression_t** al) {
-    if(!(*al)) return;
-
-    cleanupToken(&(*al)->token);
-    cleanupExpression(&(*al)->left);
-    cleanupExpression(&(*al)->right);
-    free(*al);
-    *al = NULL;
-}
-
-
 char* indexExpressionToString(const IndexExpression_t* al) {
     Strbuf_t* sbuf = createStrbuf();
     strbufWrite(sbuf, "(");
@@ -423,12 +259,12 @@ char* indexExpressionToString(const IndexExpression_t* al) {
  *      PREFIX EXPRESSION           *
  ************************************/
 
-PrefixExpression_t* createPrefixExpresion(const Token_t* tok) {
-    PrefixExpression_t* exp = mallocChk(sizeof(PrefixExpression_t));
+PrefixExpression_t* createPrefixExpresion(Arena_t* arena, const Token_t* tok) {
+    PrefixExpression_t* exp = arenaAlloc(arena, sizeof(PrefixExpression_t));
 
     *exp = (PrefixExpression_t) {
         .type = EXPRESSION_PREFIX_EXPRESSION,
-        .token = copyToken(tok),
+        .token = tok,
         .operator = NULL,
         .right = NULL
     };
@@ -436,24 +272,6 @@ PrefixExpression_t* createPrefixExpresion(const Token_t* tok) {
     return exp;
 }
 
-PrefixExpression_t* copyPrefixExpression(const PrefixExpression_t* exp) {
-    PrefixExpression_t* newExp = createPrefixExpresion(exp->token);
-    newExp->operator = cloneString(exp->operator);
-    newExp->right = copyExpression(exp->right);
-    return newExp;
-}
-
-void cleanupPrefixExpression(PrefixExpression_t** exp) {
-    if (!(*exp)) return;
-
-    cleanupToken(&(*exp)->token);
-    free((*exp)->operator);
-    cleanupExpression(&(*exp)->right);
-    
-    free(*exp);
-    *exp = NULL;
-}
-
 char* prefixExpressionToString(const PrefixExpression_t* exp) {
     Strbuf_t* sbuf = createStrbuf();
 
@@ -471,12 +289,12 @@ char* prefixExpressionToString(const PrefixExpression_t* exp) {
  *      INFIX EXPRESSION           *
  ************************************/
 
-InfixExpression_t* createInfixExpresion(const Token_t* tok) {
-    InfixExpression_t* exp = mallocChk(sizeof(InfixExpression_t));
+InfixExpression_t* createInfixExpresion(Arena_t* arena, const Token_t* tok) {
+    InfixExpression_t* exp = arenaAlloc(arena, sizeof(InfixExpression_t));
 
     *exp = (InfixExpression_t) {
         .type = EXPRESSION_INFIX_EXPRESSION,
-        .token = copyToken(tok),
+        .token = tok,
         .left = NULL, 
         .operator = NULL, 
         .right = NULL
@@ -485,26 +303,6 @@ InfixExpression_t* createInfixExpresion(const Token_t* tok) {
     return exp;
 }
 
-InfixExpression_t* copyInfixExpression(const InfixExpression_t* exp) {
-    InfixExpression_t* newExp = createInfixExpresion(exp->token);
-    newExp->left = copyExpression(exp->left);
-    newExp->operator = cloneString(exp->operator);
-    newExp->right = copyExpression(exp->right);
-    return newExp;
-}
-
-void cleanupInfixExpression(InfixExpression_t** exp) {
-    if (!(*exp))return;
-    
-    cleanupToken(&(*exp)->token);
-    cleanupExpression(&(*exp)->left);
-    free((*exp)->operator);
-    cleanupExpression(&(*exp)->right);
-
-    free(*exp);
-    *exp = NULL;
-}
-
 char* infixExpressionToString(const InfixExpression_t* exp) {
     Strbuf_t* sbuf = createStrbuf();
 
@@ -524,12 +322,12 @@ char* infixExpressionToString(const InfixExpression_t* exp) {
  *          IF EXPRESSION           *
  ************************************/
 
-IfExpression_t* createIfExpresion(const Token_t* tok) {
-    IfExpression_t* exp = mallocChk(sizeof(IfExpression_t));
+IfExpression_t* createIfExpresion(Arena_t* arena, const Token_t* tok) {
+    IfExpression_t* exp = arenaAlloc(arena, sizeof(IfExpression_t));
 
     *exp = (IfExpression_t) {
         .type = EXPRESSION_IF_EXPRESSION, 
-        .token = copyToken(tok),
+        .token = tok,
         .condition = NULL, 
         .consequence = NULL, 
         .alternative = NULL
@@ -538,26 +336,6 @@ IfExpression_t* createIfExpresion(const Token_t* tok) {
     return exp;
 }
 
-IfExpression_t* copyIfExpression(const IfExpression_t* exp) {
-    IfExpression_t* newExp = createIfExpresion(exp->token);
-    newExp->condition = copyExpression(exp->condition);
-    newExp->consequence = copyBlockStatement(exp->consequence);
-    newExp->alternative = exp->alternative ? copyBlockStatement(exp->alternative) : NULL;
-    return newExp;
-}
-
-void cleanupIfExpression(IfExpression_t** exp) {
-    if (!(*exp)) return;
-
-    cleanupToken(&(*exp)->token);
-    cleanupExpression(&(*exp)->condition);
-    cleanupBlockStatement(&(*exp)->consequence);
-    cleanupBlockStatement(&(*exp)->alternative);
-
-    free(*exp);
-    *exp = NULL;
-}
-
 char* ifExpressionToString(const IfExpression_t* exp) {
     Strbuf_t* sbuf = createStrbuf();
 
@@ -580,46 +358,27 @@ char* ifExpressionToString(const IfExpression_t* exp) {
  *    FUNCTION EXPRESSION           *
  ************************************/
 
-FunctionLiteral_t* createFunctionLiteral(const Token_t* tok) {
-    FunctionLiteral_t *exp = mallocChk(sizeof(FunctionLiteral_t));
+FunctionLiteral_t* createFunctionLiteral(Arena_t* arena, const Token_t* tok) {
+    FunctionLiteral_t *exp = arenaAlloc(arena, sizeof(FunctionLiteral_t));
 
     *exp = (FunctionLiteral_t) {
         .type = EXPRESSION_FUNCTION_LITERAL, 
-        .token = copyToken(tok),
-        .parameters = createVector(),
-        .body = NULL
+        .token = tok,
+        .parameters = createArenaVector(arena),
+        .body = NULL,
+        .arena = arena,
+        .frameEscapes = true, // safe until the body was analysed
+        .freeVariables = NULL,
+        .letBindings = NULL
     };
 
     return exp;
 }
 
-FunctionLiteral_t* copyFunctionLiteral(const FunctionLiteral_t* exp) {
-    FunctionLiteral_t* newExp = mallocChk(sizeof(FunctionLiteral_t));
-    *newExp = (FunctionLiteral_t) {
-        .type = EXPRESSION_FUNCTION_LITERAL, 
-        .token = copyToken(exp->token),
-        .parameters = copyVector(exp->parameters, (VectorElemCopyFn_t)copyExpression),
-        .body = copyBlockStatement(exp->body)
-    };
-
-    return newExp;
-}
-
-void cleanupFunctionLiteral(FunctionLiteral_t** exp) {
-    if (!(*exp)) return;
-
-    cleanupToken(&(*exp)->token);
-    cleanupVector(&(*exp)->parameters, (VectorElemCleanupFn_t)cleanupIdentifier);
-    cleanupBlockStatement(&(*exp)->body);
-
-    free(*exp);
-    *exp = NULL;
-}
-
 char* functionLiteralToString(const FunctionLiteral_t* exp) {
     Strbuf_t* sbuf = createStrbuf();
 
-    strbufWrite(sbuf, exp->token->literal);
+    strbufConsume(sbuf, tokenToString(exp->token));
     strbufWrite(sbuf, "(");
     uint32_t paramCnt = functionLiteralGetParameterCount(exp);
     Identifier_t** params = functionLiteralGetParameters(exp);
@@ -652,12 +411,12 @@ Identifier_t** functionLiteralGetParameters(const FunctionLiteral_t* exp) {
  *        CALL EXPRESSION           *
  ************************************/
 
-CallExpression_t* createCallExpression(const Token_t* tok) {
-    CallExpression_t* exp = mallocChk(sizeof(CallExpression_t));
+CallExpression_t* createCallExpression(Arena_t* arena, const Token_t* tok) {
+    CallExpression_t* exp = arenaAlloc(arena, sizeof(CallExpression_t));
 
     *exp = (CallExpression_t) {
         .type = EXPRESSION_CALL_EXPRESSION, 
-        .token =  copyToken(tok),
+        .token =  tok,
         .function = NULL, 
         .arguments = NULL
     };
@@ -665,29 +424,6 @@ CallExpression_t* createCallExpression(const Token_t* tok) {
     return exp;
 }
 
-CallExpression_t* copyCallExpression(const CallExpression_t* exp) {
-    CallExpression_t* newExp = mallocChk(sizeof(CallExpression_t));
-    *newExp = (CallExpression_t) {
-        .type = EXPRESSION_CALL_EXPRESSION, 
-        .token =  copyToken(exp->token),
-        .function = copyExpression(exp->function),
-        .arguments = copyVector(exp->arguments, (VectorElemCopyFn_t)copyExpression)
-    };
-
-    return newExp;
-}
-
-void cleanupCallExpression(CallExpression_t** exp) {
-    if (!(*exp)) return;
-    
-    cleanupToken(&(*exp)->token);
-    cleanupExpression(&(*exp)->function);
-    cleanupVector(&(*exp)->arguments,(VectorElemCleanupFn_t) cleanupExpression);
-
-    free(*exp);
-    *exp = NULL;
-}
-
 char* callExpressionToString(const CallExpression_t* exp) {
     Strbuf_t* sbuf = createStrbuf();
 
@@ -728,23 +464,6 @@ Expression_t** callExpressionGetArguments(const CallExpression_t* exp) {
  *         GENERIC STATEMENT        *
  ************************************/
 
-static StatementCleanupFn_t statementCleanupFns[] = {
-    [STATEMENT_LET]=(StatementCleanupFn_t)cleanupLetStatement,
-    [STATEMENT_RETURN]=(StatementCleanupFn_t)cleanupReturnStatement,
-    [STATEMENT_EXPRESSION]=(StatementCleanupFn_t)cleanupExpressionStatement,
-    [STATEMENT_BLOCK]=(StatementCleanupFn_t)cleanupBlockStatement,
-    [STATEMENT_INVALID]=NULL
-};
-
-static StatementCopyFn_t statementCopyFns[] = {
-    [STATEMENT_LET]=(StatementCopyFn_t)copyLetStatement,
-    [STATEMENT_RETURN]=(StatementCopyFn_t)copyReturnStatement,
-    [STATEMENT_EXPRESSION]=(StatementCopyFn_t)copyExpressionStatement,
-    [STATEMENT_BLOCK]=(StatementCopyFn_t)copyBlockStatement,
-    [STATEMENT_INVALID]=NULL
-};
-
-
 static StatementToStringFn_t statementToStringFns[] = {
     [STATEMENT_LET]=(StatementToStringFn_t)letStatementToString,
     [STATEMENT_RETURN]=(StatementToStringFn_t)returnStatementToString,
@@ -755,26 +474,11 @@ static StatementToStringFn_t statementToStringFns[] = {
 
 
 
-void cleanupStatement(Statement_t** st) {
-    if (st && (*st)->type >= 0 && (*st)->type < STATEMENT_INVALID) {
-        StatementCleanupFn_t cleanupFn = statementCleanupFns[(*st)->type];
-        cleanupFn((void**) st);
-    }
-}
-
-Statement_t* copyStatement(const Statement_t* st) {
-    if (st && (st->type >= 0) && (st->type <= STATEMENT_INVALID) ) {
-        StatementCopyFn_t copyFn = statementCopyFns[st->type];
-        return copyFn(st);
-    }
-    return NULL;
-}
-
-const char* statementTokenLiteral(const Statement_t* st) {
+char* statementTokenLiteral(const Statement_t* st) {
     if (st && st->type >= 0 && st->type <STATEMENT_INVALID ) {
-        return st->token->literal;
+        return tokenToString(st->token);
     }
-    return "";
+    return cloneString("");
 }
 
 char* statementToString(const Statement_t* st) {
@@ -790,12 +494,12 @@ char* statementToString(const Statement_t* st) {
  *         LET STATEMENT            *
  ************************************/
 
-LetStatement_t* createLetStatement(const Token_t* token) {
-    LetStatement_t* st = mallocChk(sizeof(LetStatement_t));
+LetStatement_t* createLetStatement(Arena_t* arena, const Token_t* token) {
+    LetStatement_t* st = arenaAlloc(arena, sizeof(LetStatement_t));
 
     *st = (LetStatement_t) {
         .type = STATEMENT_LET, 
-        .token = copyToken(token),
+        .token = token,
         .name = NULL,
         .value = NULL
     };
@@ -803,28 +507,10 @@ LetStatement_t* createLetStatement(const Token_t* token) {
     return st;
 }
 
-LetStatement_t* copyLetStatement(const LetStatement_t* st) {
-    LetStatement_t* newSt = createLetStatement(st->token);
-    newSt->name = copyIdentifier(st->name);
-    newSt->value = copyExpression(st->value);
-    return newSt;
-}
-
-void cleanupLetStatement(LetStatement_t** st) {
-    if (!(*st)) return;
-
-    cleanupToken(&(*st)->token);
-    cleanupIdentifier(&(*st)->name);
-    cleanupExpression(&(*st)->value);
-    
-    free(*st);
-    *st = NULL;
-}
-
 char* letStatementToString(const LetStatement_t* st) {
     Strbuf_t* sbuf = createStrbuf();
     
-    strbufWrite(sbuf, st->token->literal);
+    strbufConsume(sbuf, tokenToString(st->token));
     strbufWrite(sbuf, " ");
     strbufConsume(sbuf, identifierToString(st->name));
     strbufWrite(sbuf, " = ");
@@ -841,38 +527,22 @@ char* letStatementToString(const LetStatement_t* st) {
  *      RETURN STATEMENT            *
  ************************************/
 
-ReturnStatement_t* createReturnStatement(const Token_t* token) {
-    ReturnStatement_t* st = mallocChk(sizeof(ReturnStatement_t));
+ReturnStatement_t* createReturnStatement(Arena_t* arena, const Token_t* token) {
+    ReturnStatement_t* st = arenaAlloc(arena, sizeof(ReturnStatement_t));
     
     *st = (ReturnStatement_t) {
         .type = STATEMENT_RETURN,
-        .token = copyToken(token),
+        .token = token,
         .returnValue = NULL 
     };
 
     return st;
 }
 
-ReturnStatement_t* copyReturnStatement(const ReturnStatement_t* st) {
-    ReturnStatement_t* newSt = createReturnStatement(st->token);
-    newSt->returnValue = copyExpression(st->returnValue);
-    return newSt;
-}
-
-void cleanupReturnStatement(ReturnStatement_t** st) {
-    if (!(*st)) return;
-    
-    cleanupToken(&(*st)->token);
-    cleanupExpression(&(*st)->returnValue);
-    
-    free(*st);
-    *st = NULL;
-}
-
 char* returnStatementToString(const ReturnStatement_t* st) {
     Strbuf_t* sbuf = createStrbuf();
 
-    strbufWrite(sbuf, st->token->literal);
+    strbufConsume(sbuf, tokenToString(st->token));
     strbufWrite(sbuf, " ");
 
     if (st->returnValue != NULL) {
@@ -887,34 +557,18 @@ char* returnStatementToString(const ReturnStatement_t* st) {
  *      EXPRESSION STATEMENT        *
  ************************************/
 
-ExpressionStatement_t* createExpressionStatement(const Token_t* token) {
-    ExpressionStatement_t* st = mallocChk(sizeof(ExpressionStatement_t));
+ExpressionStatement_t* createExpressionStatement(Arena_t* arena, const Token_t* token) {
+    ExpressionStatement_t* st = arenaAlloc(arena, sizeof(ExpressionStatement_t));
 
     *st = (ExpressionStatement_t) {
         .type = STATEMENT_EXPRESSION, 
-        .token = copyToken(token),
+        .token = token,
         .expression = NULL
     };
 
     return st;
 }
 
-ExpressionStatement_t* copyExpressionStatement(const ExpressionStatement_t* st) {
-    ExpressionStatement_t* newSt = createExpressionStatement(st->token);
-    newSt->expression = copyExpression(st->expression);
-    return newSt;
-}
-
-void cleanupExpressionStatement(ExpressionStatement_t** st) {
-    if (!(*st))return;
-
-    cleanupToken(&(*st)->token);
-    cleanupExpression(&(*st)->expression);
-
-    free(*st);
-    *st = NULL;
-}
-
 char* expressionStatementToString(const ExpressionStatement_t* st) {
     if (st->expression != NULL) {
         return expressionToString(st->expression);
@@ -928,39 +582,18 @@ char* expressionStatementToString(const ExpressionStatement_t* st) {
  *         BLOCK STATEMENT          *
  ************************************/
 
-BlockStatement_t* createBlockStatement(const Token_t* token) {
-    BlockStatement_t* st = mallocChk(sizeof(BlockStatement_t));
+BlockStatement_t* createBlockStatement(Arena_t* arena, const Token_t* token) {
+    BlockStatement_t* st = arenaAlloc(arena, sizeof(BlockStatement_t));
 
     *st = (BlockStatement_t) {
         .type = STATEMENT_BLOCK, 
-        .token = copyToken(token),
-        .statements = createVector()
+        .token = token,
+        .statements = createArenaVector(arena)
     };
 
     return st;
 }
 
-BlockStatement_t* copyBlockStatement(const BlockStatement_t* st) {
-    BlockStatement_t* newSt =  mallocChk(sizeof(BlockStatement_t));
-    *newSt = (BlockStatement_t) {
-        .type = STATEMENT_BLOCK, 
-        .token = copyToken(st->token),
-        .statements = copyVector(st->statements, (VectorElemCopyFn_t)copyStatement)
-    };
-
-    return newSt;
-}
-
-void cleanupBlockStatement(BlockStatement_t** st) {
-    if (!(*st)) return;
-    
-    cleanupToken(&(*st)->token);
-    cleanupStatementVec(&(*st)->statements);
-    
-    free(*st);
-    *st = NULL;
-}
-
 char* blockStatementToString(const BlockStatement_t* st) {
     return statementVecToString(st->statements, true);
 }
@@ -982,11 +615,12 @@ void blockStatementAppendStatement(BlockStatement_t* block, const Statement_t* s
  *      PROGRAM NODE                *
  ************************************/
 
-Program_t* createProgram() {
-    Program_t* prog = (Program_t*) malloc(sizeof(Program_t));
-    if (prog == NULL)
-        return NULL;
-    prog->statements = createVector();
+Program_t* createProgram(Arena_t* arena) {
+    Program_t* prog = arenaAlloc(arena, sizeof(Program_t));
+    *prog = (Program_t) {
+        .statements = createArenaVector(arena),
+        .arena = arenaRetain(arena)
+    };
     return prog;
 }
 
@@ -998,33 +632,27 @@ uint32_t programGetStatementCount(const Program_t* prog) {
     return vectorGetCount(prog->statements);
 }
 
-Program_t* copyProgram(const Program_t* prog) {
-    Program_t* newProg = createProgram();
-    newProg->statements = copyVector(prog->statements, (VectorElemCopyFn_t)copyStatement);
-    return newProg;
-}
-
 void cleanupProgram(Program_t** prog) {
     if (*prog == NULL) 
         return;
 
-    cleanupStatementVec(&(*prog)->statements);
-    
-    free(*prog);
+    // the program itself lives in the arena
+    Arena_t* arena = (*prog)->arena;
     *prog = NULL;
+    cleanupArena(&arena);
 }
 
 void programAppendStatement(Program_t* prog, const Statement_t* st) {
     vectorAppend(prog->statements, (void*) st);
 }
 
-const char* programTokenLiteral(const Program_t* prog) {
+char* programTokenLiteral(const Program_t* prog) {
     if (programGetStatementCount(prog) > 0u) 
     {   
         Statement_t** stmts = programGetStatements(prog);
         return statementTokenLiteral(stmts[0]);
     } else  {
-        return "";
+        return cloneString("");
     }
 }
 
@@ -1037,12 +665,6 @@ char* programToString(const Program_t* prog) {
  *         COMMON UTILS              *
  ************************************/
 
-static void cleanupStatementVec(Vector_t** statements) {
-    cleanupVector(statements, (VectorElemCleanupFn_t)cleanupStatement);
-    *statements = NULL;
-}
-
-
 static char* statementVecToString(Vector_t* statements, bool indent) {
     Strbuf_t* sbuf = createStrbuf();
     
@@ -30,18 +30,15 @@ typedef enum ExpressionType
 typedef struct Expression
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
 } Expression_t;
 
-Expression_t *copyExpression(Expression_t *expr);
-void cleanupExpression(Expression_t **expr);
 
 char *expressionToString(Expression_t *expr);
-const char *expressionTokenLiteral(Expression_t *expr);
+// Copies of the token lexeme, caller frees
+char *expressionTokenLiteral(Expression_t *expr);
 
-// function pointers for cleanup / expresion to string
-typedef void (*ExpressionCleanupFn_t)(void **);
-typedef void *(*ExpressionCopyFn_t)(const void *);
+// function pointers for expresion to string
 typedef char *(*ExpressionToStringFn_t)(const void *);
 
 /************************************
@@ -51,13 +48,15 @@ typedef char *(*ExpressionToStringFn_t)(const void *);
 typedef struct Identifier
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     const char *value;
+    // set by the analysis of the enclosing function literal, index into
+    // its parameters and free variables or -1 when the name is neither
+    int32_t paramSlot;
+    int32_t captureSlot;
 } Identifier_t;
 
-Identifier_t *createIdentifier(const Token_t *tok, const char *val);
-Identifier_t *copyIdentifier(const Identifier_t *ident);
-void cleanupIdentifier(Identifier_t **ident);
+Identifier_t *createIdentifier(Arena_t *arena, const Token_t *tok);
 
 char *identifierToString(const Identifier_t *ident);
 
@@ -68,13 +67,11 @@ char *identifierToString(const Identifier_t *ident);
 typedef struct IntegerLiteral
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     int64_t value;
 } IntegerLiteral_t;
 
-IntegerLiteral_t *createIntegerLiteral(const Token_t *tok);
-IntegerLiteral_t *copyIntegerLiteral(const IntegerLiteral_t *il);
-void cleanupIntegerLiteral(IntegerLiteral_t **il);
+IntegerLiteral_t *createIntegerLiteral(Arena_t *arena, const Token_t *tok);
 
 char *integerLiteralToString(const IntegerLiteral_t *il);
 
@@ -85,13 +82,11 @@ char *integerLiteralToString(const IntegerLiteral_t *il);
 typedef struct BooleanLiteral
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     bool value;
 } BooleanLiteral_t;
 
-BooleanLiteral_t *createBooleanLiteral(const Token_t *tok);
-BooleanLiteral_t *copyBooleanLiteral(const BooleanLiteral_t *bl);
-void cleanupBooleanLiteral(BooleanLiteral_t **bl);
+BooleanLiteral_t *createBooleanLiteral(Arena_t *arena, const Token_t *tok);
 
 char *booleanLiteralToString(const BooleanLiteral_t *bl);
 
@@ -102,13 +97,11 @@ char *booleanLiteralToString(const BooleanLiteral_t *bl);
 typedef struct StringLiteral
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     char *value;
 } StringLiteral_t;
 
-StringLiteral_t *createStringLiteral(const Token_t *tok);
-StringLiteral_t *copyStringLiteral(const StringLiteral_t *sl);
-void cleanupStringLiteral(StringLiteral_t **sl);
+StringLiteral_t *createStringLiteral(Arena_t *arena, const Token_t *tok);
 
 char *stringLiteralToString(const StringLiteral_t *sl);
 
@@ -119,13 +112,11 @@ char *stringLiteralToString(const StringLiteral_t *sl);
 typedef struct ArrayLiteral
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     Vector_t *elements;
 } ArrayLiteral_t;
 
-ArrayLiteral_t *createArrayLiteral(const Token_t *tok);
-ArrayLiteral_t *copyArrayLiteral(const ArrayLiteral_t *al);
-void cleanupArrayLiteral(ArrayLiteral_t **al);
+ArrayLiteral_t *createArrayLiteral(Arena_t *arena, const Token_t *tok);
 
 char *arrayLiteralToString(const ArrayLiteral_t *al);
 uint32_t arrayLiteralGetElementCount(const ArrayLiteral_t *al);
@@ -138,14 +129,12 @@ Expression_t **arrayLiteralGetElements(const ArrayLiteral_t *al);
 typedef struct HashLiteral
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     Vector_t* keys;
     Vector_t* values;
 } HashLiteral_t;
 
-HashLiteral_t *createHashLiteral(const Token_t *tok);
-HashLiteral_t *copyHashLiteral(const HashLiteral_t *hl);
-void cleanupHashLiteral(HashLiteral_t **hl);
+HashLiteral_t *createHashLiteral(Arena_t *arena, const Token_t *tok);
 
 char *hashLiteralToString(const HashLiteral_t *hl);
 uint32_t hashLiteralGetPairsCount(const HashLiteral_t *hl);
@@ -159,14 +148,12 @@ void hashLiteralSetPair(HashLiteral_t* hl, Expression_t* key, Expression_t* valu
 typedef struct IndexExpression
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     Expression_t *left;
     Expression_t *right;
 } IndexExpression_t;
 
-IndexExpression_t *createIndexExpression(const Token_t *tok);
-IndexExpression_t *copyIndexExpression(const IndexExpression_t *al);
-void cleanupIndexExpression(IndexExpression_t **al);
+IndexExpression_t *createIndexExpression(Arena_t *arena, const Token_t *tok);
 
 char *indexExpressionToString(const IndexExpression_t *al);
 
@@ -177,14 +164,12 @@ char *indexExpressionToString(const IndexExpression_t *al);
 typedef struct PrefixExpression
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     char *operator;
     Expression_t *right;
 } PrefixExpression_t;
 
-PrefixExpression_t *createPrefixExpresion(const Token_t *tok);
-PrefixExpression_t *copyPrefixExpression(const PrefixExpression_t *exp);
-void cleanupPrefixExpression(PrefixExpression_t **exp);
+PrefixExpression_t *createPrefixExpresion(Arena_t *arena, const Token_t *tok);
 
 char *prefixExpressionToString(const PrefixExpression_t *exp);
 
@@ -195,15 +180,13 @@ char *prefixExpressionToString(const PrefixExpression_t *exp);
 typedef struct InfixExpression
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     Expression_t *left;
     char *operator;
     Expression_t *right;
 } InfixExpression_t;
 
-InfixExpression_t *createInfixExpresion(const Token_t *tok);
-InfixExpression_t *copyInfixExpression(const InfixExpression_t *exp);
-void cleanupInfixExpression(InfixExpression_t **exp);
+InfixExpression_t *createInfixExpresion(Arena_t *arena, const Token_t *tok);
 
 char *infixExpressionToString(const InfixExpression_t *exp);
 
@@ -216,15 +199,13 @@ typedef struct BlockStatement BlockStatement_t;
 typedef struct IfExpression
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     Expression_t *condition;
     BlockStatement_t *consequence;
     BlockStatement_t *alternative;
 } IfExpression_t;
 
-IfExpression_t *createIfExpresion(const Token_t *tok);
-IfExpression_t *copyIfExpression(const IfExpression_t *exp);
-void cleanupIfExpression(IfExpression_t **exp);
+IfExpression_t *createIfExpresion(Arena_t *arena, const Token_t *tok);
 
 char *ifExpressionToString(const IfExpression_t *exp);
 
@@ -235,14 +216,17 @@ char *ifExpressionToString(const IfExpression_t *exp);
 typedef struct FunctionLiteral
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     Vector_t *parameters;
     BlockStatement_t *body;
+    Arena_t *arena; // functions created from the literal keep it alive
+    // set by the parser with analysisFunctionLiteral
+    bool frameEscapes;
+    Vector_t *freeVariables; // names the body needs from outside
+    Vector_t *letBindings; // names the body binds with let
 } FunctionLiteral_t;
 
-FunctionLiteral_t *createFunctionLiteral(const Token_t *tok);
-FunctionLiteral_t *copyFunctionLiteral(const FunctionLiteral_t *exp);
-void cleanupFunctionLiteral(FunctionLiteral_t **exp);
+FunctionLiteral_t *createFunctionLiteral(Arena_t *arena, const Token_t *tok);
 
 char *functionLiteralToString(const FunctionLiteral_t *exp);
 void functionLiteralAppendParameter(FunctionLiteral_t *exp, const Identifier_t *param);
@@ -256,14 +240,12 @@ Identifier_t **functionLiteralGetParameters(const FunctionLiteral_t *exp);
 typedef struct CallExpression
 {
     ExpressionType_t type;
-    Token_t *token;
+    const Token_t *token;
     Expression_t *function;
     Vector_t *arguments;
 } CallExpression_t;
 
-CallExpression_t *createCallExpression(const Token_t *tok);
-CallExpression_t *copyCallExpression(const CallExpression_t *exp);
-void cleanupCallExpression(CallExpression_t **exp);
+CallExpression_t *createCallExpression(Arena_t *arena, const Token_t *tok);
 
 char *callExpressionToString(const CallExpression_t *exp);
 void callExpressionAppendArgument(CallExpression_t *exp, const Expression_t *arg);
@@ -286,18 +268,14 @@ typedef enum StatementType
 typedef struct Statement
 {
     StatementType_t type;
-    Token_t *token;
+    const Token_t *token;
 } Statement_t;
 
-// function pointers for cleanup / expresion to string
-typedef void (*StatementCleanupFn_t)(void **);
-typedef void *(*StatementCopyFn_t)(const void *);
+// function pointers for expresion to string
 typedef char *(*StatementToStringFn_t)(const void *);
 
-Statement_t *copyStatement(const Statement_t *st);
-void cleanupStatement(Statement_t **st);
 
-const char *statementTokenLiteral(const Statement_t *st);
+char *statementTokenLiteral(const Statement_t *st);
 char *statementToString(const Statement_t *st);
 
 /************************************
@@ -307,14 +285,12 @@ char *statementToString(const Statement_t *st);
 typedef struct LetStatement
 {
     StatementType_t type;
-    Token_t *token;
+    const Token_t *token;
     Identifier_t *name;
     Expression_t *value;
 } LetStatement_t;
 
-LetStatement_t *createLetStatement(const Token_t *token);
-LetStatement_t *copyLetStatement(const LetStatement_t *st);
-void cleanupLetStatement(LetStatement_t **st);
+LetStatement_t *createLetStatement(Arena_t *arena, const Token_t *token);
 
 char *letStatementToString(const LetStatement_t *st);
 
@@ -325,13 +301,11 @@ char *letStatementToString(const LetStatement_t *st);
 typedef struct ReturnStatement
 {
     StatementType_t type;
-    Token_t *token;
+    const Token_t *token;
     Expression_t *returnValue;
 } ReturnStatement_t;
 
-ReturnStatement_t *createReturnStatement(const Token_t *token);
-ReturnStatement_t *copyReturnStatement(const ReturnStatement_t *st);
-void cleanupReturnStatement(ReturnStatement_t **st);
+ReturnStatement_t *createReturnStatement(Arena_t *arena, const Token_t *token);
 
 char *returnStatementToString(const ReturnStatement_t *st);
 
@@ -342,13 +316,11 @@ char *returnStatementToString(const ReturnStatement_t *st);
 typedef struct ExpressionStatement
 {
     StatementType_t type;
-    Token_t *token;
+    const Token_t *token;
     Expression_t *expression;
 } ExpressionStatement_t;
 
-ExpressionStatement_t *createExpressionStatement(const Token_t *token);
-ExpressionStatement_t *copyExpressionStatement(const ExpressionStatement_t *st);
-void cleanupExpressionStatement(ExpressionStatement_t **st);
+ExpressionStatement_t *createExpressionStatement(Arena_t *arena, const Token_t *token);
 
 char *expressionStatementToString(const ExpressionStatement_t *st);
 
@@ -359,13 +331,11 @@ char *expressionStatementToString(const ExpressionStatement_t *st);
 typedef struct BlockStatement
 {
     StatementType_t type;
-    Token_t *token;
+    const Token_t *token;
     Vector_t *statements;
 } BlockStatement_t;
 
-BlockStatement_t *createBlockStatement(const Token_t *token);
-BlockStatement_t *copyBlockStatement(const BlockStatement_t *st);
-void cleanupBlockStatement(BlockStatement_t **st);
+BlockStatement_t *createBlockStatement(Arena_t *arena, const Token_t *token);
 
 char *blockStatementToString(const BlockStatement_t *st);
 uint32_t blockStatementGetStatementCount(const BlockStatement_t *st);
@@ -376,19 +346,21 @@ void blockStatementAppendStatement(BlockStatement_t *block, const Statement_t *s
  *      PROGRAM NODE                *
  ************************************/
 
+// Every node, token and string of a program lives in one arena, cleanup
+// frees all of them at once.
 typedef struct Program
 {
     Vector_t *statements;
+    Arena_t *arena;
 } Program_t;
 
-Program_t *createProgram();
-Program_t *copyProgram(const Program_t *prog);
+Program_t *createProgram(Arena_t *arena);
 void cleanupProgram(Program_t **prog);
 
 Statement_t **programGetStatements(const Program_t *prog);
 uint32_t programGetStatementCount(const Program_t *prog);
 void programAppendStatement(Program_t *prog, const Statement_t *st);
-const char *programTokenLiteral(const Program_t *prog);
+char *programTokenLiteral(const Program_t *prog);
 char *programToString(const Program_t *prog);
 
 #endif
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include <string.h>
+#include <stddef.h>
 #include "builtin.h"
 #include "sbuf.h"
 #include "utils.h"
+#include "gc.h"
 
 
 Object_t* lenBuiltin(Vector_t* args);
@@ -11,6 +13,9 @@ Object_t* restBuiltin(Vector_t* args);
 Object_t* pushBuiltin(Vector_t* args);
 Object_t* putsBuiltin(Vector_t* args);
 Object_t* printfBuiltin(Vector_t* args);
+Object_t* gcStatsBuiltin(Vector_t* args);
+Object_t* gcConfigBuiltin(Vector_t* args);
+Object_t* heapDumpBuiltin(Vector_t* args);
 
 
 void registerBuiltinFunctions(Environment_t* env) {
@@ -21,6 +26,9 @@ void registerBuiltinFunctions(Environment_t* env) {
     environmentSet(env, "push", (Object_t*)createBuiltin(pushBuiltin));    
     environmentSet(env, "puts", (Object_t*)createBuiltin(putsBuiltin));    
     environmentSet(env, "printf", (Object_t*)createBuiltin(printfBuiltin));    
+    environmentSet(env, "gc_stats", (Object_t*)createBuiltin(gcStatsBuiltin));
+    environmentSet(env, "gc_config", (Object_t*)createBuiltin(gcConfigBuiltin));
+    environmentSet(env, "heap_dump", (Object_t*)createBuiltin(heapDumpBuiltin));
 }
 
 Object_t* lenBuiltin(Vector_t* args) {
@@ -256,3 +264,140 @@ Object_t* printfBuiltin(Vector_t* args) {
 
     return retValue;
 }
+
+static void hashInsertInteger(Hash_t* hash, const char* key, int64_t value) {
+    hashInsertPair(hash, (Object_t*)createString(key), (Object_t*)createInteger(value));
+}
+
+Object_t* gcStatsBuiltin(Vector_t* args) {
+    if (vectorGetCount(args) != 0) {
+        char* err = strFormat("wrong number of arguments. got=%d, want=0", 
+                                vectorGetCount(args));
+        return (Object_t*)createError(err); 
+    }
+
+    GCStats_t stats = gcGetStats();
+    Hash_t* hash = createHash();
+    hashInsertInteger(hash, "minor_collections", stats.minorCollections);
+    hashInsertInteger(hash, "major_collections", stats.majorCollections);
+    hashInsertInteger(hash, "pause_total_us", stats.pauseTotalUs);
+    hashInsertInteger(hash, "pause_max_us", stats.pauseMaxUs);
+    hashInsertInteger(hash, "live_bytes", stats.liveBytes);
+    hashInsertInteger(hash, "freed_bytes", stats.freedBytes);
+    hashInsertInteger(hash, "ref_count_freed_bytes", stats.refCountFreedBytes);
+    hashInsertInteger(hash, "heap_bytes", stats.heapBytes);
+    hashInsertInteger(hash, "returned_bytes", stats.returnedBytes);
+    return (Object_t*)hash;
+}
+
+static const struct {
+    const char* name;
+    size_t offset;
+} gcConfigFields[] = {
+    { "trigger_bytes", offsetof(GCConfig_t, triggerBytes) },
+    { "growth_percent", offsetof(GCConfig_t, growthPercent) },
+    { "max_heap_bytes", offsetof(GCConfig_t, maxHeapBytes) },
+    { "slice_us", offsetof(GCConfig_t, sliceUs) },
+    { "retain_pages", offsetof(GCConfig_t, retainPages) },
+};
+#define GC_CONFIG_FIELD_CNT (sizeof(gcConfigFields) / sizeof(gcConfigFields[0]))
+
+// gc_config() returns the collector settings, gc_config(hash) changes the
+// settings named by its keys first.
+Object_t* gcConfigBuiltin(Vector_t* args) {
+    if (vectorGetCount(args) > 1) {
+        char* err = strFormat("wrong number of arguments. got=%d, want=0 or 1", 
+                                vectorGetCount(args));
+        return (Object_t*)createError(err); 
+    }
+
+    GCConfig_t config = gcGetConfig();
+    if (vectorGetCount(args) == 1) {
+        Object_t** argBuf = (Object_t**)vectorGetBuffer(args);
+        if (argBuf[0]->type != OBJECT_HASH) {
+            char* err = strFormat("argument to `gc_config` must be HASH, got %s", 
+                                    objectTypeToString(argBuf[0]->type));
+            return (Object_t*)createError(err);                      
+        }
+
+        Hash_t* settings = (Hash_t*)argBuf[0];
+        for (uint32_t i = 0; i < settings->arraySize; i++) {
+            if (settings->array[i])
+                return (Object_t*)createError(strFormat("unknown gc setting: %u", i));
+        }
+        for (uint32_t i = 0; i < settings->pairCnt; i++) {
+            HashPair_t* pair = &settings->pairs[i];
+            char* name = objectInspect(pair->key);
+            uint32_t field = 0;
+            while (field < GC_CONFIG_FIELD_CNT && strcmp(gcConfigFields[field].name, name) != 0) {
+                field++;
+            }
+            if (pair->key->type != OBJECT_STRING || field == GC_CONFIG_FIELD_CNT) {
+                char* err = strFormat("unknown gc setting: %s", name);
+                free(name);
+                return (Object_t*)createError(err);
+            }
+            if (pair->value->type != OBJECT_INTEGER || ((Integer_t*)pair->value)->value < 0) {
+                char* err = strFormat("gc setting %s must be a non negative INTEGER", name);
+                free(name);
+                return (Object_t*)createError(err);
+            }
+            free(name);
+            *(uint64_t*)((char*)&config + gcConfigFields[field].offset) = ((Integer_t*)pair->value)->value;
+        }
+        gcSetConfig(config);
+        config = gcGetConfig();
+    }
+
+    Hash_t* hash = createHash();
+    for (uint32_t field = 0; field < GC_CONFIG_FIELD_CNT; field++) {
+        hashInsertInteger(hash, gcConfigFields[field].name,
+                          *(uint64_t*)((char*)&config + gcConfigFields[field].offset));
+    }
+    return (Object_t*)hash;
+}
+
+// Relative path without `..` components, it can not leave the dump directory.
+static bool isDumpName(const char* name) {
+    if (!*name || name[0] == '/') 
+        return false;
+    for (const char* part = name; part; ) {
+        const char* end = strchr(part, '/');
+        size_t len = end ? (size_t)(end - part) : strlen(part);
+        if (len == 2 && strncmp(part, "..", 2) == 0) 
+            return false;
+        part = end ? end + 1 : NULL;
+    }
+    return true;
+}
+
+Object_t* heapDumpBuiltin(Vector_t* args) {
+    if (vectorGetCount(args) != 1) {
+        char* err = strFormat("wrong number of arguments. got=%d, want=1", 
+                                vectorGetCount(args));
+        return (Object_t*)createError(err); 
+    }
+
+    Object_t** argBuf = (Object_t**)vectorGetBuffer(args);
+    if (argBuf[0]->type != OBJECT_STRING) {
+        char* err = strFormat("argument to `heap_dump` must be STRING, got %s", 
+                                objectTypeToString(argBuf[0]->type));
+        return (Object_t*)createError(err);                      
+    }
+
+    // scripts may be untrusted, they only get to write where they were allowed to
+    const char* dir = getenv("CAPUCHIN_HEAP_DUMP_DIR");
+    if (!dir || !*dir) 
+        return (Object_t*)createError(cloneString("heap_dump is disabled, CAPUCHIN_HEAP_DUMP_DIR is not set"));
+
+    const char* name = ((String_t*)argBuf[0])->value;
+    if (!isDumpName(name)) 
+        return (Object_t*)createError(strFormat("heap dump path must stay inside CAPUCHIN_HEAP_DUMP_DIR, got %s", name));
+
+    char* path = strFormat("%s/%s", dir, name);
+    bool written = gcDumpHeap(path);
+    free(path);
+    if (!written)
+        return (Object_t*)createError(strFormat("could not write heap dump to %s", name));
+    return (Object_t*)createNull();
+}
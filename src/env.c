@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <string.h>
+#include <stddef.h>
 #include "env.h"
 #include "builtin.h"
 #include "utils.h"
@@ -8,8 +10,13 @@
 Environment_t* createEnvironment(Environment_t* outer){
     Environment_t* env = gcMalloc(sizeof(Environment_t), GC_DATA_ENVIRONENT);
     *env = (Environment_t) {
+        .kind = ENVIRONMENT_PLAIN,
         .store = createHashMap(),
-        .outer = outer
+        .outer = outer,
+        .owner = NULL,
+        .slotCnt = 0,
+        .pendingCnt = 0,
+        .onStack = false
     };
     if (!outer) {
         registerBuiltinFunctions(env);
@@ -18,20 +25,330 @@ Environment_t* createEnvironment(Environment_t* outer){
     return env;
 }
 
+Environment_t* createFunctionEnvironment(Function_t* function) {
+    uint32_t slotCnt = functionGetParameterCount(function);
+    Environment_t* env = gcMalloc(sizeof(Environment_t) + slotCnt * sizeof(Object_t*), 
+                                  GC_DATA_ENVIRONENT);
+    *env = (Environment_t) {
+        .kind = ENVIRONMENT_FRAME,
+        .store = NULL,
+        .outer = function->environment,
+        .owner = function,
+        .slotCnt = slotCnt,
+        .pendingCnt = 0,
+        .onStack = false
+    };
+    memset(env->slots, 0, slotCnt * sizeof(Object_t*));
+    return env;
+}
+
+// Stack frames are carved out of chunks that never move, a new chunk is
+// linked in when the current one is full.
+#define FRAME_CHUNK_SIZE (64 * 1024)
+
+typedef struct FrameChunk {
+    struct FrameChunk* prev;
+    size_t size;
+    size_t used;
+    char data[];
+} FrameChunk_t;
+
+static FrameChunk_t* frameChunk = NULL;
+static FrameChunk_t* spareFrameChunk = NULL; // avoids thrashing on chunk edges
+
+Environment_t* pushStackEnvironment(Function_t* function) {
+    uint32_t slotCnt = functionGetParameterCount(function);
+    size_t size = sizeof(Environment_t) + slotCnt * sizeof(Object_t*);
+
+    if (!frameChunk || frameChunk->size - frameChunk->used < size) {
+        FrameChunk_t* chunk = spareFrameChunk;
+        spareFrameChunk = NULL;
+        if (!chunk || chunk->size < size) {
+            free(chunk);
+            size_t chunkSize = size > FRAME_CHUNK_SIZE ? size : FRAME_CHUNK_SIZE;
+            chunk = mallocChk(sizeof(FrameChunk_t) + chunkSize);
+            chunk->size = chunkSize;
+        }
+        chunk->used = 0;
+        chunk->prev = frameChunk;
+        frameChunk = chunk;
+    }
+
+    Environment_t* env = (Environment_t*)(frameChunk->data + frameChunk->used);
+    frameChunk->used += size;
+
+    *env = (Environment_t) {
+        .kind = ENVIRONMENT_FRAME,
+        .store = NULL,
+        .outer = function->environment,
+        .owner = function,
+        .slotCnt = slotCnt,
+        .pendingCnt = 0,
+        .onStack = true
+    };
+    memset(env->slots, 0, slotCnt * sizeof(Object_t*));
+    return env;
+}
+
+void popStackEnvironment(Environment_t* env) {
+    // let bindings are the only thing owned by a stack frame
+    cleanupHashMap(&env->store, NULL);
+
+    assert((char*)env >= frameChunk->data && 
+           (char*)env < frameChunk->data + frameChunk->used);
+    frameChunk->used = (char*)env - frameChunk->data;
+
+    if (frameChunk->used == 0 && frameChunk->prev) {
+        FrameChunk_t* chunk = frameChunk;
+        frameChunk = chunk->prev;
+        free(spareFrameChunk);
+        spareFrameChunk = chunk;
+    }
+}
+
+void environmentWriteBarrier(Environment_t* env, Object_t* obj) {
+    // stack frames are scanned as roots by every collection
+    if (!env->onStack) 
+        gcWriteBarrier(env, obj);
+}
+
+static void environmentDropRef(Environment_t* env, Object_t* obj) {
+    if (!env->onStack) 
+        gcDropRef(env, obj);
+}
+
+static Object_t** environmentFindSlot(Environment_t* env, const char* name) {
+    if (env->kind == ENVIRONMENT_FRAME) {
+        Identifier_t** params = functionGetParameters(env->owner);
+        for (uint32_t i = 0; i < env->slotCnt; i++) {
+            if (strcmp(params[i]->value, name) == 0) 
+                return &env->slots[i];
+        }
+    } else if (env->kind == ENVIRONMENT_CAPTURE) {
+        char** names = (char**)vectorGetBuffer(env->owner->literal->freeVariables);
+        for (uint32_t i = 0; i < env->slotCnt; i++) {
+            if (strcmp(names[i], name) == 0) 
+                return &env->slots[i];
+        }
+    }
+    return NULL;
+}
+
+static Object_t* environmentGetLocal(Environment_t* env, const char* name) {
+    Object_t* obj = NULL;
+    if (env->slotCnt) {
+        Object_t** slot = environmentFindSlot(env, name);
+        if (slot) 
+            obj = *slot;
+    }
+
+    if (!obj && env->store) 
+        obj = hashMapGet(env->store, name);
+    return obj;
+}
+
 Object_t* environmentGet(Environment_t* env, const char* name){
-    Object_t* obj = hashMapGet(env->store, name);
+    Object_t* obj = environmentGetLocal(env, name);
     if ( !obj  && env->outer != NULL) {
         obj = environmentGet(env->outer, name);
     }
     return obj; 
 }
 
-Object_t* environmentSet(Environment_t* env, const char* name, Object_t* obj){
+Object_t* environmentGetIdentifier(Environment_t* env, const Identifier_t* ident) {
+    if (env->kind != ENVIRONMENT_FRAME) 
+        return environmentGet(env, ident->value);
+
+    if (ident->paramSlot >= 0) {
+        assert((uint32_t)ident->paramSlot < env->slotCnt);
+        Object_t* obj = env->slots[ident->paramSlot];
+        if (obj) 
+            return obj;
+    }
+
+    Object_t* obj = env->store ? hashMapGet(env->store, ident->value) : NULL;
+    if (obj) 
+        return obj;
+
+    // pending captures are still empty, the enclosing frame has them
+    Environment_t* capture = env->outer;
+    if (ident->captureSlot >= 0 && capture->kind == ENVIRONMENT_CAPTURE && 
+        capture->owner == env->owner) {
+        assert((uint32_t)ident->captureSlot < capture->slotCnt);
+        obj = capture->slots[ident->captureSlot];
+        if (obj) 
+            return obj;
+    }
+    return environmentGet(env->outer, ident->value);
+}
+
+static uint32_t countName(Vector_t* names, const char* name) {
+    uint32_t cnt = vectorGetCount(names);
+    char** buf = (char**)vectorGetBuffer(names);
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < cnt; i++) {
+        if (strcmp(buf[i], name) == 0) 
+            found++;
+    }
+    return found;
+}
+
+static Environment_t* getGlobalEnvironment(Environment_t* env) {
+    while (env->outer) 
+        env = env->outer;
+    return env;
+}
+
+// A closure bound by the let it was created for (let f = fn ...) can not
+// capture itself at creation time, fill in the pending slot now.
+static void environmentBindPendingCapture(Environment_t* env, const char* name, Function_t* function) {
+    Environment_t* capture = function->environment;
+    if (capture->kind != ENVIRONMENT_CAPTURE || capture->outer != env || 
+        env->kind != ENVIRONMENT_FRAME || countName(env->owner->literal->letBindings, name) != 1)
+        return;
+
+    Object_t** slot = environmentFindSlot(capture, name);
+    if (!slot || *slot) 
+        return;
+
+    *slot = (Object_t*)function;
+    gcWriteBarrier(capture, function);
+    if (--capture->pendingCnt == 0) 
+        capture->outer = getGlobalEnvironment(env);
+}
+
+// Binds name in env, in slot when name is a parameter of the frame.
+static Object_t* environmentBind(Environment_t* env, const char* name, Object_t** slot, Object_t* obj) {
     if(!obj) return NULL;
-    hashMapInsert(env->store, name, obj);
+    if (obj->type == OBJECT_FUNCTION) 
+        environmentBindPendingCapture(env, name, (Function_t*)obj);
+    environmentWriteBarrier(env, obj);
+
+    // rebinding a parameter has to shadow the slot, not the map
+    if (slot) {
+        environmentDropRef(env, *slot);
+        *slot = obj;
+        return obj;
+    }
+
+    if (!env->store) 
+        env->store = createHashMap();
+    environmentDropRef(env, hashMapInsert(env->store, name, obj));
     return obj;
 }
 
+Object_t* environmentSet(Environment_t* env, const char* name, Object_t* obj){
+    Object_t** slot = env->kind == ENVIRONMENT_FRAME ? environmentFindSlot(env, name) : NULL;
+    return environmentBind(env, name, slot, obj);
+}
+
+Object_t* environmentSetIdentifier(Environment_t* env, const Identifier_t* ident, Object_t* obj) {
+    if (env->kind != ENVIRONMENT_FRAME) 
+        return environmentSet(env, ident->value, obj);
+
+    Object_t** slot = NULL;
+    if (ident->paramSlot >= 0) {
+        assert((uint32_t)ident->paramSlot < env->slotCnt);
+        slot = &env->slots[ident->paramSlot];
+    }
+    return environmentBind(env, ident->value, slot, obj);
+}
+
+typedef enum CaptureKind {
+    CAPTURE_GLOBAL, // resolved through the global scope at call time
+    CAPTURE_VALUE, // bound for good in an enclosing frame, copy the value
+    CAPTURE_PENDING, // bound later by a let of an enclosing frame
+    CAPTURE_SHARED // may be rebound, closure needs the whole environment
+} CaptureKind_t;
+
+static CaptureKind_t resolveCapture(Environment_t* env, const char* name, Object_t** value) {
+    bool shadowed = false; // a let in a closer frame has yet to run
+    for (Environment_t* curr = env; curr->outer; curr = curr->outer) {
+        if (curr->kind == ENVIRONMENT_PLAIN) 
+            return CAPTURE_SHARED;
+
+        if (curr->kind == ENVIRONMENT_CAPTURE) {
+            Object_t** slot = environmentFindSlot(curr, name);
+            if (slot && *slot) {
+                *value = *slot;
+                return shadowed ? CAPTURE_SHARED : CAPTURE_VALUE;
+            }
+            continue;
+        }
+
+        uint32_t lets = countName(curr->owner->literal->letBindings, name);
+        Object_t** slot = environmentFindSlot(curr, name);
+        if (slot) {
+            // a parameter is final unless some let rebinds it
+            *value = *slot;
+            return (shadowed || lets) ? CAPTURE_SHARED : CAPTURE_VALUE;
+        }
+
+        Object_t* obj = curr->store ? hashMapGet(curr->store, name) : NULL;
+        if (obj) {
+            // the only let for the name already ran
+            *value = obj;
+            return (shadowed || lets > 1) ? CAPTURE_SHARED : CAPTURE_VALUE;
+        }
+        shadowed |= (lets > 0);
+    }
+    return shadowed ? CAPTURE_PENDING : CAPTURE_GLOBAL;
+}
+
+Environment_t* createClosureEnvironment(Function_t* function, Environment_t* env) {
+    Environment_t* global = getGlobalEnvironment(env);
+    if (env == global) 
+        return env;
+
+    uint32_t cnt = vectorGetCount(function->literal->freeVariables);
+    char** names = (char**)vectorGetBuffer(function->literal->freeVariables);
+
+    Object_t** values = mallocChk((cnt ? cnt : 1) * sizeof(Object_t*));
+    uint32_t captured = 0;
+    uint32_t pending = 0;
+    for (uint32_t i = 0; i < cnt; i++) {
+        values[i] = NULL;
+        switch (resolveCapture(env, names[i], &values[i])) {
+            case CAPTURE_SHARED:
+                free(values);
+                return env;
+            case CAPTURE_VALUE:
+                captured++;
+                break;
+            case CAPTURE_PENDING:
+                values[i] = NULL;
+                pending++;
+                break;
+            default:
+                values[i] = NULL;
+                break;
+        }
+    }
+
+    if (!captured && !pending) {
+        free(values);
+        return global;
+    }
+
+    Environment_t* capture = gcMalloc(sizeof(Environment_t) + cnt * sizeof(Object_t*), 
+                                      GC_DATA_ENVIRONENT);
+    *capture = (Environment_t) {
+        .kind = ENVIRONMENT_CAPTURE,
+        .store = NULL,
+        // pending names are looked up in the defining frame until bound
+        .outer = pending ? env : global,
+        .owner = function,
+        .slotCnt = cnt,
+        .pendingCnt = pending,
+        .onStack = false
+    };
+    memcpy(capture->slots, values, cnt * sizeof(Object_t*));
+    for (uint32_t i = 0; i < cnt; i++) {
+        gcWriteBarrier(capture, values[i]);
+    }
+    free(values);
+    return capture;
+}
 
 void gcCleanupEnvironment(Environment_t**env) {
     if (!(*env)) return;
@@ -43,27 +360,49 @@ void gcCleanupEnvironment(Environment_t**env) {
     *env = NULL;
 }
 
-extern void gcMarkObject(Object_t* obj);
-
-void gcMarkEnvironment(Environment_t*env) {
-    // iterate through hashmap and flag objects 
-    HashMapIter_t iter = createHashMapIter(env->store);
-    HashMapEntry_t* entry = hashMapIterGetNext(env->store, &iter);
-    while (entry) {
-        assert (entry->value != NULL);
+// Calls visit on the address of every GC pointer held by env.
+void gcTraceEnvironment(Environment_t* env, GCSlotVisitorFn_t visit) {
+    // owner keeps the slot names alive
+    visit((void**)&env->owner);
+    for (uint32_t i = 0; i < env->slotCnt; i++) {
+        visit((void**)&env->slots[i]);
+    }
 
-        if (!gcMarkedAsUsed(entry->value)) {
-            gcMarkUsed(entry->value);
-            gcMarkObject(entry->value);
+    if (env->store) {
+        HashMapIter_t iter = createHashMapIter(env->store);
+        HashMapEntry_t* entry = hashMapIterGetNext(env->store, &iter);
+        while (entry) {
+            assert (entry->value != NULL);
+            visit(&entry->value);
+            entry = hashMapIterGetNext(env->store, &iter);
         }
-
-        entry = hashMapIterGetNext(env->store, &iter);
     }
 
-    // mark also outer env 
-    if (env->outer && !gcMarkedAsUsed(env->outer)) {
-        gcMarkUsed(env->outer);
-        gcMarkEnvironment(env->outer);
+    visit((void**)&env->outer);
+}
+
+// Binding name of a slot gcTraceEnvironment visited
+const char* gcEnvironmentSlotName(Environment_t* env, void** slot) {
+    if (slot == (void**)&env->owner)
+        return "<owner>";
+    if (slot == (void**)&env->outer)
+        return "<outer>";
+
+    Object_t** objSlot = (Object_t**)slot;
+    if (objSlot >= env->slots && objSlot < env->slots + env->slotCnt) {
+        uint32_t idx = objSlot - env->slots;
+        if (env->kind == ENVIRONMENT_FRAME)
+            return functionGetParameters(env->owner)[idx]->value;
+        return ((char**)vectorGetBuffer(env->owner->literal->freeVariables))[idx];
     }
+    // store values are visited in place, inside their map entry
+    return ((HashMapEntry_t*)((char*)slot - offsetof(HashMapEntry_t, value)))->key;
+}
 
-}
\ No newline at end of file
+size_t gcEnvironmentOwnedBytes(Environment_t* env) {
+    HashMap_t* map = env->store;
+    if (!map)
+        return 0;
+    size_t slotBytes = sizeof(HashMapEntry_t) + sizeof(uint8_t);
+    return sizeof(HashMap_t) + (map->capacity + map->oldCapacity) * slotBytes;
+}
@@ -6,16 +6,53 @@
 
 
 typedef struct Object Object_t;
+typedef struct Function Function_t;
 
+typedef enum EnvironmentKind {
+    ENVIRONMENT_PLAIN, // every binding lives in store (global scope)
+    ENVIRONMENT_FRAME, // call frame, slots named by the owner's parameters
+    ENVIRONMENT_CAPTURE, // closure captures, slots named by the owner's free variables
+} EnvironmentKind_t;
+
+// Plain environments (global scope) keep every binding in store.
+// Function call frames keep parameters in inline slots named by the
+// owner's parameter list, store is only created for `let` bindings.
 typedef struct Environment {
-    HashMap_t* store;
+    EnvironmentKind_t kind;
+    HashMap_t* store; // may be NULL for frames and captures
     struct Environment* outer;
+    Function_t* owner; // function the slot names belong to, NULL for plain envs
+    uint32_t slotCnt;
+    uint32_t pendingCnt; // captures not bound yet at closure creation
+    bool onStack; // allocated by pushStackEnvironment, not by the GC
+    Object_t* slots[];
 } Environment_t;
 
 Environment_t* createEnvironment(Environment_t* outer);
-Environment_t* copyEnvironment(const Environment_t* env);
+Environment_t* createFunctionEnvironment(Function_t* function);
+
+// Builds the environment a closure created in env runs in. Values of
+// free variables bound in enclosing frames are copied into a flat capture
+// environment whose outer is the global scope, so the closure does not
+// keep those frames alive. Falls back to env when a captured name could
+// still be rebound by a let, the environment then acts as shared box.
+Environment_t* createClosureEnvironment(Function_t* function, Environment_t* env);
+
+// Frames of functions whose environment can not escape the call are
+// taken from a LIFO region outside the GC heap and must be released in
+// reverse order of creation once the call returns.
+Environment_t* pushStackEnvironment(Function_t* function);
+void popStackEnvironment(Environment_t* env);
 
 Object_t* environmentGet(Environment_t* env, const char* name);
 Object_t* environmentSet(Environment_t* env, const char* name, Object_t* obj);
 
-#endif
\ No newline at end of file
+// Same as above for an identifier of the function body env runs, the
+// slot indexes resolved by the analysis replace the lookup by name.
+Object_t* environmentGetIdentifier(Environment_t* env, const Identifier_t* ident);
+Object_t* environmentSetIdentifier(Environment_t* env, const Identifier_t* ident, Object_t* obj);
+
+// Must follow every direct store of obj into env->slots.
+void environmentWriteBarrier(Environment_t* env, Object_t* obj);
+
+#endif
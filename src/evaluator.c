@@ -1,8 +1,36 @@
+#define _POSIX_C_SOURCE 200809L
 #include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/resource.h>
 #include "evaluator.h"
 #include "utils.h"
 #include "gc.h"
 
+// steps between two checks of the clock
+#define EVAL_QUOTA_CHECK_INTERVAL 1024
+#define EVAL_DEFAULT_STACK_BYTES (8 * 1024 * 1024)
+
+typedef struct EvalQuota {
+    EvalLimits_t limits;
+    bool configured;
+    uint64_t steps; // taken before the current interval
+    uint64_t interval; // steps in the current interval
+    uint64_t untilCheck; // steps left in the current interval
+    uint64_t deadlineUs;
+    uintptr_t stackBase;
+    char* exceeded; // message of the limit hit, stays set until the next run
+    bool collectorLimited; // the heap quota lowered the collector's maxHeapBytes
+    uint64_t collectorMaxHeapBytes; // what it was before
+} EvalQuota_t;
+
+static EvalQuota_t evalQuota = {
+    .configured = false,
+    .exceeded = NULL,
+    .collectorLimited = false,
+    .collectorMaxHeapBytes = 0
+};
+
 static Object_t* evalStatement(Statement_t* stmt, Environment_t* env);
 static Object_t* evalBlockStatement(BlockStatement_t* stmt, Environment_t* env);
 
@@ -29,13 +57,30 @@ static Object_t* evalHashIndexExpression(Hash_t* hash, Object_t* key);
 static bool isTruthy(Object_t* obj);
 static bool isError(Object_t* obj);
 
+static void evalConfigure();
+static void evalLimitCollector();
+static void evalStartQuota();
+static Object_t* evalCheckQuota();
+
+
+// Counted once per statement, the statements of a function body run for
+// every call and loops are recursion.
+static inline Object_t* evalChargeStep() {
+    if (--evalQuota.untilCheck == 0)
+        return evalCheckQuota();
+    if (evalQuota.limits.maxHeapBytes && gcHeapBytes() > evalQuota.limits.maxHeapBytes)
+        return evalCheckQuota();
+    return NULL;
+}
 
 Object_t* evalProgram(Program_t* prog, Environment_t* env) {
     uint32_t count = programGetStatementCount(prog);
     Statement_t** stmts = programGetStatements(prog);
     Object_t* result = NULL;
+    evalStartQuota();
 
     for (uint32_t i = 0; i < count; i++) {
+        gcSafepoint();
         result = evalStatement(stmts[i], env);
         
         if (!result) {
@@ -61,6 +106,10 @@ Object_t* evalProgram(Program_t* prog, Environment_t* env) {
 }
 
 static Object_t* evalStatement(Statement_t* stmt, Environment_t* env) {
+    Object_t* exceeded = evalChargeStep();
+    if (exceeded)
+        return exceeded;
+
     switch (stmt->type)
     {
         case STATEMENT_EXPRESSION: 
@@ -75,7 +124,7 @@ static Object_t* evalStatement(Statement_t* stmt, Environment_t* env) {
         case STATEMENT_LET: {
             Object_t* evalRes = evalExpression(((LetStatement_t*)stmt)->value, env);
             if (isError(evalRes)) return evalRes;
-            environmentSet(env, ((LetStatement_t*)stmt)->name->value, evalRes);
+            environmentSetIdentifier(env, ((LetStatement_t*)stmt)->name, evalRes);
             return (Object_t*) createNull();
         }
         default:
@@ -89,6 +138,8 @@ static Object_t* evalBlockStatement(BlockStatement_t* stmt, Environment_t* env)
 
     Object_t* result = NULL;
     for (uint32_t i = 0; i < count; i++) {
+        // values of earlier statements are dead, everything else is rooted
+        gcSafepoint();
         result = evalStatement(stmts[i], env);
         if (!result)
             break; 
@@ -137,7 +188,9 @@ static Object_t* evalExpression(Expression_t* expr, Environment_t* env) {
                 return evalLeft;
             }
 
+            gcPushRoot((void**)&evalLeft);
             Object_t* evalRight = evalExpression(((InfixExpression_t*) expr)->right, env);
+            gcPopRoots(1);
             if (isError(evalRight)) {
                 return evalRight;
             }
@@ -146,7 +199,7 @@ static Object_t* evalExpression(Expression_t* expr, Environment_t* env) {
         }
 
         case EXPRESSION_IDENTIFIER: {
-            Object_t* val = environmentGet(env, ((Identifier_t*)expr)->value);
+            Object_t* val = environmentGetIdentifier(env, (Identifier_t*)expr);
             if (!val) {
                 char* message = strFormat("identifier not found: %s", ((Identifier_t*)expr)->value);
                 return (Object_t*)createError(message);
@@ -156,7 +209,9 @@ static Object_t* evalExpression(Expression_t* expr, Environment_t* env) {
 
         case EXPRESSION_FUNCTION_LITERAL: {
             FunctionLiteral_t* funcLit = ((FunctionLiteral_t*)expr);
-            return (Object_t*) createFunction(funcLit->parameters, funcLit->body, env);
+            Function_t* func = createFunction(funcLit, env);
+            func->environment = createClosureEnvironment(func, env);
+            return (Object_t*) func;
         }
 
         case EXPRESSION_CALL_EXPRESSION: {
@@ -166,7 +221,9 @@ static Object_t* evalExpression(Expression_t* expr, Environment_t* env) {
                 return function;
             }
 
+            gcPushRoot((void**)&function);
             Vector_t* args = evalExpressions(callExpr->arguments, env);
+            gcPopRoots(1);
             uint32_t argsCnt = vectorGetCount(args);
             Object_t** argsBuf = (Object_t**)vectorGetBuffer(args);
             
@@ -205,7 +262,9 @@ static Object_t* evalExpression(Expression_t* expr, Environment_t* env) {
                 return left;
             }
 
+            gcPushRoot((void**)&left);
             Object_t* index = evalExpression(indexExpr->right, env);
+            gcPopRoots(1);
             if (isError(index)){
                 return index;
             }
@@ -217,9 +276,9 @@ static Object_t* evalExpression(Expression_t* expr, Environment_t* env) {
             return evalHashLiteral((HashLiteral_t*)expr, env);
 
         default: 
-            char* message = strFormat("unknown expression type: %d(%s)", 
+            char* message = strFormat("unknown expression type: %d(%.*s)", 
                                     expr->type, 
-                                    expr->token->literal);
+                                    (int)expr->token->length, tokenText(expr->token));
             return (Object_t*)createError(message);
     }
 }
@@ -230,16 +289,18 @@ static Vector_t* evalExpressions(Vector_t* exprs, Environment_t* env) {
     uint32_t exprCnt = vectorGetCount(exprs);
     Expression_t** exprBuf = (Expression_t**)vectorGetBuffer(exprs);
 
+    gcPushVectorRoot(result);
     for (int i = 0; i < exprCnt; i++) {
         Object_t* evaluated = evalExpression(exprBuf[i], env);
         if (isError(evaluated)){
             cleanupVectorContents(result, NULL);
             vectorAppend(result, evaluated);
-            return result;
+            break;
         }
 
         vectorAppend(result, evaluated);
     }
+    gcPopRoots(1);
 
     return result;
 }
@@ -247,13 +308,32 @@ static Vector_t* evalExpressions(Vector_t* exprs, Environment_t* env) {
 static Object_t* applyFunction(Object_t* function, Vector_t* args) {
     switch(function->type) {
         case OBJECT_FUNCTION: 
-            Environment_t* extendedEnv = extendFunctionEnv((Function_t*)function, args); 
+            Function_t* func = (Function_t*)function;
+            char stackTop;
+            if (evalQuota.limits.maxStackBytes &&
+                evalQuota.stackBase - (uintptr_t)&stackTop > evalQuota.limits.maxStackBytes) {
+                char* message = strFormat("stack quota exceeded: %" PRIu64 " bytes", 
+                                          evalQuota.limits.maxStackBytes);
+                return (Object_t*) createError(message);
+            }
+            Environment_t* extendedEnv = extendFunctionEnv(func, args); 
             if (!extendedEnv) {
                 char* message = strFormat("Invalid parameter count: expected(%d) received (%d)", 
-                                            functionGetParameterCount((Function_t*)function), vectorGetCount(args));
+                                            functionGetParameterCount(func), vectorGetCount(args));
                 return (Object_t*) createError(message);
             }
-            Object_t* evaluated = evalBlockStatement(((Function_t*)function)->body, extendedEnv);
+            // the frame keeps the arguments and the function itself alive
+            if (func->literal->frameEscapes) {
+                gcPushRoot((void**)&extendedEnv);
+            } else {
+                gcPushUnmanagedRoot(extendedEnv, GC_DATA_ENVIRONENT);
+            }
+            Object_t* evaluated = evalBlockStatement(func->literal->body, extendedEnv);
+            gcPopRoots(1);
+
+            if (!func->literal->frameEscapes) {
+                popStackEnvironment(extendedEnv);
+            }
             return unwrapReturnValue(evaluated);
         case OBJECT_BUILTIN:
             return ((Builtin_t*)function)->func(args);
@@ -264,8 +344,6 @@ static Object_t* applyFunction(Object_t* function, Vector_t* args) {
 }
 
 static Environment_t* extendFunctionEnv(Function_t* function, Vector_t* args) {
-    Environment_t* env = createEnvironment(function->environment);
-
     uint32_t argsCnt = vectorGetCount(args);
     uint32_t paramsCnt = functionGetParameterCount(function);
 
@@ -273,10 +351,14 @@ static Environment_t* extendFunctionEnv(Function_t* function, Vector_t* args) {
         return NULL;
     }
 
+    // arguments go straight into the parameter slots of the frame,
+    // frames nobody can capture are released as soon as the call returns
+    Environment_t* env = function->literal->frameEscapes ? createFunctionEnvironment(function) 
+                                                : pushStackEnvironment(function);
     Object_t** argsBuf = (Object_t**)vectorGetBuffer(args);
-    Identifier_t** paramBuf = functionGetParameters(function);
     for (uint32_t i = 0; i < argsCnt; i++) {
-        environmentSet(env, paramBuf[i]->value, argsBuf[i]);
+        env->slots[i] = argsBuf[i];
+        environmentWriteBarrier(env, argsBuf[i]);
     }
 
     return env;
@@ -475,39 +557,49 @@ static Object_t* evalHashIndexExpression(Hash_t* hash, Object_t* key) {
         return (Object_t*)createError(message);
     }
 
-    HashPair_t* pair = hashGetPair(hash, key);
-    if (!pair) {
+    Object_t* value = hashGetValue(hash, key);
+    if (!value) {
         return (Object_t*) createNull();
     }
 
-    return pair->value;
+    return value;
 }
 
 static Object_t* evalHashLiteral(HashLiteral_t* node, Environment_t* env) {
     Hash_t* hash = createHash();
+    Object_t* key = NULL;
+    gcPushRoot((void**)&hash);
+    gcPushRoot((void**)&key);
+
+    Object_t* result = (Object_t*) hash;
     uint32_t pairCnt = hashLiteralGetPairsCount(node);
     for(uint32_t i = 0; i < pairCnt; i++) {
         Expression_t *keyNode, *valueNode;
         hashLiteralGetPair(node, i, &keyNode, &valueNode);
 
-        Object_t* key = evalExpression(keyNode, env);
+        key = evalExpression(keyNode, env);
         if (isError(key)) {
-            return key;
+            result = key;
+            break;
         }
 
         if (!objectIsHashable(key)) {
             char* err = strFormat("unusable as hash key: %s", objectTypeToString(key->type));
-            return (Object_t*) createError(err);
+            result = (Object_t*) createError(err);
+            break;
         }
 
         Object_t* value = evalExpression(valueNode, env);
         if (isError(value)) {
-            return key;
+            result = value;
+            break;
         }
 
-        hashInsertPair(hash, createHashPair(key, value));
+        hashInsertPair(hash, key, value);
     }
-    return (Object_t*) hash;
+
+    gcPopRoots(2);
+    return result;
 }
 
 static bool isTruthy(Object_t* obj) {
@@ -527,4 +619,111 @@ static bool isError(Object_t* obj) {
     }
 
     return false;
-}
\ No newline at end of file
+}
+
+/************************************
+ *       QUOTAS                     *
+ ************************************/
+
+static uint64_t evalNowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t evalEnvValue(const char* name, uint64_t value) {
+    const char* env = getenv(name);
+    if (!env) return value;
+    long long parsed = strtoll(env, NULL, 10);
+    return parsed >= 0 ? (uint64_t)parsed : value;
+}
+
+static void evalConfigure() {
+    EvalLimits_t* limits = &evalQuota.limits;
+    // keep some of the stack for builtins and the collector
+    uint64_t stackBytes = EVAL_DEFAULT_STACK_BYTES;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+        stackBytes = rl.rlim_cur;
+    limits->maxStackBytes = stackBytes - stackBytes / 8;
+
+    limits->maxHeapBytes = evalEnvValue("CAPUCHIN_EVAL_MAX_HEAP_BYTES", limits->maxHeapBytes);
+    limits->maxSteps = evalEnvValue("CAPUCHIN_EVAL_MAX_STEPS", limits->maxSteps);
+    limits->maxWallMs = evalEnvValue("CAPUCHIN_EVAL_MAX_WALL_MS", limits->maxWallMs);
+    limits->maxStackBytes = evalEnvValue("CAPUCHIN_EVAL_MAX_STACK_BYTES", limits->maxStackBytes);
+    evalQuota.configured = true;
+    evalLimitCollector();
+}
+
+// Collections have to keep the heap under the quota before it is reached,
+// the collector's own limit comes back once the quota is lifted.
+static void evalLimitCollector() {
+    GCConfig_t config = gcGetConfig();
+    if (evalQuota.collectorLimited) 
+        config.maxHeapBytes = evalQuota.collectorMaxHeapBytes;
+
+    uint64_t quota = evalQuota.limits.maxHeapBytes;
+    evalQuota.collectorLimited = quota && (!config.maxHeapBytes || config.maxHeapBytes > quota);
+    if (evalQuota.collectorLimited) {
+        evalQuota.collectorMaxHeapBytes = config.maxHeapBytes;
+        config.maxHeapBytes = quota;
+    }
+    gcSetConfig(config);
+}
+
+EvalLimits_t evalGetLimits() {
+    if (!evalQuota.configured)
+        evalConfigure();
+    return evalQuota.limits;
+}
+
+void evalSetLimits(EvalLimits_t limits) {
+    if (!evalQuota.configured)
+        evalConfigure();
+    evalQuota.limits = limits;
+    evalLimitCollector();
+}
+
+static void evalStartQuota() {
+    if (!evalQuota.configured)
+        evalConfigure();
+    char stackBase;
+    evalQuota.stackBase = (uintptr_t)&stackBase;
+    evalQuota.deadlineUs = evalQuota.limits.maxWallMs ? evalNowUs() + evalQuota.limits.maxWallMs * 1000 : 0;
+    evalQuota.steps = 0;
+    evalQuota.interval = EVAL_QUOTA_CHECK_INTERVAL;
+    if (evalQuota.limits.maxSteps && evalQuota.limits.maxSteps < evalQuota.interval)
+        evalQuota.interval = evalQuota.limits.maxSteps;
+    evalQuota.untilCheck = evalQuota.interval + 1;
+    cleanupString(&evalQuota.exceeded);
+}
+
+// Slow path of evalChargeStep, every step fails once a limit was hit
+static Object_t* evalCheckQuota() {
+    EvalLimits_t* limits = &evalQuota.limits;
+    if (!evalQuota.exceeded) {
+        if (evalQuota.untilCheck == 0) {
+            evalQuota.steps += evalQuota.interval;
+            evalQuota.interval = EVAL_QUOTA_CHECK_INTERVAL;
+            if (limits->maxSteps && limits->maxSteps - evalQuota.steps < evalQuota.interval)
+                evalQuota.interval = limits->maxSteps - evalQuota.steps;
+            evalQuota.untilCheck = evalQuota.interval;
+        }
+
+        if (limits->maxSteps && evalQuota.steps >= limits->maxSteps) {
+            evalQuota.exceeded = strFormat("step quota exceeded: %" PRIu64 " steps", limits->maxSteps);
+        } else if (limits->maxWallMs && evalNowUs() >= evalQuota.deadlineUs) {
+            evalQuota.exceeded = strFormat("time quota exceeded: %" PRIu64 " ms", limits->maxWallMs);
+        } else if (limits->maxHeapBytes && gcHeapBytes() > limits->maxHeapBytes) {
+            // only what survives a full collection counts, statements
+            // start where a safepoint could run
+            gcCollectAll();
+            if (gcHeapBytes() > limits->maxHeapBytes)
+                evalQuota.exceeded = strFormat("heap quota exceeded: %" PRIu64 " bytes", limits->maxHeapBytes);
+        }
+        if (!evalQuota.exceeded)
+            return NULL;
+    }
+    evalQuota.untilCheck = 1;
+    return (Object_t*)createError(cloneString(evalQuota.exceeded));
+}
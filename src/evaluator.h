@@ -7,5 +7,18 @@
 
 Object_t* evalProgram(Program_t* prog, Environment_t* env);
 
+// Limits of a single evalProgram call, 0 disables a limit. Defaults can be
+// overridden by the CAPUCHIN_EVAL_* environment variables. The program is
+// stopped with an error once it exceeds one.
+typedef struct EvalLimits {
+    uint64_t maxHeapBytes; // see gcHeapBytes()
+    uint64_t maxSteps; // statements evaluated
+    uint64_t maxWallMs;
+    uint64_t maxStackBytes; // native stack used by nested calls
+} EvalLimits_t;
+
+EvalLimits_t evalGetLimits();
+void evalSetLimits(EvalLimits_t limits);
+
 
 #endif
\ No newline at end of file
@@ -1,105 +1,516 @@
-#include <malloc.h>
+#define _DEFAULT_SOURCE
+
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <sys/mman.h>
 
 #include "env.h"
 #include "object.h"
 #include "utils.h"
 #include "gc.h"
 
+// Major collection is requested once the old space bytes allocated since
+// the last run (promotions included) reach the allocation budget. The
+// budget lets the heap grow by GC_GROWTH_PERCENT of the bytes the last run
+// found live, but never below GC_TRIGGER_BYTES. Near the max heap size the
+// budget shrinks to what is left, down to GC_MIN_BUDGET_BYTES.
+#define GC_TRIGGER_BYTES (1024 * 1024)
+#define GC_GROWTH_PERCENT 100
+#define GC_MIN_BUDGET_BYTES (64 * 1024)
+#define GC_HEAP_MAJOR_PERCENT 75
+
+// Releasing an external ref with no roots pushed (evaluation is idle)
+// collects early, once GC_IDLE_BUDGET_PERCENT of the budget was allocated.
+#define GC_IDLE_BUDGET_PERCENT 25
+
+// Young objects are bump allocated in nursery chunks. Filling the first
+// chunk requests a minor collection, until the next safepoint further
+// chunks are linked in so allocation never has to collect.
+#define GC_NURSERY_CHUNK_SIZE (1024 * 1024)
+#define GC_NURSERY_MAX_OBJ_SIZE 256
+
+// Old space cells up to GC_SLAB_MAX_CELL_SIZE bytes (header included) come
+// from size class slabs, one class every GC_SLAB_GRANULE bytes. Pages are
+// aligned to their size so a cell finds its page by masking the address.
+#define GC_PAGE_SIZE (64 * 1024)
+#define GC_SLAB_GRANULE 16
+#define GC_SLAB_MAX_CELL_SIZE 256
+#define GC_SLAB_CLASS_CNT (GC_SLAB_MAX_CELL_SIZE / GC_SLAB_GRANULE)
+#define GC_PAGE_BITMAP_WORDS (GC_PAGE_SIZE / GC_SLAB_GRANULE / 64)
+
+// Marked objects wait on the gray stack until traced. Past this many
+// entries the stack stops growing and the heap is rescanned instead.
+#define GC_MARK_STACK_MAX_CNT (1024 * 1024)
+
+// Major collections mark incrementally at safepoints, each slice stops
+// once its budget (in microseconds) runs out. CAPUCHIN_GC_SLICE_US
+// overrides the budget, the clock is read every few traced objects.
+#define GC_MARK_SLICE_US 500
+#define GC_MARK_SLICE_CHECK_CNT 256
+
+// Once evaluation is idle (an external ref is released with no roots
+// pushed) slab pages that are mostly empty get evacuated into denser
+// ones of the same size class, if the marked bytes cover less than
+// GC_COMPACT_MAX_LIVE_PERCENT of the slab pages.
+#define GC_COMPACT_MAX_LIVE_PERCENT 50
+#define GC_COMPACT_MIN_PAGES 16
+
+// Slab pages are mapped from the OS. Sweeping a page empty keeps it for
+// reuse, past the first GC_RETAIN_PAGES of a collection the cells are
+// handed back with madvise and the page only refaults once allocated
+// from again. Empty pages over the budget left when the next collection
+// starts are unmapped. CAPUCHIN_GC_RETAIN_PAGES overrides the budget.
+#define GC_RETAIN_PAGES 16
+
+// Cells too big for the slabs form the large object space. They are
+// linked in their own list, never moved and freed as soon as the sweep
+// finds them dead, cells of LARGE_BUFFER_SIZE and up are mapped directly.
+typedef struct GCLargePrefix {
+    size_t total; // bytes requested, prefix included
+    size_t reserved; // keeps the header 16 byte aligned
+} GCLargePrefix_t;
+
+// Old scalars and arrays (see gcIsRefCountedObject) count the references
+// held by other old objects, stores through gcWriteBarrier add one and
+// gcDropRef removes one. Counting stack and young references would cost
+// every assignment, instead objects whose count drops to zero wait in the
+// zero count table. Minor collections outside of marking free the entries
+// no root points to (deferred reference counting), the nursery is empty
+// then so nothing else can reference them. Counts that reach
+// GC_REF_CNT_STICKY stay there, tracing takes care of those objects.
+#define GC_REF_CNT_STICKY UINT16_MAX
+
+// Heaps with at least this many old objects are marked by several threads,
+// CAPUCHIN_GC_THREADS overrides the thread count (defaults to the cores).
+#define GC_PARALLEL_MARK_MIN_OBJECTS 50000
+#define GC_MAX_MARK_THREADS 16
+
+typedef enum GCRootType {
+    GC_ROOT_REF,
+    GC_ROOT_VECTOR,
+    GC_ROOT_UNMANAGED
+} GCRootType_t;
+
+typedef struct GCRoot {
+    GCRootType_t type;
+    GCDataType_t dataType; // only for unmanaged roots
+    void* ptr;
+} GCRoot_t;
+
+typedef struct GCNurseryChunk {
+    struct GCNurseryChunk* next;
+    char* top;
+    char* end;
+    char data[];
+} GCNurseryChunk_t;
+
+// Slab page, the cells follow the page header. Cells past bumpIdx were
+// never handed out, dead cells are linked through their first word.
+// Mark bits live in a side bitmap so marking never writes to the cells,
+// allocBits tells which cells hold an object.
+typedef struct GCPage {
+    struct GCPage* prev; // pages of the same size class
+    struct GCPage* next;
+    void* freeList;
+    uint32_t cellSize;
+    uint32_t cellCnt;
+    uint32_t liveCnt;
+    uint32_t bumpIdx;
+    uint32_t sweepClaim; // last major collection a sweep of the page started for
+    uint32_t sweepEpoch; // last major collection the page was swept for
+    char* cells;
+    uint64_t markBits[GC_PAGE_BITMAP_WORDS];
+    uint64_t allocBits[GC_PAGE_BITMAP_WORDS];
+} GCPage_t;
+
+// Pages of a size class are swept lazily. After a major collection the
+// sweep cursor restarts at the head and allocation sweeps pages one at
+// a time until it finds free cells, unless the background sweeper got
+// to them first.
+typedef struct GCSizeClass {
+    GCPage_t* pages;
+    GCPage_t* current; // swept page allocation happens in
+    GCPage_t* sweepNext; // next page to look for free cells in
+} GCSizeClass_t;
+
+// Growable stack of object pointers
+typedef struct GCPtrStack {
+    void** buf;
+    uint32_t cnt;
+    uint32_t cap;
+} GCPtrStack_t;
+
+// Chase-Lev work stealing deque. The owner pushes and takes at the
+// bottom, other mark threads steal from the top.
+typedef struct GCDequeArray {
+    int64_t size; // power of two
+    void* buf[];
+} GCDequeArray_t;
+
+typedef struct GCMarkDeque {
+    int64_t top;
+    int64_t bottom;
+    GCDequeArray_t* array;
+    GCPtrStack_t retired; // outgrown arrays thieves may still be reading
+} GCMarkDeque_t;
+
+typedef struct GCMarkWorker {
+    GCMarkDeque_t deque;
+    uint32_t id;
+} GCMarkWorker_t;
+
+// Mark worker threads are started by the first parallel marking and then
+// wait for the next round, the collecting thread acts as worker 0.
+typedef struct GCMarkPool {
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // a round was handed over
+    pthread_cond_t done; // a thread finished its round
+    bool started;
+    uint32_t threadCnt; // threads running workers 1 to threadCnt
+    uint32_t round;
+    uint32_t finishedCnt; // threads done with the current round
+    uint64_t deadline; // workers stop tracing once it passed
+} GCMarkPool_t;
+
+// Background thread sweeping the slab pages and finalizing dead large
+// objects between major collections. Pages are claimed one at a time so
+// the sweeper and the allocator never work on the same page.
+typedef struct GCSweeper {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // a batch was handed over
+    pthread_cond_t done; // the batch was finished or abandoned
+    bool started;
+    bool busy;
+    bool stop; // the next major collection wants the heap back
+    GCPtrStack_t pages; // every slab page at the end of marking
+    void* large; // unreachable large objects, linked through the header
+} GCSweeper_t;
+
 typedef struct GCHandle {
-    void* first;
+    void* large; // malloc'd old space objects, linked through the header
     uint32_t objCount;
+    uint64_t allocBytes; // old space bytes allocated since last major run
+    uint64_t allocBudget;
+    bool runPending;
+
+    GCNurseryChunk_t* nursery; // first chunk is never released
+    bool minorPending;
+    uint64_t heapTrigger; // heap bytes that request a minor collection
+    GCPtrStack_t remembered; // old objects that may point into the nursery
+    GCPtrStack_t promoted; // promoted objects not scanned yet
+    GCPtrStack_t zeroCount; // old objects whose reference count dropped to zero
+
+    GCSizeClass_t classes[GC_SLAB_CLASS_CNT];
+    uint32_t sweepEpoch;
+    uint32_t slabPageCnt; // counted when marking finishes
+    uint64_t slabMarkedBytes;
+    uint64_t largeMarkedBytes;
+    uint32_t emptyPageCnt; // pages swept empty since marking finished
+    size_t osPageSize;
+    GCStats_t stats;
+    GCPtrStack_t extRefs; // objects with the external ref bit set
+    GCPtrStack_t gray; // marked objects not traced yet
+    bool grayOverflow; // some marked objects were dropped from gray
+    bool marking; // an incremental major collection is under way
+    GCConfig_t config;
+    bool configured;
+
+    GCSweeper_t sweeper;
+
+    GCMarkWorker_t* markWorkers;
+    uint32_t markWorkerCnt; // 0 until configured
+    uint32_t idleWorkerCnt;
+    GCMarkPool_t markPool;
+
+    GCRoot_t* roots;
+    uint32_t rootCnt;
+    uint32_t rootCap;
 }GCHandle_t;
 
-static GCHandle_t gcHandle = {.first = NULL, .objCount = 0 };
+static GCHandle_t gcHandle = {
+    .large = NULL,
+    .objCount = 0,
+    .allocBytes = 0,
+    .allocBudget = GC_TRIGGER_BYTES,
+    .runPending = false,
+    .nursery = NULL,
+    .minorPending = false,
+    .heapTrigger = UINT64_MAX,
+    .remembered = {0},
+    .promoted = {0},
+    .zeroCount = {0},
+    .classes = {{0}},
+    .sweepEpoch = 0,
+    .slabPageCnt = 0,
+    .slabMarkedBytes = 0,
+    .largeMarkedBytes = 0,
+    .emptyPageCnt = 0,
+    .osPageSize = 0,
+    .stats = {0},
+    .extRefs = {0},
+    .gray = {0},
+    .grayOverflow = false,
+    .marking = false,
+    .config = {
+        .triggerBytes = GC_TRIGGER_BYTES,
+        .growthPercent = GC_GROWTH_PERCENT,
+        .maxHeapBytes = 0,
+        .sliceUs = GC_MARK_SLICE_US,
+        .retainPages = GC_RETAIN_PAGES
+    },
+    .configured = false,
+    .sweeper = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+        .started = false,
+        .busy = false,
+        .stop = false,
+        .pages = {0},
+        .large = NULL
+    },
+    .markWorkers = NULL,
+    .markWorkerCnt = 0,
+    .idleWorkerCnt = 0,
+    .markPool = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+        .started = false,
+        .threadCnt = 0,
+        .round = 0,
+        .finishedCnt = 0,
+        .deadline = 0
+    },
+    .roots = NULL,
+    .rootCnt = 0,
+    .rootCap = 0
+};
 
-// Additional header data used for GC 
+// Additional header data used for GC
 // *--------*---------
 // | header |  data....
 // *--------*----------
-//          |-> return ptr 
+//          |-> return ptr
 
 typedef struct GCDataHeader {
     GCDataType_t type;
     uint8_t mark;
-    void* next;
+    uint8_t sizeClass; // slab class + 1, 0 if the cell was malloc'd
+    uint16_t size; // data size of young objects, reference count of old ones
+    void* next; // forwarding address once a young object is promoted,
+                // next large object otherwise
 } GCDataHeader_t;
 
-// Mark bits significance 
-// *------------*-----+-----+
-// | 7-3 Unused | ERB | IRB |
-// *------------*-----+-----+
+// Mark bits significance
+// *-----+-----+-----+-----+-----+-----+-----+-----+
+// | DMP | PIN | ZCT | REM | FWD | YNG | ERB | IRB |
+// *-----+-----+-----+-----+-----+-----+-----+-----+
+// IRB - internal ref bit, only used by large objects (slab cells are
+//       marked in their page bitmap)
 // ERB - external ref bit
-// IRB - internal ref bit
+// YNG - young bit, object lives in the nursery
+// FWD - forwarded bit, young object was copied to the old space
+// REM - remembered bit, old object is in the remembered set
+// ZCT - object is in the zero count table
+// PIN - a root points to the object, only set while the table is processed
+// DMP - object was written to the heap snapshot being taken
 
 #define MARK_UNUSED 0x00
-#define INTERNAL_REF_BIT 0x01 
+#define INTERNAL_REF_BIT 0x01
 #define EXTERNAL_REF_BIT 0x02
+#define YOUNG_BIT 0x04
+#define FORWARDED_BIT 0x08
+#define REMEMBERED_BIT 0x10
+#define ZERO_COUNT_BIT 0x20
+#define PINNED_BIT 0x40
+#define DUMPED_BIT 0x80
 
 /* External definitions */
 extern void gcCleanupObject(Object_t** obj);
 extern void gcCleanupEnvironment(Environment_t**env);
 
-extern void gcMarkObject(Object_t* obj);
-extern void gcMarkEnvironment(Environment_t*env);
+extern void gcTraceObject(Object_t* obj, GCSlotVisitorFn_t visit);
+extern void gcTraceEnvironment(Environment_t*env, GCSlotVisitorFn_t visit);
+
+extern bool gcIsRefCountedObject(Object_t* obj);
+
+extern size_t gcObjectOwnedBytes(Object_t* obj);
+extern size_t gcEnvironmentOwnedBytes(Environment_t* env);
+extern const char* gcEnvironmentSlotName(Environment_t* env, void** slot);
 
 
 /* Create global table of destructors */
 typedef void (*GCCleanupFn_t) (void**);
-typedef void (*GCMarkFn_t) (void*);
+typedef void (*GCTraceFn_t) (void*, GCSlotVisitorFn_t);
 
 static GCCleanupFn_t gcCleanupFns[_GC_DATA_TYPE_CNT] = {
     [GC_DATA_OBJECT]=(GCCleanupFn_t)gcCleanupObject,
     [GC_DATA_ENVIRONENT]=(GCCleanupFn_t)gcCleanupEnvironment
 };
 
-static GCMarkFn_t gcMarkFns[_GC_DATA_TYPE_CNT] = {
-    [GC_DATA_OBJECT]=(GCMarkFn_t)gcMarkObject,
-    [GC_DATA_ENVIRONENT]=(GCMarkFn_t)gcMarkEnvironment
+static GCTraceFn_t gcTraceFns[_GC_DATA_TYPE_CNT] = {
+    [GC_DATA_OBJECT]=(GCTraceFn_t)gcTraceObject,
+    [GC_DATA_ENVIRONENT]=(GCTraceFn_t)gcTraceEnvironment
+};
+
+typedef bool (*GCRefCountedFn_t) (void*);
+
+static GCRefCountedFn_t gcRefCountedFns[_GC_DATA_TYPE_CNT] = {
+    [GC_DATA_OBJECT]=(GCRefCountedFn_t)gcIsRefCountedObject,
+    [GC_DATA_ENVIRONENT]=NULL
 };
 
-static void* createFatPtr(size_t size, GCDataType_t type, void* next);
+typedef size_t (*GCOwnedBytesFn_t) (void*);
+typedef const char* (*GCSlotNameFn_t) (void*, void**);
+
+static GCOwnedBytesFn_t gcOwnedBytesFns[_GC_DATA_TYPE_CNT] = {
+    [GC_DATA_OBJECT]=(GCOwnedBytesFn_t)gcObjectOwnedBytes,
+    [GC_DATA_ENVIRONENT]=(GCOwnedBytesFn_t)gcEnvironmentOwnedBytes
+};
+
+static GCSlotNameFn_t gcSlotNameFns[_GC_DATA_TYPE_CNT] = {
+    [GC_DATA_OBJECT]=NULL,
+    [GC_DATA_ENVIRONENT]=(GCSlotNameFn_t)gcEnvironmentSlotName
+};
+
+static void* createFatPtr(size_t size, GCDataType_t type);
 static GCDataHeader_t* getHeader(void *ptr);
 static void *getPtr(GCDataHeader_t* header);
 static inline void setBit(GCDataHeader_t* header, uint8_t bitmask);
 static inline void clearBit(GCDataHeader_t* header, uint8_t bitmask);
 static inline bool isBitSet(GCDataHeader_t* header, uint8_t bitmask);
 
+static void* gcNurseryAlloc(size_t size, GCDataType_t type);
+static void gcMinorCollect();
+static void gcEvacuateSlot(void** slot);
+static void gcEvacuateRememberedSlot(void** slot);
+static void gcScanPromoted();
+static void gcSweepNursery();
+
+static void gcIncRef(void* ptr);
+static void gcDecRef(void* ptr);
+static void gcReclaimZeroCount();
+static void gcClearZeroCount();
+
+static GCPage_t* getPage(GCDataHeader_t* header);
+static uint32_t getCellIndex(GCPage_t* page, GCDataHeader_t* header);
+static GCDataHeader_t* gcSlabAlloc(size_t total);
+static void gcSlabFree(GCDataHeader_t* header);
+static void gcReleaseCell(GCDataHeader_t* header);
+static void gcFinishSweep(uint64_t retainPages);
+static void gcStartSweep();
+static bool gcIsFragmented();
+static bool gcClaimPage(GCPage_t* page, uint32_t epoch);
+static bool gcPageSwept(GCPage_t* page, uint32_t epoch);
+static void gcSweepPage(GCPage_t* page, uint32_t epoch);
+static void gcCompact();
+
+static void gcConfigure();
+static void gcUpdateBudget();
+static void gcUpdateHeapTrigger();
+static void gcRecordPause(uint64_t start);
+static size_t gcCellBytes(GCDataHeader_t* header);
+static uint64_t gcNowUs();
+
+static void gcStartMarking();
+static bool gcMarkSlice();
+static void gcFinishMarking();
 static void gcMark();
-static void gcSweep();
-static void gcRecurseMark(void* ptr);
+static void gcMarkRoots();
+static void gcVisitRoots(GCSlotVisitorFn_t visit);
+static void gcMarkSlot(void** slot);
+static void gcPushGray(void* ptr);
+static void gcDrainGray();
+static void gcRescanMarked();
+static bool gcUseParallelMark();
+static bool gcParallelMark(uint64_t deadline);
+static void gcSweepLarge();
+static void gcPushRootEntry(GCRoot_t root);
+static void gcTrace(void* ptr, GCSlotVisitorFn_t visit);
 static void gcFreeElem(void* ptr);
-static void gcDebugPrintChain(void* ptr) ;
+static void gcPtrStackPush(GCPtrStack_t* stack, void* ptr);
+static void gcWriteRequestedDump();
+
+// Set from the SIGUSR1 handler, the snapshot is taken by the next safepoint
+static volatile sig_atomic_t gcDumpRequested = 0;
 
 void* gcMalloc(size_t size, GCDataType_t type) {
-    void* ptr = createFatPtr(size, type, gcHandle.first);
+    // buffers of young objects fill the heap without filling the nursery
+    if (gcHeapBytes() >= gcHandle.heapTrigger)
+        gcHandle.minorPending = true;
+    // environments are referenced by long lived functions, keep them old
+    if (type == GC_DATA_OBJECT && size <= GC_NURSERY_MAX_OBJ_SIZE)
+        return gcNurseryAlloc(size, type);
+    return gcMallocTenured(size, type);
+}
 
-    GCDataHeader_t* header = getHeader(ptr);
-    header->next = gcHandle.first;
+void* gcMallocTenured(size_t size, GCDataType_t type) {
+    if (!gcHandle.configured)
+        gcConfigure();
+    void* ptr = createFatPtr(size, type);
+    __atomic_add_fetch(&gcHandle.objCount, 1, __ATOMIC_RELAXED);
 
-    gcHandle.first = ptr;
-    gcHandle.objCount++;
+    gcHandle.allocBytes += gcCellBytes(getHeader(ptr));
+    if (gcHandle.allocBytes >= gcHandle.allocBudget)
+        gcHandle.runPending = true;
     return ptr;
 }
 
 void gcFree(void* ptr) {
-    free(getHeader(ptr));
-    gcHandle.objCount--;
+    GCDataHeader_t* header = getHeader(ptr);
+    // may run on the background sweeper
+    __atomic_add_fetch(&gcHandle.stats.freedBytes, gcCellBytes(header), __ATOMIC_RELAXED);
+    // nursery memory is reclaimed in bulk
+    if (isBitSet(header, YOUNG_BIT))
+        return;
+    gcReleaseCell(header);
+    __atomic_sub_fetch(&gcHandle.objCount, 1, __ATOMIC_RELAXED);
 }
 
 void gcMarkUsed(void* ptr) {
     if (!ptr) return;
     GCDataHeader_t* header = getHeader(ptr);
-    setBit(header, INTERNAL_REF_BIT);
+    if (header->sizeClass) {
+        GCPage_t* page = getPage(header);
+        uint32_t idx = getCellIndex(page, header);
+        page->markBits[idx / 64] |= (uint64_t)1 << (idx % 64);
+    } else {
+        setBit(header, INTERNAL_REF_BIT);
+    }
 }
 
 bool gcMarkedAsUsed(void* ptr) {
-    return isBitSet(getHeader(ptr), INTERNAL_REF_BIT);
+    GCDataHeader_t* header = getHeader(ptr);
+    if (header->sizeClass) {
+        GCPage_t* page = getPage(header);
+        uint32_t idx = getCellIndex(page, header);
+        return (page->markBits[idx / 64] >> (idx % 64)) & 1;
+    }
+    return isBitSet(header, INTERNAL_REF_BIT);
 }
 
 void* gcGetExtRef(void* ptr) {
     if (!ptr) return NULL;
+    // external refs are only tracked in the old space, promote ptr and
+    // everything young reachable from it right away
+    if (isBitSet(getHeader(ptr), YOUNG_BIT)) {
+        gcEvacuateSlot(&ptr);
+        gcScanPromoted();
+    }
+
     GCDataHeader_t* header = getHeader(ptr);
-    setBit(header, EXTERNAL_REF_BIT);
+    if (!isBitSet(header, EXTERNAL_REF_BIT)) {
+        setBit(header, EXTERNAL_REF_BIT);
+        gcPtrStackPush(&gcHandle.extRefs, ptr);
+    }
     return ptr;
 }
 
@@ -111,21 +522,165 @@ void gcFreeExtRef(void* ptr) {
         exit(1);
     }
     clearBit(header, EXTERNAL_REF_BIT);
+    // most recently taken refs are released first
+    for (uint32_t i = gcHandle.extRefs.cnt; i-- > 0;) {
+        if (gcHandle.extRefs.buf[i] == ptr) {
+            gcHandle.extRefs.buf[i] = gcHandle.extRefs.buf[--gcHandle.extRefs.cnt];
+            break;
+        }
+    }
+    // objects only move while the evaluator holds no GC pointers in C
+    // locals, external refs stay pinned
+    if (gcHandle.rootCnt)
+        return;
+    // once the last external ref is gone the whole heap is garbage
+    uint64_t idleBudget = gcHandle.allocBudget * GC_IDLE_BUDGET_PERCENT / 100;
+    if (gcHandle.extRefs.cnt && !gcHandle.marking && !gcHandle.runPending &&
+        gcHandle.allocBytes < idleBudget)
+        return;
+
+    uint64_t start = gcNowUs();
     gcForceRun();
+    if (gcIsFragmented())
+        gcCompact();
+    gcRecordPause(start);
+}
+
+void gcWriteBarrier(void* owner, void* value) {
+    if (!value) return;
+    GCDataHeader_t* header = getHeader(owner);
+    if (isBitSet(header, YOUNG_BIT))
+        return;
+
+    if (isBitSet(getHeader(value), YOUNG_BIT)) {
+        if (!isBitSet(header, REMEMBERED_BIT)) {
+            setBit(header, REMEMBERED_BIT);
+            gcPtrStackPush(&gcHandle.remembered, owner);
+        }
+        return;
+    }
+
+    gcIncRef(value);
+    if (gcHandle.marking && gcMarkedAsUsed(owner)) {
+        // a marked object may already be traced, never let it point to
+        // an unmarked one
+        gcMarkSlot(&value);
+    }
+}
+
+void gcDropRef(void* owner, void* value) {
+    if (!value || isBitSet(getHeader(owner), YOUNG_BIT))
+        return;
+    gcDecRef(value);
 }
 
 void gcForceRun() {
-    // perform mark & sweep round
-    gcMark();
-    gcSweep();
+    if (!gcHandle.marking)
+        gcStartMarking();
+    gcFinishMarking();
+}
+
+void gcCollectAll() {
+    gcForceRun();
+    // the background sweep would free the garbage later
+    gcFinishSweep(0);
+    gcUpdateHeapTrigger();
+}
+
+void gcSafepoint() {
+#ifdef GC_STRESS
+    gcHandle.runPending = true;
+    gcHandle.minorPending = true;
+#endif
+    if (!gcHandle.minorPending && !gcHandle.marking && !gcHandle.runPending &&
+        !gcDumpRequested)
+        return;
+
+    uint64_t start = gcNowUs();
+    if (gcDumpRequested)
+        gcWriteRequestedDump();
+    if (gcHandle.minorPending)
+        gcMinorCollect();
+
+    if (gcHandle.marking) {
+        if (gcMarkSlice())
+            gcFinishMarking();
+    } else if (gcHandle.runPending) {
+        gcStartMarking();
+    }
+    gcRecordPause(start);
+}
+
+GCStats_t gcGetStats() {
+    GCStats_t stats = gcHandle.stats;
+    stats.freedBytes = __atomic_load_n(&gcHandle.stats.freedBytes, __ATOMIC_RELAXED);
+    stats.returnedBytes = __atomic_load_n(&gcHandle.stats.returnedBytes, __ATOMIC_RELAXED);
+    return stats;
+}
+
+uint64_t gcHeapBytes() {
+    // large objects are buffers too
+    return gcHandle.stats.heapBytes + bufferBytesInUse();
 }
 
-static void* createFatPtr(size_t size, GCDataType_t type, void* next) {
-    GCDataHeader_t* ptr = malloc(sizeof(GCDataHeader_t) + size);
-    if (!ptr) HANDLE_OOM();
+GCConfig_t gcGetConfig() {
+    if (!gcHandle.configured)
+        gcConfigure();
+    return gcHandle.config;
+}
+
+void gcSetConfig(GCConfig_t config) {
+    if (!gcHandle.configured)
+        gcConfigure();
+    gcHandle.config = config;
+    if (!gcHandle.config.sliceUs)
+        gcHandle.config.sliceUs = 1;
+    gcUpdateBudget();
+}
+
+void gcPushRoot(void** ref) {
+    gcPushRootEntry((GCRoot_t){ .type = GC_ROOT_REF, .ptr = ref });
+}
+
+void gcPushVectorRoot(Vector_t* vec) {
+    gcPushRootEntry((GCRoot_t){ .type = GC_ROOT_VECTOR, .ptr = vec });
+}
+
+void gcPushUnmanagedRoot(void* ptr, GCDataType_t type) {
+    gcPushRootEntry((GCRoot_t){ .type = GC_ROOT_UNMANAGED, .dataType = type, .ptr = ptr });
+}
+
+void gcPopRoots(uint32_t cnt) {
+    assert(cnt <= gcHandle.rootCnt);
+    gcHandle.rootCnt -= cnt;
+}
+
+static void gcPushRootEntry(GCRoot_t root) {
+    if (gcHandle.rootCnt == gcHandle.rootCap) {
+        gcHandle.rootCap = gcHandle.rootCap ? gcHandle.rootCap * 2 : 64;
+        gcHandle.roots = realloc(gcHandle.roots, gcHandle.rootCap * sizeof(GCRoot_t));
+        if (!gcHandle.roots) HANDLE_OOM();
+    }
+    gcHandle.roots[gcHandle.rootCnt++] = root;
+}
+
+static void* createFatPtr(size_t size, GCDataType_t type) {
+    size_t total = sizeof(GCDataHeader_t) + size;
+    GCDataHeader_t* ptr;
+    if (total <= GC_SLAB_MAX_CELL_SIZE) {
+        ptr = gcSlabAlloc(total);
+        ptr->next = NULL;
+    } else {
+        GCLargePrefix_t* prefix = mallocBuffer(sizeof(GCLargePrefix_t) + total);
+        prefix->total = sizeof(GCLargePrefix_t) + total;
+        ptr = (GCDataHeader_t*)(prefix + 1);
+        ptr->sizeClass = 0;
+        ptr->next = gcHandle.large;
+        gcHandle.large = getPtr(ptr);
+    }
     ptr->type = type;
     ptr->mark = 0;
-    ptr->next = next;
+    ptr->size = 0;
     return (void*)((char*)ptr + sizeof(GCDataHeader_t));
 }
 
@@ -139,51 +694,1317 @@ static void *getPtr(GCDataHeader_t* header) {
     return (void*)((char*)header + sizeof(GCDataHeader_t));
 }
 
+/************************************
+ *      NURSERY (YOUNG SPACE)       *
+ ************************************/
 
-static void gcMark() {
-    void* ptr = gcHandle.first;
-    while (ptr) {
+static GCNurseryChunk_t* createNurseryChunk(GCNurseryChunk_t* next) {
+    GCNurseryChunk_t* chunk = mallocChk(sizeof(GCNurseryChunk_t) + GC_NURSERY_CHUNK_SIZE);
+    chunk->next = next;
+    chunk->top = chunk->data;
+    chunk->end = chunk->data + GC_NURSERY_CHUNK_SIZE;
+    return chunk;
+}
+
+static void* gcNurseryAlloc(size_t size, GCDataType_t type) {
+    size_t total = (sizeof(GCDataHeader_t) + size + 7) & ~(size_t)7;
+    GCNurseryChunk_t* chunk = gcHandle.nursery;
+    if (!chunk || chunk->end - chunk->top < total) {
+        // can't collect outside a safepoint, borrow another chunk until then
+        if (chunk)
+            gcHandle.minorPending = true;
+        chunk = gcHandle.nursery = createNurseryChunk(chunk);
+    }
+
+    GCDataHeader_t* header = (GCDataHeader_t*)chunk->top;
+    chunk->top += total;
+    *header = (GCDataHeader_t) {
+        .type = type,
+        .mark = YOUNG_BIT,
+        .sizeClass = 0,
+        .size = size,
+        .next = NULL
+    };
+    return getPtr(header);
+}
+
+// Copies young objects referenced from roots, the remembered set and
+// everything they reach into the old space, then recycles the nursery.
+static void gcMinorCollect() {
+    gcVisitRoots(gcEvacuateSlot);
+
+    for (uint32_t i = 0; i < gcHandle.remembered.cnt; i++) {
+        void* ptr = gcHandle.remembered.buf[i];
+        clearBit(getHeader(ptr), REMEMBERED_BIT);
+        gcTrace(ptr, gcEvacuateRememberedSlot);
+    }
+    gcHandle.remembered.cnt = 0;
+
+    gcScanPromoted();
+    gcSweepNursery();
+    gcHandle.minorPending = false;
+    gcHandle.stats.minorCollections++;
+
+    // marking may hold zero count objects on the gray stack
+    if (!gcHandle.marking)
+        gcReclaimZeroCount();
+    gcUpdateHeapTrigger();
+}
+
+static void gcEvacuateSlot(void** slot) {
+    void* ptr = *slot;
+    if (!ptr) return;
+    GCDataHeader_t* header = getHeader(ptr);
+    if (!isBitSet(header, YOUNG_BIT))
+        return;
+
+    if (!isBitSet(header, FORWARDED_BIT)) {
+        void* newPtr = gcMallocTenured(header->size, header->type);
+        memcpy(newPtr, ptr, header->size);
+
+        setBit(header, FORWARDED_BIT);
+        header->next = newPtr;
+        gcPtrStackPush(&gcHandle.promoted, newPtr);
+        // the slot may belong to an object incremental marking already traced
+        if (gcHandle.marking)
+            gcMarkSlot(&newPtr);
+    }
+    *slot = header->next;
+}
+
+// Stores into old objects were counted by the write barrier when the
+// value was already old, the others are counted once it gets promoted.
+static void gcEvacuateRememberedSlot(void** slot) {
+    void* ptr = *slot;
+    gcEvacuateSlot(slot);
+    if (*slot != ptr)
+        gcIncRef(*slot);
+}
+
+// Nothing a promoted object references was counted yet
+static void gcEvacuatePromotedSlot(void** slot) {
+    gcEvacuateSlot(slot);
+    if (*slot)
+        gcIncRef(*slot);
+}
+
+static void gcScanPromoted() {
+    while (gcHandle.promoted.cnt) {
+        void* ptr = gcHandle.promoted.buf[--gcHandle.promoted.cnt];
+        gcTrace(ptr, gcEvacuatePromotedSlot);
+    }
+}
+
+static void gcSweepNursery() {
+    GCNurseryChunk_t* chunk = gcHandle.nursery;
+    while (chunk) {
+        char* pos = chunk->data;
+        while (pos < chunk->top) {
+            GCDataHeader_t* header = (GCDataHeader_t*)pos;
+            pos += (sizeof(GCDataHeader_t) + header->size + 7) & ~(size_t)7;
+            // promoted copies took over the owned buffers
+            if (!isBitSet(header, FORWARDED_BIT))
+                gcFreeElem(getPtr(header));
+        }
+
+        GCNurseryChunk_t* next = chunk->next;
+        if (next) {
+            free(chunk);
+        } else {
+            chunk->top = chunk->data;
+            gcHandle.nursery = chunk;
+        }
+        chunk = next;
+    }
+}
+
+/************************************
+ *       REFERENCE COUNTING         *
+ ************************************/
+
+static bool gcIsRefCounted(GCDataHeader_t* header) {
+    GCRefCountedFn_t refCountedFn = gcRefCountedFns[header->type];
+    return header->sizeClass && !isBitSet(header, YOUNG_BIT) &&
+           refCountedFn && refCountedFn(getPtr(header));
+}
+
+static void gcIncRef(void* ptr) {
+    GCDataHeader_t* header = getHeader(ptr);
+    if (gcIsRefCounted(header) && header->size != GC_REF_CNT_STICKY)
+        header->size++;
+}
+
+static void gcDecRef(void* ptr) {
+    GCDataHeader_t* header = getHeader(ptr);
+    if (!gcIsRefCounted(header) || header->size == 0 || header->size == GC_REF_CNT_STICKY)
+        return;
+    if (--header->size == 0 && !isBitSet(header, ZERO_COUNT_BIT)) {
+        setBit(header, ZERO_COUNT_BIT);
+        gcPtrStackPush(&gcHandle.zeroCount, ptr);
+    }
+}
+
+uint32_t gcGetRefCount(void* ptr) {
+    GCDataHeader_t* header = getHeader(ptr);
+    return gcIsRefCounted(header) ? header->size : 0;
+}
+
+static void gcDecRefSlot(void** slot) {
+    if (*slot)
+        gcDecRef(*slot);
+}
+
+static void gcPinSlot(void** slot) {
+    if (*slot)
+        setBit(getHeader(*slot), PINNED_BIT);
+}
+
+static void gcUnpinSlot(void** slot) {
+    if (*slot)
+        clearBit(getHeader(*slot), PINNED_BIT);
+}
+
+// Sweeps the page unless the background sweeper is already on it, then
+// waits for the sweeper to finish it.
+static void gcEnsureSwept(GCPage_t* page) {
+    if (gcClaimPage(page, gcHandle.sweepEpoch))
+        gcSweepPage(page, gcHandle.sweepEpoch);
+    while (!gcPageSwept(page, gcHandle.sweepEpoch)) {
+        sched_yield();
+    }
+}
+
+// Frees the zero count objects no root or external ref points to. Their
+// page has to be swept first, the sweep still reads the cell otherwise.
+static void gcReclaimZeroCount() {
+    if (!gcHandle.zeroCount.cnt)
+        return;
+
+    gcVisitRoots(gcPinSlot);
+    while (gcHandle.zeroCount.cnt) {
+        void* ptr = gcHandle.zeroCount.buf[--gcHandle.zeroCount.cnt];
         GCDataHeader_t* header = getHeader(ptr);
-        if (isBitSet(header, EXTERNAL_REF_BIT) && !isBitSet(header, INTERNAL_REF_BIT)) {
-            setBit(header, INTERNAL_REF_BIT);
-            gcRecurseMark(ptr);
+        clearBit(header, ZERO_COUNT_BIT);
+        if (header->size || isBitSet(header, EXTERNAL_REF_BIT | PINNED_BIT))
+            continue;
+        gcEnsureSwept(getPage(header));
+
+        // what the object referenced loses a reference
+        gcTrace(ptr, gcDecRefSlot);
+        gcHandle.stats.refCountFreedBytes += gcCellBytes(header);
+        gcFreeElem(ptr);
+    }
+    gcVisitRoots(gcUnpinSlot);
+}
+
+// Marking finished, zero count objects it did not reach are about to be
+// swept and the others stay to the next major collection.
+static void gcClearZeroCount() {
+    while (gcHandle.zeroCount.cnt) {
+        void* ptr = gcHandle.zeroCount.buf[--gcHandle.zeroCount.cnt];
+        clearBit(getHeader(ptr), ZERO_COUNT_BIT);
+    }
+}
+
+/************************************
+ *       SIZE CLASS SLABS           *
+ ************************************/
+
+static GCPage_t* getPage(GCDataHeader_t* header) {
+    return (GCPage_t*)((uintptr_t)header & ~(uintptr_t)(GC_PAGE_SIZE - 1));
+}
+
+static uint32_t getCellIndex(GCPage_t* page, GCDataHeader_t* header) {
+    return ((char*)header - page->cells) / page->cellSize;
+}
+
+// Maps twice the page size and trims the ends so the page is aligned.
+static GCPage_t* gcMapPage() {
+    char* raw = mmap(NULL, 2 * GC_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) HANDLE_OOM();
+    char* page = (char*)(((uintptr_t)raw + GC_PAGE_SIZE - 1) & ~(uintptr_t)(GC_PAGE_SIZE - 1));
+    if (page > raw)
+        munmap(raw, page - raw);
+    if (page < raw + GC_PAGE_SIZE)
+        munmap(page + GC_PAGE_SIZE, raw + GC_PAGE_SIZE - page);
+    gcHandle.stats.heapBytes += GC_PAGE_SIZE;
+    return (GCPage_t*)page;
+}
+
+static GCPage_t* createSlabPage(uint32_t cellSize) {
+    GCPage_t* page = gcMapPage();
+    size_t headerSize = (sizeof(GCPage_t) + GC_SLAB_GRANULE - 1) & ~(size_t)(GC_SLAB_GRANULE - 1);
+    *page = (GCPage_t) {
+        .prev = NULL,
+        .next = NULL,
+        .freeList = NULL,
+        .cellSize = cellSize,
+        .cellCnt = (GC_PAGE_SIZE - headerSize) / cellSize,
+        .liveCnt = 0,
+        .bumpIdx = 0,
+        .sweepClaim = gcHandle.sweepEpoch,
+        .sweepEpoch = gcHandle.sweepEpoch,
+        .cells = (char*)page + headerSize
+    };
+    return page;
+}
+
+static void gcReleasePage(GCSizeClass_t* sc, GCPage_t* page) {
+    if (page->prev)
+        page->prev->next = page->next;
+    else
+        sc->pages = page->next;
+    if (page->next)
+        page->next->prev = page->prev;
+    munmap(page, GC_PAGE_SIZE);
+    gcHandle.stats.heapBytes -= GC_PAGE_SIZE;
+    __atomic_add_fetch(&gcHandle.stats.returnedBytes, GC_PAGE_SIZE, __ATOMIC_RELAXED);
+}
+
+// Resets a page the sweep left without live cells, the cells are returned
+// to the OS once the collection has retained enough empty pages. Safe on
+// the sweeper thread, the header stays mapped.
+static void gcRecycleEmptyPage(GCPage_t* page) {
+    page->freeList = NULL;
+    if (page->bumpIdx == 0)
+        return;
+    page->bumpIdx = 0;
+    if (__atomic_fetch_add(&gcHandle.emptyPageCnt, 1, __ATOMIC_RELAXED) < gcHandle.config.retainPages)
+        return;
+
+    size_t mask = gcHandle.osPageSize - 1;
+    char* start = (char*)(((uintptr_t)page->cells + mask) & ~(uintptr_t)mask);
+    size_t len = (char*)page + GC_PAGE_SIZE - start;
+    if (madvise(start, len, MADV_DONTNEED) == 0)
+        __atomic_add_fetch(&gcHandle.stats.returnedBytes, len, __ATOMIC_RELAXED);
+}
+
+// Returns true if the caller won the right to sweep page.
+static bool gcClaimPage(GCPage_t* page, uint32_t epoch) {
+    uint32_t claim = __atomic_load_n(&page->sweepClaim, __ATOMIC_ACQUIRE);
+    return claim != epoch &&
+        __atomic_compare_exchange_n(&page->sweepClaim, &claim, epoch, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static bool gcPageSwept(GCPage_t* page, uint32_t epoch) {
+    return __atomic_load_n(&page->sweepEpoch, __ATOMIC_ACQUIRE) == epoch;
+}
+
+// Frees the cells allocated before the last mark that it did not reach.
+// The page must have been claimed.
+static void gcSweepPage(GCPage_t* page, uint32_t epoch) {
+    uint32_t words = (page->bumpIdx + 63) / 64;
+    for (uint32_t w = 0; w < words; w++) {
+        uint64_t dead = page->allocBits[w] & ~page->markBits[w];
+        while (dead) {
+            uint32_t idx = w * 64 + __builtin_ctzll(dead);
+            dead &= dead - 1;
+            gcFreeElem(getPtr((GCDataHeader_t*)(page->cells + idx * page->cellSize)));
+        }
+        page->markBits[w] = 0;
+    }
+    if (page->liveCnt == 0)
+        gcRecycleEmptyPage(page);
+    __atomic_store_n(&page->sweepEpoch, epoch, __ATOMIC_RELEASE);
+}
+
+// Advances the sweep cursor to the next page with a free cell, a new page
+// is added once every page was swept and found full.
+static GCPage_t* gcSlabNextPage(GCSizeClass_t* sc, uint32_t cellSize) {
+    while (sc->sweepNext) {
+        GCPage_t* page = sc->sweepNext;
+        sc->sweepNext = page->next;
+        if (gcClaimPage(page, gcHandle.sweepEpoch))
+            gcSweepPage(page, gcHandle.sweepEpoch);
+        // skip pages the background sweeper is still busy with
+        else if (!gcPageSwept(page, gcHandle.sweepEpoch))
+            continue;
+        if (page->liveCnt < page->cellCnt)
+            return page;
+    }
+
+    GCPage_t* page = createSlabPage(cellSize);
+    page->next = sc->pages;
+    if (sc->pages)
+        sc->pages->prev = page;
+    sc->pages = page;
+    return page;
+}
+
+static GCDataHeader_t* gcSlabAlloc(size_t total) {
+    uint8_t cls = (total - 1) / GC_SLAB_GRANULE;
+    GCSizeClass_t* sc = &gcHandle.classes[cls];
+    GCPage_t* page = sc->current;
+    if (!page || page->liveCnt == page->cellCnt)
+        page = sc->current = gcSlabNextPage(sc, (cls + 1) * GC_SLAB_GRANULE);
+
+    void* cell;
+    if (page->freeList) {
+        cell = page->freeList;
+        page->freeList = *(void**)cell;
+    } else {
+        cell = page->cells + page->bumpIdx++ * page->cellSize;
+    }
+    page->liveCnt++;
+
+    GCDataHeader_t* header = cell;
+    uint32_t idx = getCellIndex(page, header);
+    page->allocBits[idx / 64] |= (uint64_t)1 << (idx % 64);
+    header->sizeClass = cls + 1;
+    return header;
+}
+
+static void gcSlabFree(GCDataHeader_t* header) {
+    GCPage_t* page = getPage(header);
+    uint32_t idx = getCellIndex(page, header);
+    page->allocBits[idx / 64] &= ~((uint64_t)1 << (idx % 64));
+
+    *(void**)header = page->freeList;
+    page->freeList = header;
+    page->liveCnt--;
+}
+
+static void gcFinalizeLarge(void* ptr) {
+    while (ptr) {
+        void* next = getHeader(ptr)->next;
+        gcFreeElem(ptr);
+        ptr = next;
+    }
+}
+
+static void* gcSweeperRun(void* arg) {
+    GCSweeper_t* sweeper = arg;
+    for (;;) {
+        pthread_mutex_lock(&sweeper->lock);
+        while (!sweeper->busy) {
+            pthread_cond_wait(&sweeper->wake, &sweeper->lock);
+        }
+        uint32_t epoch = gcHandle.sweepEpoch;
+        pthread_mutex_unlock(&sweeper->lock);
+
+        for (uint32_t i = 0; i < sweeper->pages.cnt; i++) {
+            if (__atomic_load_n(&sweeper->stop, __ATOMIC_RELAXED))
+                break;
+            GCPage_t* page = sweeper->pages.buf[i];
+            if (gcClaimPage(page, epoch))
+                gcSweepPage(page, epoch);
+        }
+        if (!__atomic_load_n(&sweeper->stop, __ATOMIC_RELAXED)) {
+            gcFinalizeLarge(sweeper->large);
+            sweeper->large = NULL;
+        }
+
+        pthread_mutex_lock(&sweeper->lock);
+        sweeper->busy = false;
+        pthread_cond_signal(&sweeper->done);
+        pthread_mutex_unlock(&sweeper->lock);
+    }
+    return NULL;
+}
+
+// Sweeps every page the cursors did not reach yet and unmaps the pages
+// left empty past retainPages, never the one allocation currently happens
+// in. Runs before marking starts.
+static void gcFinishSweep(uint64_t retainPages) {
+    GCSweeper_t* sweeper = &gcHandle.sweeper;
+    pthread_mutex_lock(&sweeper->lock);
+    __atomic_store_n(&sweeper->stop, true, __ATOMIC_RELAXED);
+    while (sweeper->busy) {
+        pthread_cond_wait(&sweeper->done, &sweeper->lock);
+    }
+    sweeper->stop = false;
+    pthread_mutex_unlock(&sweeper->lock);
+
+    gcFinalizeLarge(sweeper->large);
+    sweeper->large = NULL;
+    sweeper->pages.cnt = 0;
+
+    uint32_t retained = 0;
+    for (uint32_t cls = 0; cls < GC_SLAB_CLASS_CNT; cls++) {
+        GCSizeClass_t* sc = &gcHandle.classes[cls];
+        GCPage_t* page = sc->pages;
+        while (page) {
+            GCPage_t* next = page->next;
+            if (gcClaimPage(page, gcHandle.sweepEpoch))
+                gcSweepPage(page, gcHandle.sweepEpoch);
+            if (page->liveCnt == 0 && page != sc->current && retained++ >= retainPages)
+                gcReleasePage(sc, page);
+            page = next;
+        }
+        // every page is swept now, allocation looks through all of them
+        sc->sweepNext = sc->pages;
+    }
+}
+
+// Called once marking is done, every slab page becomes unswept and is
+// handed to the background sweeper.
+static void gcStartSweep() {
+    GCSweeper_t* sweeper = &gcHandle.sweeper;
+    gcHandle.sweepEpoch++;
+    gcHandle.emptyPageCnt = 0;
+    gcHandle.slabPageCnt = 0;
+    gcHandle.slabMarkedBytes = 0;
+    for (uint32_t cls = 0; cls < GC_SLAB_CLASS_CNT; cls++) {
+        GCSizeClass_t* sc = &gcHandle.classes[cls];
+        sc->current = NULL;
+        sc->sweepNext = sc->pages;
+        for (GCPage_t* page = sc->pages; page; page = page->next) {
+            gcPtrStackPush(&sweeper->pages, page);
+
+            uint32_t marked = 0;
+            for (uint32_t w = 0; w < GC_PAGE_BITMAP_WORDS; w++) {
+                marked += __builtin_popcountll(page->markBits[w]);
+            }
+            gcHandle.slabPageCnt++;
+            gcHandle.slabMarkedBytes += (uint64_t)marked * page->cellSize;
         }
-        ptr = header->next;
     }
+
+    if (!sweeper->started)
+        sweeper->started = !pthread_create(&sweeper->thread, NULL, gcSweeperRun, sweeper);
+    // without the thread allocation sweeps on its own
+    if (!sweeper->started)
+        return;
+
+    pthread_mutex_lock(&sweeper->lock);
+    sweeper->busy = true;
+    pthread_cond_signal(&sweeper->wake);
+    pthread_mutex_unlock(&sweeper->lock);
+}
+
+/************************************
+ *       COMPACTION                 *
+ ************************************/
+
+static bool gcIsFragmented() {
+    if (gcHandle.slabPageCnt < GC_COMPACT_MIN_PAGES)
+        return false;
+    uint64_t pageBytes = (uint64_t)gcHandle.slabPageCnt * GC_PAGE_SIZE;
+    return gcHandle.slabMarkedBytes * 100 < pageBytes * GC_COMPACT_MAX_LIVE_PERCENT;
+}
+
+static GCDataHeader_t* getCell(GCPage_t* page, uint32_t idx) {
+    return (GCDataHeader_t*)(page->cells + idx * page->cellSize);
+}
+
+static bool gcPageHasPinned(GCPage_t* page) {
+    for (uint32_t idx = 0; idx < page->bumpIdx; idx++) {
+        if (((page->allocBits[idx / 64] >> (idx % 64)) & 1) &&
+            isBitSet(getCell(page, idx), EXTERNAL_REF_BIT))
+            return true;
+    }
+    return false;
 }
 
-static void gcRecurseMark(void* ptr) {
+// Copies every object of src into free cells of dst, leaving forwarding
+// addresses behind. Returns false once dst is full.
+static bool gcEvacuatePage(GCPage_t* src, GCPage_t* dst) {
+    for (uint32_t w = 0; w < GC_PAGE_BITMAP_WORDS; w++) {
+        while (src->allocBits[w]) {
+            if (dst->liveCnt == dst->cellCnt)
+                return false;
+            uint32_t idx = w * 64 + __builtin_ctzll(src->allocBits[w]);
+            src->allocBits[w] &= src->allocBits[w] - 1;
+            src->liveCnt--;
+
+            void* cell;
+            if (dst->freeList) {
+                cell = dst->freeList;
+                dst->freeList = *(void**)cell;
+            } else {
+                cell = dst->cells + dst->bumpIdx++ * dst->cellSize;
+            }
+            uint32_t dstIdx = getCellIndex(dst, cell);
+            dst->allocBits[dstIdx / 64] |= (uint64_t)1 << (dstIdx % 64);
+            dst->liveCnt++;
+
+            GCDataHeader_t* from = getCell(src, idx);
+            memcpy(cell, from, src->cellSize);
+            setBit(from, FORWARDED_BIT);
+            from->next = getPtr(cell);
+        }
+    }
+    return true;
+}
+
+static void gcForwardSlot(void** slot) {
+    void* ptr = *slot;
+    if (ptr && isBitSet(getHeader(ptr), FORWARDED_BIT))
+        *slot = getHeader(ptr)->next;
+}
+
+static int gcComparePageLiveCnt(const void* a, const void* b) {
+    uint32_t liveA = (*(GCPage_t**)a)->liveCnt;
+    uint32_t liveB = (*(GCPage_t**)b)->liveCnt;
+    return (liveA < liveB) - (liveA > liveB);
+}
+
+// Empties the sparsest pages of every size class into the densest ones,
+// then rewrites every reference to a moved object and releases the
+// evacuated pages. Pages holding external refs are never evacuated.
+static void gcCompact() {
+    gcFinishSweep(gcHandle.config.retainPages);
+
+    GCPtrStack_t pages = {0};
+    GCPtrStack_t evacuated = {0};
+    for (uint32_t cls = 0; cls < GC_SLAB_CLASS_CNT; cls++) {
+        GCSizeClass_t* sc = &gcHandle.classes[cls];
+        pages.cnt = 0;
+        for (GCPage_t* page = sc->pages; page; page = page->next) {
+            gcPtrStackPush(&pages, page);
+        }
+        if (pages.cnt < 2)
+            continue;
+        qsort(pages.buf, pages.cnt, sizeof(void*), gcComparePageLiveCnt);
+
+        uint32_t dst = 0;
+        uint32_t src = pages.cnt - 1;
+        while (dst < src) {
+            GCPage_t* page = pages.buf[src];
+            if (page->liveCnt * 2 >= page->cellCnt)
+                break;
+            if (gcPageHasPinned(page)) {
+                src--;
+                continue;
+            }
+            // a page is only touched if the denser ones can take all of it
+            uint32_t freeCnt = 0;
+            for (uint32_t i = dst; i < src; i++) {
+                GCPage_t* target = pages.buf[i];
+                freeCnt += target->cellCnt - target->liveCnt;
+            }
+            if (freeCnt < page->liveCnt)
+                break;
+
+            while (!gcEvacuatePage(page, pages.buf[dst])) {
+                dst++;
+            }
+            gcPtrStackPush(&evacuated, page);
+            src--;
+        }
+    }
+    free(pages.buf);
+
+    if (evacuated.cnt) {
+        // evacuated pages are empty now, every cell still allocated is live
+        for (uint32_t cls = 0; cls < GC_SLAB_CLASS_CNT; cls++) {
+            for (GCPage_t* page = gcHandle.classes[cls].pages; page; page = page->next) {
+                for (uint32_t w = 0; w < GC_PAGE_BITMAP_WORDS; w++) {
+                    uint64_t alloc = page->allocBits[w];
+                    while (alloc) {
+                        uint32_t idx = w * 64 + __builtin_ctzll(alloc);
+                        alloc &= alloc - 1;
+                        gcTrace(getPtr(getCell(page, idx)), gcForwardSlot);
+                    }
+                }
+            }
+        }
+        for (void* ptr = gcHandle.large; ptr; ptr = getHeader(ptr)->next) {
+            gcTrace(ptr, gcForwardSlot);
+        }
+        gcVisitRoots(gcForwardSlot);
+
+        for (uint32_t i = 0; i < evacuated.cnt; i++) {
+            GCPage_t* page = evacuated.buf[i];
+            uint32_t cls = page->cellSize / GC_SLAB_GRANULE - 1;
+            gcReleasePage(&gcHandle.classes[cls], page);
+        }
+        for (uint32_t cls = 0; cls < GC_SLAB_CLASS_CNT; cls++) {
+            gcHandle.classes[cls].current = NULL;
+            gcHandle.classes[cls].sweepNext = gcHandle.classes[cls].pages;
+        }
+    }
+    free(evacuated.buf);
+    // don't try again until the next major collection measured the heap
+    gcHandle.slabPageCnt = 0;
+}
+
+static void gcReleaseCell(GCDataHeader_t* header) {
+    if (header->sizeClass)
+        gcSlabFree(header);
+    else {
+        GCLargePrefix_t* prefix = (GCLargePrefix_t*)header - 1;
+        freeBuffer(prefix, prefix->total);
+    }
+}
+
+/************************************
+ *       POLICY                     *
+ ************************************/
+
+static uint64_t gcNowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t gcEnvValue(const char* name, uint64_t value) {
+    const char* env = getenv(name);
+    if (!env) return value;
+    long long parsed = strtoll(env, NULL, 10);
+    return parsed >= 0 ? (uint64_t)parsed : value;
+}
+
+// Reads the CAPUCHIN_GC_* overrides, once before the first collection
+static void gcConfigure() {
+    GCConfig_t* config = &gcHandle.config;
+    config->triggerBytes = gcEnvValue("CAPUCHIN_GC_TRIGGER_BYTES", config->triggerBytes);
+    config->growthPercent = gcEnvValue("CAPUCHIN_GC_GROWTH_PERCENT", config->growthPercent);
+    config->maxHeapBytes = gcEnvValue("CAPUCHIN_GC_MAX_HEAP_BYTES", config->maxHeapBytes);
+    config->sliceUs = gcEnvValue("CAPUCHIN_GC_SLICE_US", config->sliceUs);
+    if (!config->sliceUs)
+        config->sliceUs = 1;
+    config->retainPages = gcEnvValue("CAPUCHIN_GC_RETAIN_PAGES", config->retainPages);
+
+    gcHandle.osPageSize = sysconf(_SC_PAGESIZE);
+    gcHandle.configured = true;
+    gcUpdateBudget();
+}
+
+static void gcUpdateBudget() {
+    GCConfig_t* config = &gcHandle.config;
+    uint64_t live = gcHandle.stats.liveBytes;
+    uint64_t budget = live / 100 * config->growthPercent;
+    if (budget < config->triggerBytes)
+        budget = config->triggerBytes;
+
+    if (config->maxHeapBytes) {
+        uint64_t room = config->maxHeapBytes > live ? config->maxHeapBytes - live : 0;
+        if (room < GC_MIN_BUDGET_BYTES)
+            room = GC_MIN_BUDGET_BYTES;
+        if (budget > room)
+            budget = room;
+    }
+    gcHandle.allocBudget = budget;
+    if (gcHandle.allocBytes >= budget)
+        gcHandle.runPending = true;
+    gcUpdateHeapTrigger();
+}
+
+// Near the max heap size a minor collection is also due once half of the
+// room the last collection left is used up. Buffers of promoted objects
+// only go with a major collection, it is requested as well once they take
+// GC_HEAP_MAJOR_PERCENT of the max heap size.
+static void gcUpdateHeapTrigger() {
+    uint64_t max = gcHandle.config.maxHeapBytes;
+    if (!max) {
+        gcHandle.heapTrigger = UINT64_MAX;
+        return;
+    }
+    uint64_t heap = gcHeapBytes();
+    uint64_t room = max > heap ? (max - heap) / 2 : 0;
+    if (room < GC_MIN_BUDGET_BYTES)
+        room = GC_MIN_BUDGET_BYTES;
+    gcHandle.heapTrigger = heap + room;
+
+    if (!gcHandle.marking && heap >= max / 100 * GC_HEAP_MAJOR_PERCENT &&
+        gcHandle.allocBytes >= GC_MIN_BUDGET_BYTES)
+        gcHandle.runPending = true;
+}
+
+static void gcRecordPause(uint64_t start) {
+    uint64_t pause = gcNowUs() - start;
+    gcHandle.stats.pauseTotalUs += pause;
+    if (pause > gcHandle.stats.pauseMaxUs)
+        gcHandle.stats.pauseMaxUs = pause;
+}
+
+// Heap bytes taken by the object, header and padding included
+static size_t gcCellBytes(GCDataHeader_t* header) {
+    if (isBitSet(header, YOUNG_BIT))
+        return (sizeof(GCDataHeader_t) + header->size + 7) & ~(size_t)7;
+    if (header->sizeClass)
+        return header->sizeClass * GC_SLAB_GRANULE;
+    return ((GCLargePrefix_t*)header - 1)->total;
+}
+
+/************************************
+ *       MARK & SWEEP (OLD SPACE)   *
+ ************************************/
+
+// Begins a major collection, only the roots are marked here. The rest of
+// the heap is traced in slices while evaluation goes on, write barriers
+// shade the objects stored into marked ones.
+static void gcStartMarking() {
+    if (!gcHandle.configured)
+        gcConfigure();
+
+    // empty the nursery first, major collection only deals with old objects
+    gcMinorCollect();
+    // mark bits of pages left unswept still describe the previous run
+    gcFinishSweep(gcHandle.config.retainPages);
+
+    gcHandle.marking = true;
+    gcHandle.runPending = false;
+    gcMark();
+    gcMarkRoots();
+}
+
+// Traces gray objects until the budget runs out, returns true once there
+// is nothing left to trace.
+static bool gcMarkSlice() {
+#ifdef GC_STRESS
+    uint64_t deadline = 0; // one batch per safepoint
+#else
+    uint64_t deadline = gcNowUs() + gcHandle.config.sliceUs;
+#endif
+    if (gcUseParallelMark())
+        return gcParallelMark(deadline);
+
+    for (;;) {
+        for (uint32_t i = 0; i < GC_MARK_SLICE_CHECK_CNT; i++) {
+            // an overflow is left to the final rescan
+            if (!gcHandle.gray.cnt)
+                return true;
+            void* ptr = gcHandle.gray.buf[--gcHandle.gray.cnt];
+            gcTrace(ptr, gcMarkSlot);
+        }
+        if (gcNowUs() >= deadline)
+            return false;
+    }
+}
+
+// Roots are written without barriers, scan them again and trace what is
+// left, then hand the heap to the sweeper.
+static void gcFinishMarking() {
+    gcMinorCollect();
+    gcMark();
+    gcMarkRoots();
+    if (gcUseParallelMark())
+        gcParallelMark(UINT64_MAX);
+    gcDrainGray();
+    gcClearZeroCount();
+    gcSweepLarge();
+    gcStartSweep();
+
+    gcHandle.marking = false;
+    gcHandle.allocBytes = 0;
+    gcHandle.runPending = false;
+    gcHandle.stats.liveBytes = gcHandle.slabMarkedBytes + gcHandle.largeMarkedBytes;
+    gcHandle.stats.majorCollections++;
+    gcUpdateBudget();
+}
+
+static void gcMark() {
+    for (uint32_t i = 0; i < gcHandle.extRefs.cnt; i++) {
+        gcMarkSlot(&gcHandle.extRefs.buf[i]);
+    }
+}
+
+static void gcMarkSlot(void** slot) {
+    void* ptr = *slot;
+    // young objects are reached through the remembered set once promoted
+    if (!ptr || isBitSet(getHeader(ptr), YOUNG_BIT) || gcMarkedAsUsed(ptr))
+        return;
+    gcMarkUsed(ptr);
+    gcPushGray(ptr);
+}
+
+static void gcPushGray(void* ptr) {
+    GCPtrStack_t* gray = &gcHandle.gray;
+    if (gray->cnt == gray->cap) {
+        uint32_t cap = gray->cap ? gray->cap * 2 : 256;
+        void** buf = cap <= GC_MARK_STACK_MAX_CNT ? realloc(gray->buf, cap * sizeof(void*)) : NULL;
+        if (!buf) {
+            // leave it marked, the rescan traces it later
+            gcHandle.grayOverflow = true;
+            return;
+        }
+        gray->buf = buf;
+        gray->cap = cap;
+    }
+    gray->buf[gray->cnt++] = ptr;
+}
+
+// Traces gray objects until none are left, marking is iterative so deep
+// structures can't exhaust the C stack.
+static void gcDrainGray() {
+    do {
+        while (gcHandle.gray.cnt) {
+            void* ptr = gcHandle.gray.buf[--gcHandle.gray.cnt];
+            gcTrace(ptr, gcMarkSlot);
+        }
+        if (gcHandle.grayOverflow) {
+            gcHandle.grayOverflow = false;
+            gcRescanMarked();
+        }
+    } while (gcHandle.gray.cnt);
+}
+
+// Retraces every marked object, children dropped on overflow get marked
+// and pushed again. Already marked children are skipped.
+static void gcRescanMarked() {
+    for (uint32_t cls = 0; cls < GC_SLAB_CLASS_CNT; cls++) {
+        for (GCPage_t* page = gcHandle.classes[cls].pages; page; page = page->next) {
+            uint32_t words = (page->bumpIdx + 63) / 64;
+            for (uint32_t w = 0; w < words; w++) {
+                uint64_t marked = page->markBits[w];
+                while (marked) {
+                    uint32_t idx = w * 64 + __builtin_ctzll(marked);
+                    marked &= marked - 1;
+                    gcTrace(getPtr((GCDataHeader_t*)(page->cells + idx * page->cellSize)), gcMarkSlot);
+                }
+            }
+        }
+    }
+
+    for (void* ptr = gcHandle.large; ptr; ptr = getHeader(ptr)->next) {
+        if (isBitSet(getHeader(ptr), INTERNAL_REF_BIT))
+            gcTrace(ptr, gcMarkSlot);
+    }
+}
+
+static void gcMarkRoots() {
+    gcVisitRoots(gcMarkSlot);
+}
+
+static void gcVisitRoots(GCSlotVisitorFn_t visit) {
+    for (uint32_t i = 0; i < gcHandle.rootCnt; i++) {
+        GCRoot_t* root = &gcHandle.roots[i];
+        switch (root->type) {
+            case GC_ROOT_REF:
+                visit((void**)root->ptr);
+                break;
+            case GC_ROOT_VECTOR: {
+                uint32_t cnt = vectorGetCount(root->ptr);
+                void** buf = vectorGetBuffer(root->ptr);
+                for (uint32_t j = 0; j < cnt; j++) {
+                    visit(&buf[j]);
+                }
+                break;
+            }
+            case GC_ROOT_UNMANAGED:
+                // no header, only visit what it references
+                gcTraceFns[root->dataType](root->ptr, visit);
+                break;
+        }
+    }
+}
+
+static void gcTrace(void* ptr, GCSlotVisitorFn_t visit) {
     if (!ptr) return;
     GCDataHeader_t* header = getHeader(ptr);
     if ( header->type >= 0 && header->type < _GC_DATA_TYPE_CNT ){
-        GCMarkFn_t markFunc = gcMarkFns[header->type];
-        if (markFunc) 
-            markFunc(ptr);
+        GCTraceFn_t traceFunc = gcTraceFns[header->type];
+        if (traceFunc)
+            traceFunc(ptr, visit);
     }
 }
 
-static void gcSweep() {
-    if (!gcHandle.first) return;
+// Unlinks the unreachable large objects, their cleanup is left to the
+// background sweeper.
+static void gcSweepLarge() {
+    gcHandle.largeMarkedBytes = 0;
+    if (!gcHandle.large) return;
 
-    GCDataHeader_t sentinel = {.next = gcHandle.first};
+    GCDataHeader_t sentinel = {.next = gcHandle.large};
     GCDataHeader_t* prev = &sentinel;
-    GCDataHeader_t* curr = getHeader(gcHandle.first);
-    
+    GCDataHeader_t* curr = getHeader(gcHandle.large);
+
     while (curr) {
         if (!isBitSet(curr, INTERNAL_REF_BIT)) {
-            // remove element 
+            // remove element
             prev->next = curr->next;
-            void* cptr = getPtr(curr);
-            gcFreeElem(cptr);
+            curr->next = gcHandle.sweeper.large;
+            gcHandle.sweeper.large = getPtr(curr);
             curr = getHeader(prev->next);
         } else  {
             clearBit(curr, INTERNAL_REF_BIT);
-            prev = curr; 
+            gcHandle.largeMarkedBytes += gcCellBytes(curr);
+            prev = curr;
             curr = getHeader(curr->next);
         }
     }
 
-    gcHandle.first = sentinel.next;
+    gcHandle.large = sentinel.next;
+}
+
+/************************************
+ *       HEAP SNAPSHOT              *
+ ************************************/
+
+// One line per root, object and reference, ids are object addresses:
+//   root <id> <local|external|frame>
+//   object <id> <type> <bytes>        cell plus owned buffers
+//   ref <from id> <to id> <label>     binding name, - if the slot has none
+// Only objects reachable from the roots are written.
+typedef struct GCSnapshot {
+    FILE* file;
+    GCPtrStack_t pending; // written objects whose references are not
+    GCPtrStack_t dumped; // objects with the dumped bit set
+    void* owner; // object whose references are being written
+    GCDataType_t ownerType;
+} GCSnapshot_t;
+
+static GCSnapshot_t* gcSnapshot = NULL;
+
+static const char* gcTypeAsStr(void* ptr, GCDataType_t type) {
+    if (type == GC_DATA_ENVIRONENT)
+        return "ENVIRONMENT";
+    return objectTypeToString(((Object_t*)ptr)->type);
+}
+
+static void* gcResolveForwarded(void* ptr) {
+    GCDataHeader_t* header = getHeader(ptr);
+    return isBitSet(header, FORWARDED_BIT) ? header->next : ptr;
+}
+
+// Writes ptr the first time it is reached
+static void gcSnapshotObject(void* ptr) {
+    GCDataHeader_t* header = getHeader(ptr);
+    if (isBitSet(header, DUMPED_BIT))
+        return;
+    setBit(header, DUMPED_BIT);
+    gcPtrStackPush(&gcSnapshot->dumped, ptr);
+    gcPtrStackPush(&gcSnapshot->pending, ptr);
+
+    GCOwnedBytesFn_t ownedBytesFn = gcOwnedBytesFns[header->type];
+    size_t bytes = gcCellBytes(header) + (ownedBytesFn ? ownedBytesFn(ptr) : 0);
+    fprintf(gcSnapshot->file, "object %" PRIxPTR " %s %zu\n",
+            (uintptr_t)ptr, gcTypeAsStr(ptr, header->type), bytes);
+}
+
+static void gcSnapshotSlot(void** slot) {
+    if (!*slot) return;
+    void* ptr = gcResolveForwarded(*slot);
+    GCSlotNameFn_t slotNameFn = gcSlotNameFns[gcSnapshot->ownerType];
+    const char* label = slotNameFn ? slotNameFn(gcSnapshot->owner, slot) : "-";
+    fprintf(gcSnapshot->file, "ref %" PRIxPTR " %" PRIxPTR " %s\n",
+            (uintptr_t)gcSnapshot->owner, (uintptr_t)ptr, label);
+    gcSnapshotObject(ptr);
+}
+
+static void gcSnapshotRoot(void* ptr, const char* kind) {
+    if (!ptr) return;
+    ptr = gcResolveForwarded(ptr);
+    fprintf(gcSnapshot->file, "root %" PRIxPTR " %s\n", (uintptr_t)ptr, kind);
+    gcSnapshotObject(ptr);
+}
+
+bool gcDumpHeap(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    GCSnapshot_t snapshot = { .file = file };
+    gcSnapshot = &snapshot;
+
+    for (uint32_t i = 0; i < gcHandle.extRefs.cnt; i++) {
+        gcSnapshotRoot(gcHandle.extRefs.buf[i], "external");
+    }
+    for (uint32_t i = 0; i < gcHandle.rootCnt; i++) {
+        GCRoot_t* root = &gcHandle.roots[i];
+        if (root->type == GC_ROOT_REF) {
+            gcSnapshotRoot(*(void**)root->ptr, "local");
+        } else if (root->type == GC_ROOT_VECTOR) {
+            uint32_t cnt = vectorGetCount(root->ptr);
+            void** buf = vectorGetBuffer(root->ptr);
+            for (uint32_t j = 0; j < cnt; j++) {
+                gcSnapshotRoot(buf[j], "local");
+            }
+        } else {
+            // stack frames have no header, nothing else points to them
+            fprintf(file, "root %" PRIxPTR " frame\n", (uintptr_t)root->ptr);
+            fprintf(file, "object %" PRIxPTR " FRAME 0\n", (uintptr_t)root->ptr);
+            snapshot.owner = root->ptr;
+            snapshot.ownerType = root->dataType;
+            gcTraceFns[root->dataType](root->ptr, gcSnapshotSlot);
+        }
+    }
+
+    while (snapshot.pending.cnt) {
+        snapshot.owner = snapshot.pending.buf[--snapshot.pending.cnt];
+        snapshot.ownerType = getHeader(snapshot.owner)->type;
+        gcTrace(snapshot.owner, gcSnapshotSlot);
+    }
+
+    for (uint32_t i = 0; i < snapshot.dumped.cnt; i++) {
+        clearBit(getHeader(snapshot.dumped.buf[i]), DUMPED_BIT);
+    }
+    free(snapshot.pending.buf);
+    free(snapshot.dumped.buf);
+    gcSnapshot = NULL;
+    return fclose(file) == 0;
+}
+
+void gcRequestHeapDump() {
+    gcDumpRequested = 1;
+}
+
+// CAPUCHIN_HEAP_DUMP names the file, capuchin-<pid>.heap by default
+static void gcWriteRequestedDump() {
+    gcDumpRequested = 0;
+    const char* path = getenv("CAPUCHIN_HEAP_DUMP");
+    char defaultPath[64];
+    if (!path) {
+        snprintf(defaultPath, sizeof(defaultPath), "capuchin-%ld.heap", (long)getpid());
+        path = defaultPath;
+    }
+    if (!gcDumpHeap(path))
+        perror("GC failed to write heap snapshot");
+}
+
+/************************************
+ *       PARALLEL MARKING           *
+ ************************************/
+
+static __thread GCMarkWorker_t* gcCurrentWorker = NULL;
+
+static GCDequeArray_t* createDequeArray(int64_t size) {
+    GCDequeArray_t* array = mallocChk(sizeof(GCDequeArray_t) + size * sizeof(void*));
+    array->size = size;
+    return array;
+}
+
+static void gcDequePush(GCMarkDeque_t* deque, void* ptr) {
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    GCDequeArray_t* array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+    if (b - t > array->size - 1) {
+        GCDequeArray_t* grown = createDequeArray(array->size * 2);
+        for (int64_t i = t; i < b; i++) {
+            grown->buf[i & (grown->size - 1)] = array->buf[i & (array->size - 1)];
+        }
+        gcPtrStackPush(&deque->retired, array);
+        __atomic_store_n(&deque->array, grown, __ATOMIC_RELEASE);
+        array = grown;
+    }
+    __atomic_store_n(&array->buf[b & (array->size - 1)], ptr, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+static void* gcDequeTake(GCMarkDeque_t* deque) {
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    GCDequeArray_t* array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    void* ptr = NULL;
+    if (t <= b) {
+        ptr = __atomic_load_n(&array->buf[b & (array->size - 1)], __ATOMIC_RELAXED);
+        if (t == b) {
+            // last element, race thieves for it
+            if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+                ptr = NULL;
+            __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+// Returns NULL if the deque is empty or another thread won the race.
+static void* gcDequeSteal(GCMarkDeque_t* deque) {
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return NULL;
+
+    GCDequeArray_t* array = __atomic_load_n(&deque->array, __ATOMIC_ACQUIRE);
+    void* ptr = __atomic_load_n(&array->buf[t & (array->size - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    return ptr;
+}
+
+static bool gcDequeIsEmpty(GCMarkDeque_t* deque) {
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    return t >= b;
+}
+
+// Mark bits may be set by several threads at once, returns false if the
+// object was already marked.
+static bool gcTryMarkAtomic(void* ptr) {
+    GCDataHeader_t* header = getHeader(ptr);
+    if (header->sizeClass) {
+        GCPage_t* page = getPage(header);
+        uint32_t idx = getCellIndex(page, header);
+        uint64_t* word = &page->markBits[idx / 64];
+        uint64_t bit = (uint64_t)1 << (idx % 64);
+        if (__atomic_load_n(word, __ATOMIC_RELAXED) & bit)
+            return false;
+        return !(__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit);
+    }
+    if (__atomic_load_n(&header->mark, __ATOMIC_RELAXED) & INTERNAL_REF_BIT)
+        return false;
+    return !(__atomic_fetch_or(&header->mark, INTERNAL_REF_BIT, __ATOMIC_RELAXED) & INTERNAL_REF_BIT);
+}
+
+static void gcParallelMarkSlot(void** slot) {
+    void* ptr = *slot;
+    // slices run while the nursery holds objects
+    if (ptr && !isBitSet(getHeader(ptr), YOUNG_BIT) && gcTryMarkAtomic(ptr)) {
+        gcDequePush(&gcCurrentWorker->deque, ptr);
+    }
+}
+
+static void* gcStealWork(GCMarkWorker_t* worker) {
+    uint32_t cnt = gcHandle.markWorkerCnt;
+    for (uint32_t i = 1; i < cnt; i++) {
+        void* ptr = gcDequeSteal(&gcHandle.markWorkers[(worker->id + i) % cnt].deque);
+        if (ptr)
+            return ptr;
+    }
+    return NULL;
+}
+
+static bool gcWorkAvailable() {
+    for (uint32_t i = 0; i < gcHandle.markWorkerCnt; i++) {
+        if (!gcDequeIsEmpty(&gcHandle.markWorkers[i].deque))
+            return true;
+    }
+    return false;
+}
+
+static bool gcMarkDeadlinePassed() {
+    uint64_t deadline = gcHandle.markPool.deadline;
+    return deadline != UINT64_MAX && gcNowUs() >= deadline;
+}
+
+static void gcMarkWorkerRun(GCMarkWorker_t* worker) {
+    gcCurrentWorker = worker;
+
+    uint32_t traced = 0;
+    for (;;) {
+        void* ptr = gcDequeTake(&worker->deque);
+        if (!ptr) 
+            ptr = gcStealWork(worker);
+        if (ptr) {
+            gcTrace(ptr, gcParallelMarkSlot);
+            // what is left in the deques goes back to the gray stack
+            if (++traced % GC_MARK_SLICE_CHECK_CNT == 0 && gcMarkDeadlinePassed())
+                return;
+            continue;
+        }
+
+        // idle workers never push, once all of them are idle marking is done
+        __atomic_add_fetch(&gcHandle.idleWorkerCnt, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+            if (gcWorkAvailable()) {
+                __atomic_sub_fetch(&gcHandle.idleWorkerCnt, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+            if (__atomic_load_n(&gcHandle.idleWorkerCnt, __ATOMIC_SEQ_CST) == gcHandle.markWorkerCnt ||
+                gcMarkDeadlinePassed())
+                return;
+            sched_yield();
+        }
+    }
+}
+
+static void* gcMarkThreadRun(void* arg) {
+    GCMarkWorker_t* worker = arg;
+    GCMarkPool_t* pool = &gcHandle.markPool;
+    uint32_t round = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->round == round) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        round = pool->round;
+        pthread_mutex_unlock(&pool->lock);
+
+        gcMarkWorkerRun(worker);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->finishedCnt++;
+        pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+static void gcStartMarkThreads() {
+    GCMarkPool_t* pool = &gcHandle.markPool;
+    pool->started = true;
+    for (uint32_t i = 1; i < gcHandle.markWorkerCnt; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, gcMarkThreadRun, &gcHandle.markWorkers[i]))
+            break;
+        pthread_detach(thread);
+        pool->threadCnt++;
+    }
+}
+
+static void gcConfigureMarkWorkers() {
+    const char* env = getenv("CAPUCHIN_GC_THREADS");
+    long cnt = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (cnt < 1) cnt = 1;
+    if (cnt > GC_MAX_MARK_THREADS) cnt = GC_MAX_MARK_THREADS;
+
+    gcHandle.markWorkerCnt = cnt;
+    gcHandle.markWorkers = mallocChk(cnt * sizeof(GCMarkWorker_t));
+    for (uint32_t i = 0; i < cnt; i++) {
+        gcHandle.markWorkers[i] = (GCMarkWorker_t) {
+            .deque = {
+                .top = 0,
+                .bottom = 0,
+                .array = createDequeArray(1024),
+                .retired = {0}
+            },
+            .id = i
+        };
+    }
+}
+
+static bool gcUseParallelMark() {
+    if (!gcHandle.markWorkerCnt)
+        gcConfigureMarkWorkers();
+    return gcHandle.markWorkerCnt > 1 && gcHandle.objCount >= GC_PARALLEL_MARK_MIN_OBJECTS;
+}
+
+// Hands the gray stack out to the mark workers and traces the heap from
+// it on several threads until nothing is left or the deadline passed.
+// Incremental slices and the final marking both come through here, the
+// threads are started once and reused. Returns true if tracing is done.
+static bool gcParallelMark(uint64_t deadline) {
+    uint32_t cnt = gcHandle.markWorkerCnt;
+    GCMarkWorker_t* workers = gcHandle.markWorkers;
+    GCMarkPool_t* pool = &gcHandle.markPool;
+    if (!pool->started)
+        gcStartMarkThreads();
+
+    for (uint32_t i = 0; i < gcHandle.gray.cnt; i++) {
+        gcDequePush(&workers[i % cnt].deque, gcHandle.gray.buf[i]);
+    }
+    gcHandle.gray.cnt = 0;
+    // workers that failed to start count as idle, their deques get stolen
+    gcHandle.idleWorkerCnt = cnt - 1 - pool->threadCnt;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->deadline = deadline;
+    pool->finishedCnt = 0;
+    pool->round++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    gcMarkWorkerRun(&workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->finishedCnt < pool->threadCnt) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 0; i < cnt; i++) {
+        GCMarkDeque_t* deque = &workers[i].deque;
+        void* ptr;
+        while ((ptr = gcDequeTake(deque))) {
+            gcPushGray(ptr);
+        }
+        while (deque->retired.cnt) {
+            free(deque->retired.buf[--deque->retired.cnt]);
+        }
+    }
+    return !gcHandle.gray.cnt;
 }
 
 static void gcFreeElem(void* ptr) {
@@ -191,33 +2012,23 @@ static void gcFreeElem(void* ptr) {
     GCDataHeader_t* header = getHeader(ptr);
     if ( header->type >= 0 && header->type < _GC_DATA_TYPE_CNT ){
         GCCleanupFn_t cleanupFunc = gcCleanupFns[header->type];
-        if (cleanupFunc) { 
+        if (cleanupFunc) {
             void **cptr = &ptr;
             cleanupFunc(cptr);
         }
     }
-    
-}
 
-static char* gcTypeAsStr(void* ptr){
-    GCDataHeader_t* header = getHeader(ptr);
-    return (header->type == GC_DATA_ENVIRONENT)? "ENV" : "OBJ";
 }
 
-static void gcDebugPrintChain(void* ptr) {
-    //printf("-----START-----\n");
-    while (ptr) {
-        printf("ptr(%s|%d|%d)@0x%p\n",
-            gcTypeAsStr(ptr),
-            isBitSet(getHeader(ptr), EXTERNAL_REF_BIT),
-            isBitSet(getHeader(ptr), INTERNAL_REF_BIT),
-            ptr);
-        ptr = getHeader(ptr)->next;
+static void gcPtrStackPush(GCPtrStack_t* stack, void* ptr) {
+    if (stack->cnt == stack->cap) {
+        stack->cap = stack->cap ? stack->cap * 2 : 256;
+        stack->buf = realloc(stack->buf, stack->cap * sizeof(void*));
+        if (!stack->buf) HANDLE_OOM();
     }
-    //printf("-----END-----\n");
+    stack->buf[stack->cnt++] = ptr;
 }
 
-
 static inline void setBit(GCDataHeader_t* header, uint8_t bitmask) {
     header->mark |= bitmask;
 }
@@ -2,6 +2,7 @@
 #define _GC_H_
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 typedef enum GCDataType{
@@ -11,14 +12,87 @@ typedef enum GCDataType{
 } GCDataType_t;
 
 
+typedef void (*GCSlotVisitorFn_t) (void** slot);
+
+// Small objects start out young in the nursery, surviving a minor
+// collection moves them to the old space. Tenured allocations go to the
+// old space directly and never move.
 void* gcMalloc(size_t size, GCDataType_t type);
+void* gcMallocTenured(size_t size, GCDataType_t type);
 void gcFree(void* ptr);
+
+// Must be called after storing value into an already allocated object
+// owner, keeps old to young references visible to minor collections.
+void gcWriteBarrier(void* owner, void* value);
+// Must be called when a store into owner overwrites value, scalars and
+// arrays are reclaimed without tracing once no old object references them.
+void gcDropRef(void* owner, void* value);
+// References old objects hold to ptr, 0 for objects that are not counted.
+uint32_t gcGetRefCount(void* ptr);
 void gcForceRun();
+// Like gcForceRun, but sweeping is finished before it returns and every
+// empty page goes back to the OS, gcHeapBytes only counts live data then.
+// Must be called at a safepoint.
+void gcCollectAll();
 
 void gcMarkUsed(void* ptr);
 bool gcMarkedAsUsed(void*ptr);
 
+// Young objects are promoted first, use the returned pointer from then on.
 void* gcGetExtRef(void* ptr);
 void gcFreeExtRef(void* ptr);
 
+// Precise roots for GC pointers held in C locals of the evaluator.
+// Roots are popped in reverse order of pushing.
+typedef struct Vector Vector_t;
+
+void gcPushRoot(void** ref); // address of a local, may hold NULL
+void gcPushVectorRoot(Vector_t* vec); // every element is a GC pointer
+void gcPushUnmanagedRoot(void* ptr, GCDataType_t type); // lives outside the GC heap
+void gcPopRoots(uint32_t cnt);
+
+// gcMalloc only requests a collection once enough was allocated, it is
+// carried out at the next safepoint where every live value is rooted.
+// Defining GC_STRESS collects at every safepoint.
+void gcSafepoint();
+
+typedef struct GCStats {
+    uint64_t minorCollections;
+    uint64_t majorCollections;
+    uint64_t pauseTotalUs; // time evaluation was stopped for collections
+    uint64_t pauseMaxUs;
+    uint64_t liveBytes; // old space bytes found live by the last major run
+    uint64_t freedBytes; // reclaimed so far, nursery included
+    uint64_t refCountFreedBytes; // part of freedBytes reclaimed by reference counting
+    uint64_t heapBytes; // slab pages currently mapped
+    uint64_t returnedBytes; // handed back to the OS so far
+} GCStats_t;
+
+GCStats_t gcGetStats();
+// Memory the heap holds right now: slab pages plus the large objects and
+// the string and array buffers allocated outside of them.
+uint64_t gcHeapBytes();
+
+// Collection policy, defaults can be overridden by the CAPUCHIN_GC_*
+// environment variables. A major collection starts once the old space
+// allocated triggerBytes, or growthPercent of the bytes the last one found
+// live if that is more. Approaching maxHeapBytes (0 for no limit) makes
+// collections more frequent.
+typedef struct GCConfig {
+    uint64_t triggerBytes;
+    uint64_t growthPercent;
+    uint64_t maxHeapBytes;
+    uint64_t sliceUs; // time budget of one incremental marking slice
+    uint64_t retainPages; // empty heap pages kept resident after a collection
+} GCConfig_t;
+
+GCConfig_t gcGetConfig();
+void gcSetConfig(GCConfig_t config);
+
+// Writes every object reachable from the roots with its type, size and
+// references to path, returns false if the file could not be written.
+bool gcDumpHeap(const char* path);
+// Async signal safe, the next safepoint writes the snapshot.
+void gcRequestHeapDump();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "../utils.h"
+
+// Summarizes a snapshot written by heap_dump() or SIGUSR1: object counts
+// and bytes by type, and how the largest objects are retained.
+//   heapstat <snapshot> [TYPE]
+
+#define LINE_SIZE 512
+#define TOP_OBJECT_CNT 5
+#define NO_PARENT UINT32_MAX
+
+typedef struct HeapObject {
+    uint64_t id;
+    uint64_t bytes;
+    const char* type;
+    uint32_t parent; // first object reaching this one from the roots
+    const char* parentLabel;
+} HeapObject_t;
+
+typedef struct HeapRef {
+    uint64_t from;
+    uint64_t to;
+    char* label;
+} HeapRef_t;
+
+typedef struct TypeSummary {
+    const char* type;
+    uint64_t cnt;
+    uint64_t bytes;
+} TypeSummary_t;
+
+typedef struct Snapshot {
+    HeapObject_t* objects;
+    uint32_t objectCnt;
+    HeapRef_t* refs;
+    uint32_t refCnt;
+    uint64_t* roots;
+    uint32_t rootCnt;
+    char** types; // distinct type names, objects point into this table
+    uint32_t typeCnt;
+} Snapshot_t;
+
+static void* growArray(void* buf, uint32_t cnt, size_t elemSize) {
+    // capacity doubles at every power of two
+    if (cnt == 0 || (cnt & (cnt - 1)) == 0) {
+        buf = realloc(buf, (cnt ? cnt * 2 : 16) * elemSize);
+        if (!buf) HANDLE_OOM();
+    }
+    return buf;
+}
+
+static const char* internType(Snapshot_t* snap, const char* type) {
+    for (uint32_t i = 0; i < snap->typeCnt; i++) {
+        if (strcmp(snap->types[i], type) == 0)
+            return snap->types[i];
+    }
+    snap->types = growArray(snap->types, snap->typeCnt, sizeof(char*));
+    snap->types[snap->typeCnt] = cloneString(type);
+    return snap->types[snap->typeCnt++];
+}
+
+static bool readSnapshot(const char* path, Snapshot_t* snap) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror("Failed to open snapshot");
+        return false;
+    }
+
+    char line[LINE_SIZE];
+    char kind[16], type[LINE_SIZE], label[LINE_SIZE];
+    uint32_t lineNum = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineNum++;
+        uint64_t a, b;
+        if (sscanf(line, "object %" SCNx64 " %s %" SCNu64, &a, type, &b) == 3) {
+            snap->objects = growArray(snap->objects, snap->objectCnt, sizeof(HeapObject_t));
+            snap->objects[snap->objectCnt++] = (HeapObject_t){
+                .id = a,
+                .bytes = b,
+                .type = internType(snap, type),
+                .parent = NO_PARENT,
+                .parentLabel = NULL
+            };
+        } else if (sscanf(line, "ref %" SCNx64 " %" SCNx64 " %s", &a, &b, label) == 3) {
+            snap->refs = growArray(snap->refs, snap->refCnt, sizeof(HeapRef_t));
+            snap->refs[snap->refCnt++] = (HeapRef_t){
+                .from = a,
+                .to = b,
+                .label = strcmp(label, "-") == 0 ? NULL : cloneString(label)
+            };
+        } else if (sscanf(line, "root %" SCNx64 " %15s", &a, kind) == 2) {
+            snap->roots = growArray(snap->roots, snap->rootCnt, sizeof(uint64_t));
+            snap->roots[snap->rootCnt++] = a;
+        } else {
+            fprintf(stderr, "%s:%u: malformed snapshot line\n", path, lineNum);
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static int compareObjectIds(const void* a, const void* b) {
+    uint64_t x = ((const HeapObject_t*)a)->id;
+    uint64_t y = ((const HeapObject_t*)b)->id;
+    return (x > y) - (x < y);
+}
+
+static int compareSummaryBytes(const void* a, const void* b) {
+    uint64_t x = ((const TypeSummary_t*)a)->bytes;
+    uint64_t y = ((const TypeSummary_t*)b)->bytes;
+    return (x < y) - (x > y);
+}
+
+static uint32_t findObject(Snapshot_t* snap, uint64_t id) {
+    HeapObject_t key = { .id = id };
+    HeapObject_t* obj = bsearch(&key, snap->objects, snap->objectCnt,
+                                sizeof(HeapObject_t), compareObjectIds);
+    return obj ? (uint32_t)(obj - snap->objects) : NO_PARENT;
+}
+
+// Breadth first from the roots, so every object remembers a shortest path
+static void findRetainers(Snapshot_t* snap) {
+    uint32_t* edgeStart = calloc(snap->objectCnt + 1, sizeof(uint32_t));
+    uint32_t* edges = mallocChk(sizeof(uint32_t) * (snap->refCnt + 1));
+    uint32_t* queue = mallocChk(sizeof(uint32_t) * (snap->objectCnt + 1));
+    bool* visited = calloc(snap->objectCnt + 1, sizeof(bool));
+    if (!edgeStart || !visited) HANDLE_OOM();
+
+    // edges of object i are refs[edges[edgeStart[i]..edgeStart[i+1]]]
+    for (uint32_t i = 0; i < snap->refCnt; i++) {
+        uint32_t from = findObject(snap, snap->refs[i].from);
+        if (from != NO_PARENT)
+            edgeStart[from + 1]++;
+    }
+    for (uint32_t i = 0; i < snap->objectCnt; i++) {
+        edgeStart[i + 1] += edgeStart[i];
+    }
+    uint32_t* fill = mallocChk(sizeof(uint32_t) * (snap->objectCnt + 1));
+    memcpy(fill, edgeStart, sizeof(uint32_t) * (snap->objectCnt + 1));
+    for (uint32_t i = 0; i < snap->refCnt; i++) {
+        uint32_t from = findObject(snap, snap->refs[i].from);
+        if (from != NO_PARENT)
+            edges[fill[from]++] = i;
+    }
+    free(fill);
+
+    uint32_t head = 0, tail = 0;
+    for (uint32_t i = 0; i < snap->rootCnt; i++) {
+        uint32_t root = findObject(snap, snap->roots[i]);
+        if (root != NO_PARENT && !visited[root]) {
+            visited[root] = true;
+            queue[tail++] = root;
+        }
+    }
+    while (head < tail) {
+        uint32_t cur = queue[head++];
+        for (uint32_t e = edgeStart[cur]; e < edgeStart[cur + 1]; e++) {
+            HeapRef_t* ref = &snap->refs[edges[e]];
+            uint32_t to = findObject(snap, ref->to);
+            if (to == NO_PARENT || visited[to])
+                continue;
+            visited[to] = true;
+            snap->objects[to].parent = cur;
+            snap->objects[to].parentLabel = ref->label;
+            queue[tail++] = to;
+        }
+    }
+
+    free(edgeStart);
+    free(edges);
+    free(queue);
+    free(visited);
+}
+
+static void printTypeSummary(Snapshot_t* snap) {
+    TypeSummary_t* summary = calloc(snap->typeCnt + 1, sizeof(TypeSummary_t));
+    if (!summary) HANDLE_OOM();
+    for (uint32_t i = 0; i < snap->typeCnt; i++) {
+        summary[i].type = snap->types[i];
+    }
+
+    uint64_t totalBytes = 0;
+    for (uint32_t i = 0; i < snap->objectCnt; i++) {
+        HeapObject_t* obj = &snap->objects[i];
+        uint32_t t = 0;
+        while (summary[t].type != obj->type) {
+            t++;
+        }
+        summary[t].cnt++;
+        summary[t].bytes += obj->bytes;
+        totalBytes += obj->bytes;
+    }
+    qsort(summary, snap->typeCnt, sizeof(TypeSummary_t), compareSummaryBytes);
+
+    printf("%u objects, %" PRIu64 " bytes, %u references, %u roots\n\n",
+           snap->objectCnt, totalBytes, snap->refCnt, snap->rootCnt);
+    printf("%-12s %10s %12s %6s\n", "TYPE", "COUNT", "BYTES", "%");
+    for (uint32_t i = 0; i < snap->typeCnt; i++) {
+        printf("%-12s %10" PRIu64 " %12" PRIu64 " %6.1f\n", summary[i].type,
+               summary[i].cnt, summary[i].bytes,
+               totalBytes ? 100.0 * summary[i].bytes / totalBytes : 0.0);
+    }
+    free(summary);
+}
+
+static void printRetentionPath(Snapshot_t* snap, uint32_t idx) {
+    // the path is stored child to parent, print it from the root down
+    uint32_t depth = 0;
+    for (uint32_t cur = idx; cur != NO_PARENT; cur = snap->objects[cur].parent) {
+        depth++;
+    }
+    uint32_t* path = mallocChk(sizeof(uint32_t) * depth);
+    uint32_t i = depth;
+    for (uint32_t cur = idx; cur != NO_PARENT; cur = snap->objects[cur].parent) {
+        path[--i] = cur;
+    }
+
+    printf("    root");
+    for (i = 0; i < depth; i++) {
+        HeapObject_t* obj = &snap->objects[path[i]];
+        if (i > 0 && obj->parentLabel)
+            printf(" -%s->", obj->parentLabel);
+        else if (i > 0)
+            printf(" ->");
+        printf(" %s", obj->type);
+    }
+    printf("\n");
+    free(path);
+}
+
+static void printLargestObjects(Snapshot_t* snap, const char* type) {
+    uint32_t top[TOP_OBJECT_CNT];
+    uint32_t topCnt = 0;
+    for (uint32_t i = 0; i < snap->objectCnt; i++) {
+        HeapObject_t* obj = &snap->objects[i];
+        if (type && strcmp(obj->type, type) != 0)
+            continue;
+        // insertion into the short list sorted by size
+        uint32_t pos = topCnt < TOP_OBJECT_CNT ? topCnt++ : TOP_OBJECT_CNT;
+        while (pos > 0 && snap->objects[top[pos - 1]].bytes < obj->bytes) {
+            if (pos < TOP_OBJECT_CNT)
+                top[pos] = top[pos - 1];
+            pos--;
+        }
+        if (pos < TOP_OBJECT_CNT)
+            top[pos] = i;
+    }
+
+    printf("\nlargest %s%sobjects:\n", type ? type : "", type ? " " : "");
+    for (uint32_t i = 0; i < topCnt; i++) {
+        HeapObject_t* obj = &snap->objects[top[i]];
+        printf("  %" PRIx64 " %s %" PRIu64 " bytes\n", obj->id, obj->type, obj->bytes);
+        printRetentionPath(snap, top[i]);
+    }
+}
+
+static void cleanupSnapshot(Snapshot_t* snap) {
+    for (uint32_t i = 0; i < snap->refCnt; i++) {
+        free(snap->refs[i].label);
+    }
+    for (uint32_t i = 0; i < snap->typeCnt; i++) {
+        free(snap->types[i]);
+    }
+    free(snap->objects);
+    free(snap->refs);
+    free(snap->roots);
+    free(snap->types);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <snapshot> [TYPE]\n", argv[0]);
+        return 1;
+    }
+
+    Snapshot_t snap = {0};
+    if (!readSnapshot(argv[1], &snap)) {
+        cleanupSnapshot(&snap);
+        return 1;
+    }
+    qsort(snap.objects, snap.objectCnt, sizeof(HeapObject_t), compareObjectIds);
+    findRetainers(&snap);
+
+    printTypeSummary(&snap);
+    printLargestObjects(&snap, argc == 3 ? argv[2] : NULL);
+
+    cleanupSnapshot(&snap);
+    return 0;
+}
@@ -1,38 +1,170 @@
 #include <malloc.h>
 #include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "hmap.h"
 #include "utils.h"
 
-// Number of buckets allocated at has map creation.
-#define DEFAULT_NUM_BUCKETS 4 
+// Number of slots allocated at hash map creation. Tables smaller than
+// a group still get a full group of control bytes, the unused tail
+// stays EMPTY and is masked out when looking for free slots.
+#define DEFAULT_CAPACITY 4
+#define GROUP_WIDTH 16
+
+// Old table slots moved to the new table per insert while a resize is in
+// progress. The new table has room for all old items plus as many inserts
+// as the old table had slots, migration always finishes long before that.
+#define MIGRATE_SLOTS_PER_OP (2 * GROUP_WIDTH)
+
+// Control byte values, full slots store the 7 bit H2 hash (top bit clear).
+#define CTRL_EMPTY ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xFE)
+
+static void hashMapAllocTable(HashMap_t* map, uint32_t capacity);
+static void hashMapFreeTable(uint8_t* ctrl, HashMapEntry_t* slots, uint32_t capacity);
+static void hashMapStartResize(HashMap_t* map);
+static void hashMapMigrate(HashMap_t* map, uint32_t slotCnt);
+static HashMapEntry_t* hashMapFindEntry(const HashMap_t* map, const void* key, uint64_t hash);
+static int64_t findSlot(const uint8_t* ctrl, const HashMapEntry_t* slots, uint32_t capacity,
+                        const HashMapKeyOps_t* keyOps, const void* key, uint64_t hash);
+static uint32_t findFreeSlot(const uint8_t* ctrl, uint32_t capacity, uint64_t hash);
+static void hashMapPlaceEntry(HashMap_t* map, void* key, uint64_t hash, void* value);
+static void cleanupHashMapEntry(HashMap_t* map, HashMapEntry_t* entry, HashMapElemCleanupFn_t cleanupFn);
+static uint32_t getMaxLoad(uint32_t capacity);
+static uint32_t getCtrlSize(uint32_t capacity);
+
+static inline uint64_t hashH1(uint64_t hash) { return hash >> 7; }
+static inline uint8_t hashH2(uint64_t hash) { return (uint8_t)(hash & 0x7F); }
+
+/* Group scanning, each returned bit corresponds to one slot of the group */
+
+#ifdef __SSE2__
+static inline uint32_t groupMatch(const uint8_t* ctrl, uint8_t h2) {
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+static inline uint32_t groupMatchEmpty(const uint8_t* ctrl) {
+    return groupMatch(ctrl, CTRL_EMPTY);
+}
+
+static inline uint32_t groupMatchEmptyOrDeleted(const uint8_t* ctrl) {
+    // both special values have the top bit set
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(group);
+}
+#else
+static inline uint32_t groupMatch(const uint8_t* ctrl, uint8_t h2) {
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < GROUP_WIDTH; i++) {
+        if (ctrl[i] == h2) mask |= (1u << i);
+    }
+    return mask;
+}
 
-static HashMapEntry_t* createHashMapEntry(const char* key, void* value); 
-static void cleanupHashMapEntry(HashMapEntry_t** entry, HashMapElemCleanupFn_t clenaupFn); 
-static uint64_t computeHash(const char* key); 
-static uint32_t getBucketIndex(HashMap_t* map, const char* key); 
-static void hashMapReinsertEntry(HashMap_t* map, HashMapEntry_t* entry); 
-static void hashMapResize(HashMap_t* map);  
-static uint32_t getResizeTriggerLimit(HashMap_t* map); 
+static inline uint32_t groupMatchEmpty(const uint8_t* ctrl) {
+    return groupMatch(ctrl, CTRL_EMPTY);
+}
+
+static inline uint32_t groupMatchEmptyOrDeleted(const uint8_t* ctrl) {
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < GROUP_WIDTH; i++) {
+        if (ctrl[i] & 0x80) mask |= (1u << i);
+    }
+    return mask;
+}
+#endif
+
+static inline uint32_t lowestBit(uint32_t mask) {
+    return (uint32_t)__builtin_ctz(mask);
+}
+
+/* Default key type: interned NUL terminated strings */
+
+// The pool is not synchronized, only the thread that evaluates (the one
+// that created it) may intern. GC marker and sweeper threads never insert
+// into string keyed maps, so they never reach it.
+static HashMap_t* internPool = NULL;
+static pthread_t internPoolOwner;
+
+static uint64_t stringKeyHash(const char* key) {
+    return hashString(key);
+}
+
+static bool stringKeyEquals(const char* a, const char* b) {
+    return a == b || strcmp(a, b) == 0;
+}
+
+static void* stringKeyIntern(const char* key) {
+    return (void*)internString(key);
+}
+
+static const HashMapKeyOps_t stringKeyOps = {
+    .hash = (HashMapKeyHashFn_t)stringKeyHash,
+    .equals = (HashMapKeyEqualsFn_t)stringKeyEquals,
+    .copy = (HashMapKeyCopyFn_t)stringKeyIntern,
+    .cleanup = NULL
+};
+
+// The pool itself borrows its keys, they are owned by the values.
+static const HashMapKeyOps_t internPoolKeyOps = {
+    .hash = (HashMapKeyHashFn_t)stringKeyHash,
+    .equals = (HashMapKeyEqualsFn_t)stringKeyEquals,
+    .copy = NULL,
+    .cleanup = NULL
+};
+
+// Returns the canonical copy of str, which lives for the whole program.
+const char* internString(const char* str) {
+    if (!internPool) {
+        internPool = createHashMapWithKeyOps(&internPoolKeyOps);
+        internPoolOwner = pthread_self();
+    }
+    assert(pthread_equal(internPoolOwner, pthread_self()));
+
+    const char* interned = hashMapGet(internPool, str);
+    if (!interned) {
+        char* copy = cloneString(str);
+        hashMapInsert(internPool, copy, copy);
+        interned = copy;
+    }
+    return interned;
+}
+
+void cleanupInternPool() {
+    // keys are borrowed from the values, freeing the values frees both
+    cleanupHashMap(&internPool, (HashMapElemCleanupFn_t)cleanupString);
+}
 
 /* External API */
 
 HashMap_t* createHashMap() {
+    return createHashMapWithKeyOps(&stringKeyOps);
+}
+
+HashMap_t* createHashMapWithKeyOps(const HashMapKeyOps_t* keyOps) {
     HashMap_t* map = mallocChk(sizeof(HashMap_t));
-    
     *map = (HashMap_t) {
-        .buckets = calloc(DEFAULT_NUM_BUCKETS, sizeof(HashMapEntry_t*)),
-        .numBuckets = DEFAULT_NUM_BUCKETS, 
-        .itemCnt = 0
+        .itemCnt = 0,
+        .oldCtrl = NULL,
+        .oldSlots = NULL,
+        .oldCapacity = 0,
+        .migrateIdx = 0,
+        .keyOps = keyOps
     };
-
+    hashMapAllocTable(map, DEFAULT_CAPACITY);
     return map;
 }
 
 HashMap_t* copyHashMap(const HashMap_t* map, HashMapElemCopyFn_t copyFn) {
     if (!map || !copyFn)
         return NULL;
-    HashMap_t* newMap = createHashMap();
+    HashMap_t* newMap = createHashMapWithKeyOps(map->keyOps);
 
     HashMapIter_t iter = createHashMapIter(map);
     HashMapEntry_t* entry = hashMapIterGetNext(map, &iter);
@@ -49,10 +181,17 @@ void cleanupHashMapElements(HashMap_t* map, HashMapElemCleanupFn_t cleanupFn) {
     HashMapIter_t iter = createHashMapIter(map);
     HashMapEntry_t* entry = hashMapIterGetNext(map, &iter);
     while (entry)  {
-        HashMapEntry_t* next = hashMapIterGetNext(map, &iter);
-        cleanupHashMapEntry(&entry, cleanupFn);
-        entry = next;
+        cleanupHashMapEntry(map, entry, cleanupFn);
+        entry = hashMapIterGetNext(map, &iter);
     }
+    memset(map->ctrl, CTRL_EMPTY, getCtrlSize(map->capacity));
+    map->itemCnt = 0;
+    map->growthLeft = getMaxLoad(map->capacity);
+
+    hashMapFreeTable(map->oldCtrl, map->oldSlots, map->oldCapacity);
+    map->oldCtrl = NULL;
+    map->oldSlots = NULL;
+    map->oldCapacity = 0;
 }
 
 
@@ -60,172 +199,203 @@ void cleanupHashMap(HashMap_t** map, HashMapElemCleanupFn_t cleanupFn) {
     if (!(*map)) return;
 
     cleanupHashMapElements(*map, cleanupFn);
-    free((*map)->buckets);
-    
+    hashMapFreeTable((*map)->ctrl, (*map)->slots, (*map)->capacity);
+
     free(*map);
     *map = NULL;
 }
 
 HashMapIter_t createHashMapIter(const HashMap_t* map)  {
-    for (int32_t i = 0; i < map->numBuckets; i++) {
-        if (map->buckets[i]) {
-            return (HashMapIter_t) {
-                .curBucket = i,
-                .curElem = map->buckets[i]
-            };
-        }
-    }
-    return (HashMapIter_t) {.curElem=NULL};
+    return (HashMapIter_t) {.index = 0};
 }
 
 HashMapEntry_t* hashMapIterGetNext(const HashMap_t* map, HashMapIter_t* iter) {
-    if (!iter || !iter->curElem) return NULL;
-    
-    HashMapEntry_t* ret = iter->curElem;
-    if (iter->curElem->next){
-        iter->curElem = iter->curElem->next;
-        return ret; 
-    }
-        
-    // seek starting at next bucket 
-    iter->curElem = NULL;
-    iter->curBucket++; 
-    while (iter->curBucket < map->numBuckets) {
-        if (map->buckets[iter->curBucket]) {
-            iter->curElem = map->buckets[iter->curBucket];
-            return ret;
-        }
-        iter->curBucket++;
+    if (!iter) return NULL;
+
+    while (iter->index < map->capacity) {
+        uint32_t index = iter->index++;
+        if (!(map->ctrl[index] & 0x80))
+            return &map->slots[index];
     }
 
-    return ret;
+    // items not yet migrated, moved ones are marked DELETED
+    while (map->oldCtrl && iter->index < map->capacity + map->oldCapacity) {
+        uint32_t index = (iter->index++) - map->capacity;
+        if (!(map->oldCtrl[index] & 0x80))
+            return &map->oldSlots[index];
+    }
+    return NULL;
 }
 
 
+void* hashMapInsert(HashMap_t* map, const void* key, void* value) {
+    hashMapMigrate(map, MIGRATE_SLOTS_PER_OP);
+    uint64_t hash = map->keyOps->hash(key);
 
-void* hashMapInsert(HashMap_t* map, const char* key, void* value) {  
-    uint32_t index = getBucketIndex(map, key);
-    void* ret = NULL; // holds previous value in case of key collision.
-    if (!map->buckets[index]){
-        map->buckets[index] = createHashMapEntry(key, value);
-        map->itemCnt++;
-    } else {
-        HashMapEntry_t* cur = map->buckets[index];
-        bool found = false;
-        while (!(found = (strcmp(cur->key, key) == 0)) && cur->next) {
-            cur = cur->next;
-        }
-        if (!found) {
-            cur->next = createHashMapEntry(key, value);
-            map->itemCnt++;
-        } else {
-            ret = cur->value;
-            cur->value = value;
-        }
+    HashMapEntry_t* entry = hashMapFindEntry(map, key, hash);
+    if (entry) {
+        // holds previous value in case of key collision.
+        void* ret = entry->value;
+        entry->value = value;
+        // borrowed keys usually live inside the value, follow the new one
+        if (!map->keyOps->copy)
+            entry->key = (void*)key;
+        return ret; 
+    }
+
+    if (map->growthLeft == 0) {
+        // previous resize must be done before starting a new one
+        hashMapMigrate(map, map->oldCapacity);
+        hashMapStartResize(map);
+        hashMapMigrate(map, MIGRATE_SLOTS_PER_OP);
     }
 
-    hashMapResize(map);
-    return ret;
+    void* ownKey = map->keyOps->copy ? map->keyOps->copy(key) : (void*)key;
+    hashMapPlaceEntry(map, ownKey, hash, value);
+    map->itemCnt++;
+    return NULL;
 }
 
-void* hashMapGet(HashMap_t* map, const char* key) {
-    uint32_t index = getBucketIndex(map, key);
-    HashMapEntry_t* cur = map->buckets[index];
+// Read only, migration is left to inserts so that lookups never move
+// entries under a running iterator.
+void* hashMapGet(const HashMap_t* map, const void* key) {
+    HashMapEntry_t* entry = hashMapFindEntry(map, key, map->keyOps->hash(key));
+    return entry ? entry->value : NULL;
+}
 
-    while (cur) {
-        if (strcmp(cur->key, key) == 0)
-            return cur->value;
-        cur = cur->next;
-    }
+static HashMapEntry_t* hashMapFindEntry(const HashMap_t* map, const void* key, uint64_t hash) {
+    int64_t index = findSlot(map->ctrl, map->slots, map->capacity, map->keyOps, key, hash);
+    if (index >= 0)
+        return &map->slots[index];
 
+    if (map->oldCtrl) {
+        index = findSlot(map->oldCtrl, map->oldSlots, map->oldCapacity, map->keyOps, key, hash);
+        if (index >= 0)
+            return &map->oldSlots[index];
+    }
     return NULL;
 }
 
-static void hashMapResize(HashMap_t* map)  {
-    if (map->itemCnt < getResizeTriggerLimit(map)) {
-        return;
-    }
-    
-    uint32_t prevSize = map->numBuckets;
-    HashMapEntry_t** prevBuckets = map->buckets;
-
-    map->numBuckets = map->numBuckets * 2;  
-    map->buckets = (HashMapEntry_t**) calloc(map->numBuckets, sizeof(HashMapEntry_t*));
-    if (!map->buckets) HANDLE_OOM();
-
-    for(uint32_t i = 0; i < prevSize; i++) {
-        HashMapEntry_t* entry = prevBuckets[i];
-        while (entry) {
-            HashMapEntry_t* next = entry->next;
-            entry->next = NULL;
-            hashMapReinsertEntry(map, entry);
-            entry = next;
+static int64_t findSlot(const uint8_t* ctrl, const HashMapEntry_t* slots, uint32_t capacity,
+                        const HashMapKeyOps_t* keyOps, const void* key, uint64_t hash) {
+    uint32_t groupMask = (getCtrlSize(capacity) / GROUP_WIDTH) - 1;
+    uint32_t group = (uint32_t)hashH1(hash) & groupMask;
+    uint8_t h2 = hashH2(hash);
+
+    // triangular probing visits every group once
+    for (uint32_t step = 1; step <= groupMask + 1; step++) {
+        const uint8_t* groupCtrl = &ctrl[group * GROUP_WIDTH];
+
+        uint32_t match = groupMatch(groupCtrl, h2);
+        while (match) {
+            uint32_t index = group * GROUP_WIDTH + lowestBit(match);
+            const HashMapEntry_t* entry = &slots[index];
+            if (entry->hash == hash && keyOps->equals(entry->key, key))
+                return index;
+            match &= match - 1;
         }
-    }
 
-    free(prevBuckets);
+        // an empty slot ends the probe sequence
+        if (groupMatchEmpty(groupCtrl))
+            return -1;
+
+        group = (group + step) & groupMask;
+    }
+    return -1;
 }
 
-static void hashMapReinsertEntry(HashMap_t* map, HashMapEntry_t* entry) {
-    uint32_t index = getBucketIndex(map, entry->key);
-    
-    if (!map->buckets[index]){
-        map->buckets[index] = entry;
-    } else {
-        HashMapEntry_t* cur = map->buckets[index];
-        while (cur->next) {
-            cur = cur->next;
-        }
-        cur->next = entry;
+static uint32_t findFreeSlot(const uint8_t* ctrl, uint32_t capacity, uint64_t hash) {
+    uint32_t groupMask = (getCtrlSize(capacity) / GROUP_WIDTH) - 1;
+    uint32_t group = (uint32_t)hashH1(hash) & groupMask;
+    uint32_t validMask = (capacity < GROUP_WIDTH) ? (1u << capacity) - 1 : 0xFFFFu;
+
+    for (uint32_t step = 1; ; step++) {
+        uint32_t match = groupMatchEmptyOrDeleted(&ctrl[group * GROUP_WIDTH]) & validMask;
+        if (match)
+            return group * GROUP_WIDTH + lowestBit(match);
+        group = (group + step) & groupMask;
     }
 }
 
+// Stores an entry known to be absent in the current table.
+static void hashMapPlaceEntry(HashMap_t* map, void* key, uint64_t hash, void* value) {
+    uint32_t index = findFreeSlot(map->ctrl, map->capacity, hash);
+    if (map->ctrl[index] == CTRL_EMPTY)
+        map->growthLeft--;
+    map->ctrl[index] = hashH2(hash);
+    map->slots[index] = (HashMapEntry_t) {
+        .key = key,
+        .value = value,
+        .hash = hash
+    };
+}
 
-static uint32_t getResizeTriggerLimit(HashMap_t* map) {
-    return ((3 * map->numBuckets) / 4); 
+// Tables are buffers, environment maps count against the heap size.
+static void hashMapAllocTable(HashMap_t* map, uint32_t capacity) {
+    map->ctrl = mallocBuffer(getCtrlSize(capacity));
+    map->slots = mallocBuffer(capacity * sizeof(HashMapEntry_t));
+    memset(map->ctrl, CTRL_EMPTY, getCtrlSize(capacity));
+    map->capacity = capacity;
+    map->growthLeft = getMaxLoad(capacity);
 }
 
-static uint32_t getBucketIndex(HashMap_t* map, const char* key) {
-    uint64_t hash = computeHash(key);
-    return (uint32_t)(hash & (uint64_t)(map->numBuckets - 1)); 
+static void hashMapFreeTable(uint8_t* ctrl, HashMapEntry_t* slots, uint32_t capacity) {
+    if (!ctrl) 
+        return;
+    freeBuffer(ctrl, getCtrlSize(capacity));
+    freeBuffer(slots, capacity * sizeof(HashMapEntry_t));
 }
 
-#define FNV_OFFSET 14695981039346656037UL
-#define FNV_PRIME 1099511628211UL
+static void hashMapStartResize(HashMap_t* map)  {
+    map->oldCtrl = map->ctrl;
+    map->oldSlots = map->slots;
+    map->oldCapacity = map->capacity;
+    map->migrateIdx = 0;
 
-// https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function
-static uint64_t computeHash(const char* key) {
-    uint64_t hash = FNV_OFFSET;
-    while(*key) {
-        hash ^= (uint64_t)(unsigned char)(*key);
-        hash *= FNV_PRIME;
-        key++;
-    }
-    return hash;
+    hashMapAllocTable(map, map->capacity * 2);
 }
 
-static HashMapEntry_t* createHashMapEntry(const char* key, void* value) {
-    HashMapEntry_t* entry = (HashMapEntry_t*)malloc(sizeof(HashMapEntry_t));
-    if (!entry) HANDLE_OOM();
-     
-    *entry = (HashMapEntry_t) {
-        .key = cloneString(key),
-        .value = value,
-        .next = NULL
-    };
+static void hashMapMigrate(HashMap_t* map, uint32_t slotCnt) {
+    if (!map->oldCtrl)
+        return;
 
-    return entry;
+    uint32_t end = map->migrateIdx + slotCnt;
+    if (end > map->oldCapacity)
+        end = map->oldCapacity;
+
+    // cached hashes, keys are known to be unique so no compares are needed
+    for (uint32_t i = map->migrateIdx; i < end; i++) {
+        if (map->oldCtrl[i] & 0x80)
+            continue;
+        HashMapEntry_t* entry = &map->oldSlots[i];
+        hashMapPlaceEntry(map, entry->key, entry->hash, entry->value);
+        // tombstone keeps probe sequences of the remaining items intact
+        map->oldCtrl[i] = CTRL_DELETED;
+    }
+    map->migrateIdx = end;
+
+    if (map->migrateIdx == map->oldCapacity) {
+        hashMapFreeTable(map->oldCtrl, map->oldSlots, map->oldCapacity);
+        map->oldCtrl = NULL;
+        map->oldSlots = NULL;
+        map->oldCapacity = 0;
+    }
 }
 
+static uint32_t getMaxLoad(uint32_t capacity) {
+    // a single group is always scanned in full, so it can be filled up
+    if (capacity < GROUP_WIDTH)
+        return capacity;
+    return capacity - capacity / 8;
+}
 
-static void cleanupHashMapEntry(HashMapEntry_t** entry, HashMapElemCleanupFn_t cleanupFn) {
-    if (!(*entry))
-        return;
-        
-    free((*entry)->key);
+static uint32_t getCtrlSize(uint32_t capacity) {
+    return (capacity < GROUP_WIDTH) ? GROUP_WIDTH : capacity;
+}
+
+static void cleanupHashMapEntry(HashMap_t* map, HashMapEntry_t* entry, HashMapElemCleanupFn_t cleanupFn) {
+    if (map->keyOps->cleanup)
+        map->keyOps->cleanup(&entry->key);
     if (cleanupFn)
-        cleanupFn(&(*entry)->value);
-    
-    free(*entry);
-    *entry = NULL;
+        cleanupFn(&entry->value);
 }
\ No newline at end of file
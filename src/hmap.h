@@ -3,28 +3,59 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 
+typedef uint64_t (*HashMapKeyHashFn_t) (const void* key);
+typedef bool (*HashMapKeyEqualsFn_t) (const void* a, const void* b);
+typedef void* (*HashMapKeyCopyFn_t) (const void* key);
+typedef void (*HashMapKeyCleanupFn_t) (void** key);
+
+// Describes how keys are hashed, compared and owned by the map.
+// If copy is NULL the map only borrows the key pointer.
+typedef struct HashMapKeyOps {
+    HashMapKeyHashFn_t hash;
+    HashMapKeyEqualsFn_t equals;
+    HashMapKeyCopyFn_t copy;
+    HashMapKeyCleanupFn_t cleanup;
+} HashMapKeyOps_t;
+
+// Slots are stored inline in the table, no per entry allocation.
 typedef struct HashMapEntry {
-    char* key; // local ownership 
+    void* key; // local ownership (unless borrowed)
     void* value; // local ownership 
-    struct HashMapEntry* next; 
+    uint64_t hash; // cached key hash
 } HashMapEntry_t;
 
+// Open addressing map (swiss table layout). Every slot has a control
+// byte holding either EMPTY, DELETED or the low 7 bits of the hash,
+// control bytes are scanned one 16 slot group at a time.
+// Growing is incremental: the previous table is kept around and a few
+// of its groups are moved over on every insert. Lookups and iteration
+// never move entries.
 typedef struct HashMap {
-    HashMapEntry_t** buckets;
-    uint32_t numBuckets;
-    uint32_t itemCnt;
+    uint8_t* ctrl;
+    HashMapEntry_t* slots;
+    uint32_t capacity; // power of two
+    uint32_t itemCnt; // items in both tables
+    uint32_t growthLeft; // inserts left before a resize is needed
+
+    uint8_t* oldCtrl; // NULL unless a resize is in progress
+    HashMapEntry_t* oldSlots;
+    uint32_t oldCapacity;
+    uint32_t migrateIdx; // first old slot not yet moved
+
+    const HashMapKeyOps_t* keyOps;
 } HashMap_t;
 
 typedef struct HashMapIter {
-    uint32_t curBucket; 
-    HashMapEntry_t* curElem; 
+    uint32_t index; // runs over the new table, then the old one
 } HashMapIter_t;
 
 typedef void (*HashMapElemCleanupFn_t) (void** elem);
 typedef void* (*HashMapElemCopyFn_t) (const void* elem);
 
 HashMap_t* createHashMap();
+HashMap_t* createHashMapWithKeyOps(const HashMapKeyOps_t* keyOps);
 HashMap_t* copyHashMap(const HashMap_t* map, HashMapElemCopyFn_t copyFn);
 void cleanupHashMapElements(HashMap_t* map, HashMapElemCleanupFn_t cleanupFn);
 void cleanupHashMap(HashMap_t** map, HashMapElemCleanupFn_t cleanupFn);
@@ -32,7 +63,11 @@ void cleanupHashMap(HashMap_t** map, HashMapElemCleanupFn_t cleanupFn);
 HashMapIter_t createHashMapIter(const HashMap_t* map);
 HashMapEntry_t* hashMapIterGetNext(const HashMap_t* map, HashMapIter_t* iter);
 
-void* hashMapInsert(HashMap_t* map, const char* key , void* value);
-void* hashMapGet(HashMap_t* map, const char* key);
+void* hashMapInsert(HashMap_t* map, const void* key , void* value);
+void* hashMapGet(const HashMap_t* map, const void* key);
+
+const char* internString(const char* str);
+// Frees every interned string, only at shutdown once no map uses them.
+void cleanupInternPool();
 
 #endif 
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include "token.h"
 #include "utils.h"
 
+static Token_t* lexerCreateToken(Lexer_t* lexer, TokenType_t type, const char* start, uint32_t len);
 static void lexerReadChar(Lexer_t* lexer);
 static char lexerPeekChar(Lexer_t* lexer);
 static void lexerReadIdentifier(Lexer_t* lexer, uint32_t* len);
@@ -27,10 +28,15 @@ Lexer_t* createLexer(const char* input)
 
     Lexer_t* lexer = mallocChk(sizeof(Lexer_t));
     
-    lexer->input = input;
     lexer->position = 0;
     lexer->readPosition = 0;
-    lexer->inputLength = strlen(lexer->input);
+    lexer->inputLength = strlen(input);
+    lexer->ch = '\0';
+    lexer->line = 1u;
+    lexer->lineStart = 0;
+    lexer->arena = createArena();
+    // tokens point into the input, keep it alive as long as they are
+    lexer->input = arenaCloneSubstring(lexer->arena, input, lexer->inputLength);
 
     lexerReadChar(lexer);
     return lexer;
@@ -41,6 +47,7 @@ void cleanupLexer(Lexer_t** lexer)
     if (!(*lexer))
         return;
         
+    cleanupArena(&(*lexer)->arena);
     free(*lexer);
     *lexer = NULL;
 }
@@ -53,96 +60,99 @@ Token_t* lexerNextToken(Lexer_t* lexer) {
 
     lexerSkipWhiteSpace(lexer);
     tokStart = &lexer->input[lexer->position]; 
+    lexer->tokLine = lexer->line;
+    lexer->tokCol = lexer->position - lexer->lineStart + 1;
 
     switch(lexer->ch) {
         case '=': 
             if (lexerPeekChar(lexer) == '=') {
                 lexerReadChar(lexer); // consume next char 
-                tok = createToken(TOKEN_EQ, tokStart, 2u);
+                tok = lexerCreateToken(lexer, TOKEN_EQ, tokStart, 2u);
             }
             else {
-                tok = createToken(TOKEN_ASSIGN, tokStart, 1u);
+                tok = lexerCreateToken(lexer, TOKEN_ASSIGN, tokStart, 1u);
             }
             break;
         case '+':
-            tok = createToken(TOKEN_PLUS, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_PLUS, tokStart, 1u);
             break;
         case '-': 
-            tok = createToken(TOKEN_MINUS, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_MINUS, tokStart, 1u);
             break;
         case '!': 
             if (lexerPeekChar(lexer) == '=') {
                 lexerReadChar(lexer);
-                tok = createToken(TOKEN_NOT_EQ, tokStart, 2u);
+                tok = lexerCreateToken(lexer, TOKEN_NOT_EQ, tokStart, 2u);
             }
             else {
-                tok = createToken(TOKEN_BANG, tokStart, 1u);
+                tok = lexerCreateToken(lexer, TOKEN_BANG, tokStart, 1u);
             }
             break;
         case '*': 
-            tok = createToken(TOKEN_ASTERISK, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_ASTERISK, tokStart, 1u);
             break;
         case '/': 
-            tok = createToken(TOKEN_SLASH, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_SLASH, tokStart, 1u);
             break;
         case '<': 
-            tok = createToken(TOKEN_LT, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_LT, tokStart, 1u);
             break;
         case '>': 
-            tok = createToken(TOKEN_GT, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_GT, tokStart, 1u);
             break;
         case ',': 
-            tok = createToken(TOKEN_COMMA, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_COMMA, tokStart, 1u);
             break;
         case ';':
-            tok = createToken(TOKEN_SEMICOLON, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_SEMICOLON, tokStart, 1u);
             break;
         case '(':
-            tok = createToken(TOKEN_LPAREN, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_LPAREN, tokStart, 1u);
             break;
         case ')':
-            tok = createToken(TOKEN_RPAREN, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_RPAREN, tokStart, 1u);
             break;
         case '{':
-            tok = createToken(TOKEN_LBRACE, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_LBRACE, tokStart, 1u);
             break;
         case '}':
-            tok = createToken(TOKEN_RBRACE, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_RBRACE, tokStart, 1u);
             break;
         case '[':
-            tok = createToken(TOKEN_LBRACKET, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_LBRACKET, tokStart, 1u);
             break;
         case ']':
-            tok = createToken(TOKEN_RBRACKET, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_RBRACKET, tokStart, 1u);
             break;
         case '\0':
-            tok = createToken(TOKEN_EOF, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_EOF, tokStart, 0u);
             break;  
         case ':': 
-            tok = createToken(TOKEN_COLON, tokStart, 1u);
+            tok = lexerCreateToken(lexer, TOKEN_COLON, tokStart, 1u);
             break;
         case '"':
             // now sitting on '"', skip it
             lexerReadChar(lexer);
             tokStart++;
+            lexer->tokCol++;
             
             lexerReadString(lexer, &tokLen);
             if (lexer->ch != '"')
-                tok = createToken(TOKEN_ILLEGAL, tokStart, tokLen);
+                tok = lexerCreateToken(lexer, TOKEN_ILLEGAL, tokStart, tokLen);
             else 
-                tok = createToken(TOKEN_STRING, tokStart, tokLen);
+                tok = lexerCreateToken(lexer, TOKEN_STRING, tokStart, tokLen);
             break;
         default: 
             if (isLetter(lexer->ch)) {
                 lexerReadIdentifier(lexer, &tokLen);
-                tok = createToken(lookupIdent(tokStart, tokLen), tokStart, tokLen);
+                tok = lexerCreateToken(lexer, lookupIdent(tokStart, tokLen), tokStart, tokLen);
                 return tok;
             } else if(isDigit(lexer->ch)) {
                 lexerReadDigit(lexer, &tokLen);
-                tok = createToken(TOKEN_INT, tokStart, tokLen);
+                tok = lexerCreateToken(lexer, TOKEN_INT, tokStart, tokLen);
                 return tok;
             } else { 
-                tok = createToken(TOKEN_ILLEGAL, tokStart, tokLen);
+                tok = lexerCreateToken(lexer, TOKEN_ILLEGAL, tokStart, tokLen);
             }
 
     }
@@ -151,7 +161,17 @@ Token_t* lexerNextToken(Lexer_t* lexer) {
     return tok;
 }
 
+static Token_t* lexerCreateToken(Lexer_t* lexer, TokenType_t type, const char* start, uint32_t len) {
+    return createToken(lexer->arena, type, lexer->input, start - lexer->input, len, 
+                       lexer->tokLine, lexer->tokCol);
+}
+
 static void lexerReadChar(Lexer_t* lexer) {
+    if (lexer->ch == '\n') {
+        lexer->line++;
+        lexer->lineStart = lexer->readPosition;
+    }
+
     if (lexer->readPosition >= lexer->inputLength)
         lexer->ch = '\0'; // Empty string return NULL character 
     else 
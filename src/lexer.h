@@ -10,6 +10,10 @@ typedef struct Lexer {
     int32_t position; // current position in input (points to current char)
     int32_t readPosition; // current reading position in input (affter current char)
     char ch; // curernt char under examination 
+    uint32_t line; // line of the current char
+    int32_t lineStart; // position of the first char of that line
+    uint32_t tokLine, tokCol; // where the token being scanned starts
+    Arena_t* arena; // tokens, the parser puts the AST next to them
 } Lexer_t;
 
 // Relevant API 
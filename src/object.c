@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "object.h"
@@ -94,12 +95,49 @@ bool objectIsHashable(Object_t* obj) {
     }
 }
 
-char* objectGetHashKey(Object_t* obj) {
-   return objectIsHashable(obj) ? objectInspect(obj) : NULL;
+HashKey_t objectGetHashKey(Object_t* obj) {
+    HashKey_t key = {.type = obj->type};
+    switch(obj->type) {
+        case OBJECT_INTEGER:
+            key.integer = ((Integer_t*)obj)->value;
+            key.hash = hashInteger((uint64_t)key.integer);
+            break;
+        case OBJECT_BOOLEAN:
+            key.boolean = ((Boolean_t*)obj)->value;
+            key.hash = hashInteger((uint64_t)key.boolean);
+            break;
+        case OBJECT_STRING:
+            key.string = ((String_t*)obj)->value;
+            key.hash = hashString(key.string);
+            break;
+        default:
+            assert(!"objectGetHashKey called on unhashable object");
+    }
+    // keep equal payloads of different types apart
+    key.hash ^= (uint64_t)key.type * 0x9e3779b97f4a7c15UL;
+    return key;
+}
+
+bool hashKeyEquals(const HashKey_t* a, const HashKey_t* b) {
+    if (a->type != b->type || a->hash != b->hash)
+        return false;
+
+    switch(a->type) {
+        case OBJECT_INTEGER:
+            return a->integer == b->integer;
+        case OBJECT_BOOLEAN:
+            return a->boolean == b->boolean;
+        case OBJECT_STRING:
+            return strcmp(a->string, b->string) == 0;
+        default:
+            return false;
+    }
 }
 
 void gcCleanupObject(Object_t** obj);
-void gcMarkObject(Object_t* obj);
+void gcTraceObject(Object_t* obj, GCSlotVisitorFn_t visit);
+bool gcIsRefCountedObject(Object_t* obj);
+size_t gcObjectOwnedBytes(Object_t* obj);
 
 
 /************************************ 
@@ -131,7 +169,7 @@ void gcCleanupInteger(Integer_t** obj) {
     *obj = NULL; 
 }
 
-void gcMarkInteger(Integer_t* obj) {
+void gcTraceInteger(Integer_t* obj, GCSlotVisitorFn_t visit) {
     // no objects owned by gc
 }
 
@@ -163,7 +201,7 @@ void gcCleanupBoolean(Boolean_t** obj) {
     *obj = NULL; 
 }
 
-void gcMarkBoolean(Boolean_t* obj) {
+void gcTraceBoolean(Boolean_t* obj, GCSlotVisitorFn_t visit) {
     // no objects owned by gc
 }
 
@@ -174,9 +212,10 @@ void gcMarkBoolean(Boolean_t* obj) {
 
 String_t* createString(const char* value) {
     String_t* ret = gcMalloc(sizeof(String_t), GC_DATA_OBJECT);
+    size_t size = strlen(value) + 1;
     *ret = (String_t) {
         .type = OBJECT_STRING,
-        .value = cloneString(value)
+        .value = memcpy(mallocBuffer(size), value, size)
     };
     return ret;
 }
@@ -191,12 +230,12 @@ char* stringInspect(String_t* obj) {
 
 void gcCleanupString(String_t** obj) {
     if (!(*obj)) return;
-    free((*obj)->value);
+    freeBuffer((*obj)->value, strlen((*obj)->value) + 1);
     gcFree(*obj);
     *obj = NULL; 
 }
 
-void gcMarkString(Boolean_t* obj) {
+void gcTraceString(String_t* obj, GCSlotVisitorFn_t visit) {
     // no objects owned by gc
 }
 /************************************ 
@@ -223,7 +262,7 @@ void gcCleanupNull(Null_t** obj) {
     *obj = NULL;    
 }
 
-void gcMarkNull(Null_t* obj) {
+void gcTraceNull(Null_t* obj, GCSlotVisitorFn_t visit) {
     // no objects owned by gc
 }
 /************************************ 
@@ -255,11 +294,8 @@ void gcCleanupReturnValue(ReturnValue_t** obj) {
     *obj = NULL;    
 }
 
-void gcMarkReturnValue(ReturnValue_t* obj) {
-    if (!gcMarkedAsUsed(obj->value)) {
-        gcMarkUsed(obj->value);
-        gcMarkObject(obj->value);
-    }
+void gcTraceReturnValue(ReturnValue_t* obj, GCSlotVisitorFn_t visit) {
+    visit((void**)&obj->value);
 }
 
 /************************************ 
@@ -293,7 +329,7 @@ void gcCleanupError(Error_t** err) {
     *err = NULL;
 }
 
-void gcMarkError(Error_t* err) {
+void gcTraceError(Error_t* err, GCSlotVisitorFn_t visit) {
     // no objects owned by gc
 }
 
@@ -302,12 +338,13 @@ void gcMarkError(Error_t* err) {
  *    FUNCTION OBJECT TYPE          *
  ************************************/
 
-Function_t* createFunction(Vector_t* params, BlockStatement_t* body, Environment_t* env) {
-    Function_t* func = gcMalloc(sizeof(Function_t), GC_DATA_OBJECT);
+Function_t* createFunction(const FunctionLiteral_t* literal, Environment_t* env) {
+    // functions are long lived and referenced by frames, skip the nursery
+    Function_t* func = gcMallocTenured(sizeof(Function_t), GC_DATA_OBJECT);
     *func = (Function_t) {
         .type = OBJECT_FUNCTION,
-        .parameters = copyVector(params, (VectorElemCopyFn_t) copyExpression),
-        .body = copyBlockStatement(body),
+        .literal = literal, // shared, the arena keeps it alive
+        .ast = arenaRetain(literal->arena),
         .environment = env, // weak copy to env
     };
 
@@ -318,33 +355,27 @@ void gcCleanupFunction(Function_t** obj) {
     if(!(*obj)) 
         return;
 
-    // full clean because these are owned by object & not by GC 
-    cleanupVector(&(*obj)->parameters, (VectorElemCleanupFn_t)cleanupExpression);
-    cleanupBlockStatement(&(*obj)->body);
+    // the literal and its analysis are shared, drop our hold on them
+    cleanupArena(&(*obj)->ast);
     
     gcFree(*obj);
     *obj = NULL;
 }
 
-extern void gcMarkEnvironment(Environment_t*env);
-
-void gcMarkFunction(Function_t* obj) { 
-    if (!gcMarkedAsUsed(obj->environment)) {
-        gcMarkUsed(obj->environment);
-        gcMarkEnvironment(obj->environment);
-    }
+void gcTraceFunction(Function_t* obj, GCSlotVisitorFn_t visit) { 
+    visit((void**)&obj->environment);
 }
 
 Function_t* copyFunction(Function_t* obj) {
-    return createFunction(obj->parameters, obj->body, obj->environment);
+    return createFunction(obj->literal, obj->environment);
 }
 
 char* functionInspect(Function_t* obj) {
     Strbuf_t* sbuf = createStrbuf();
     strbufWrite(sbuf, "fn(");
     
-    uint32_t cnt = vectorGetCount(obj->parameters);
-    Identifier_t** params = (Identifier_t**)vectorGetBuffer(obj->parameters);
+    uint32_t cnt = functionGetParameterCount(obj);
+    Identifier_t** params = functionGetParameters(obj);
     for (uint32_t i = 0; i < cnt; i++) {
         strbufConsume(sbuf, identifierToString(params[i]));
         if (i !=  (cnt - 1))
@@ -352,18 +383,18 @@ char* functionInspect(Function_t* obj) {
     }
     
     strbufWrite(sbuf, ") {\n");
-    strbufConsume(sbuf, blockStatementToString(obj->body));
+    strbufConsume(sbuf, blockStatementToString(obj->literal->body));
     strbufWrite(sbuf, "\n}");
 
     return detachStrbuf(&sbuf);
 }
 
 uint32_t functionGetParameterCount(Function_t* obj) {
-    return vectorGetCount(obj->parameters);
+    return functionLiteralGetParameterCount(obj->literal);
 }
 
 Identifier_t** functionGetParameters(Function_t* obj) {
-    return (Identifier_t**)vectorGetBuffer(obj->parameters);
+    return functionLiteralGetParameters(obj->literal);
 }
 
 /************************************ 
@@ -411,6 +442,7 @@ Object_t** arrayGetElements(Array_t* obj) {
 
 void arrayAppend(Array_t* arr, Object_t* obj) {
     vectorAppend(arr->elements, (void*) obj);
+    gcWriteBarrier(arr, obj);
 }
 
 void gcCleanupArray(Array_t** arr) {
@@ -420,14 +452,11 @@ void gcCleanupArray(Array_t** arr) {
     *arr = NULL;
 }
 
-void gcMarkArray(Array_t* arr) {
+void gcTraceArray(Array_t* arr, GCSlotVisitorFn_t visit) {
     uint32_t cnt = arrayGetElementCount(arr);
     Object_t** elems = arrayGetElements(arr);
     for (uint32_t i = 0; i < cnt; i++) {
-        if (!gcMarkedAsUsed(elems[i])) {
-            gcMarkUsed(elems[i]);
-            gcMarkObject(elems[i]);
-        }
+        visit((void**)&elems[i]);
     } 
 }
 
@@ -435,36 +464,67 @@ void gcMarkArray(Array_t* arr) {
  *        HASH OBJECT TYPE          *
  ************************************/
 
-HashPair_t* createHashPair(Object_t* key, Object_t* value) {
-    HashPair_t* pair = mallocChk(sizeof(HashPair_t));
-    *pair = (HashPair_t) {
-        .key = key,
-        .value = value
-    };
-    return pair;
-}
+// Index table sizes are powers of two and kept at most 2/3 full.
+#define HASH_MIN_INDEX_SIZE 8
+#define HASH_INDEX_EMPTY -1
+
+// Array part sizes are powers of two, keys above the limit always
+// stay in the hash part.
+#define HASH_MIN_ARRAY_SIZE 4
+#define HASH_MAX_ARRAY_BITS 26
 
-void cleanupHashPair(HashPair_t** pair) {
-    if (!(*pair)) return;
-    free(*pair);
-    *pair = NULL;
+static void hashAppendPair(Hash_t* obj, const HashKey_t* hashKey, Object_t* key, Object_t* value, uint32_t seq);
+static void hashBuildIndex(Hash_t* obj, uint32_t indexSize);
+static int32_t* hashFindIndexSlot(const Hash_t* obj, const HashKey_t* key);
+static void hashRehash(Hash_t* obj);
+static void hashResizeArray(Hash_t* obj, uint32_t arraySize);
+static uint32_t hashComputeArraySize(const Hash_t* obj);
+
+// Entry of either part, used to walk a hash in insertion order.
+typedef struct HashEntry {
+    uint32_t seq;
+    uint32_t arrayKey; // key of array part entries
+    HashPair_t* pair; // NULL for array part entries
+} HashEntry_t;
+
+static HashEntry_t* hashGetOrderedEntries(Hash_t* obj);
+
+static inline bool isArrayKey(const HashKey_t* key) {
+    return key->type == OBJECT_INTEGER && key->integer >= 0 && 
+           key->integer < (1L << HASH_MAX_ARRAY_BITS);
 }
 
 Hash_t* createHash() {
     Hash_t* hash = gcMalloc(sizeof(Hash_t), GC_DATA_OBJECT);
     *hash = (Hash_t) {
         .type = OBJECT_HASH,
-        .pairs = createHashMap()
+        .array = NULL,
+        .arraySeq = NULL,
+        .arraySize = 0,
+        .arrayCnt = 0,
+        .nextSeq = 0,
+        .pairs = NULL,
+        .pairCnt = 0,
+        .pairCap = 0,
+        .index = NULL,
+        .indexSize = 0
     };
     return hash;
 }
 
 Hash_t* copyHash(Hash_t* obj) {
-    Hash_t* newHash = gcMalloc(sizeof(Hash_t), GC_DATA_OBJECT);
-    *newHash = (Hash_t) {
-        .type = OBJECT_HASH,
-        .pairs = copyHashMap(obj->pairs, (HashMapElemCopyFn_t) copyObject)
-    };
+    Hash_t* newHash = createHash();
+    uint32_t cnt = hashGetPairCount(obj);
+    HashEntry_t* entries = hashGetOrderedEntries(obj);
+    for (uint32_t i = 0; i < cnt; i++) {
+        HashPair_t* pair = entries[i].pair;
+        if (pair) 
+            hashInsertPair(newHash, copyObject(pair->key), copyObject(pair->value));
+        else 
+            hashInsertPair(newHash, (Object_t*)createInteger(entries[i].arrayKey), 
+                           copyObject(obj->array[entries[i].arrayKey]));
+    }
+    free(entries);
     return newHash;
 }
 
@@ -472,58 +532,275 @@ char* hashInspect(Hash_t* obj) {
     Strbuf_t* sbuf = createStrbuf();
     strbufWrite(sbuf, "{");
     
-    HashMapIter_t iter = createHashMapIter(obj->pairs);
-    HashMapEntry_t* entry = hashMapIterGetNext(obj->pairs, &iter);
-    while(entry) {
-        HashPair_t* pair = (HashPair_t*)entry->value; 
-        strbufConsume(sbuf, objectInspect(pair->key));
-        strbufWrite(sbuf, ":");
-        strbufConsume(sbuf, objectInspect(pair->value));
-
-        entry = hashMapIterGetNext(obj->pairs, &iter);
-        if (entry)
+    uint32_t cnt = hashGetPairCount(obj);
+    HashEntry_t* entries = hashGetOrderedEntries(obj);
+    for (uint32_t i = 0; i < cnt; i++) {
+        HashPair_t* pair = entries[i].pair;
+        if (pair) {
+            strbufConsume(sbuf, objectInspect(pair->key));
+            strbufWrite(sbuf, ":");
+            strbufConsume(sbuf, objectInspect(pair->value));
+        } else {
+            strbufConsume(sbuf, strFormat("%u:", entries[i].arrayKey));
+            strbufConsume(sbuf, objectInspect(obj->array[entries[i].arrayKey]));
+        }
+
+        if (i + 1 < cnt)
             strbufWrite(sbuf, ", ");
     }
+    free(entries);
 
     strbufWrite(sbuf, "}");
     return detachStrbuf(&sbuf);
 }
 
-void hashInsertPair(Hash_t* obj, HashPair_t* pair) {
-    char* hashKey = objectGetHashKey(pair->key);
-    hashMapInsert(obj->pairs, hashKey, pair);
-    free(hashKey);
+void hashInsertPair(Hash_t* obj, Object_t* key, Object_t* value) {
+    // the array part only stores the value, key gets its barrier where it is stored
+    gcWriteBarrier(obj, value);
+    HashKey_t hashKey = objectGetHashKey(key);
+
+    if (isArrayKey(&hashKey)) {
+        // dense append grows the array part directly
+        if (hashKey.integer == obj->arraySize && obj->arrayCnt == obj->arraySize) 
+            hashResizeArray(obj, obj->arraySize ? obj->arraySize * 2 : HASH_MIN_ARRAY_SIZE);
+
+        if (hashKey.integer < obj->arraySize) {
+            // existing key keeps its position
+            if (!obj->array[hashKey.integer]) {
+                obj->arraySeq[hashKey.integer] = obj->nextSeq++;
+                obj->arrayCnt++;
+            }
+            gcDropRef(obj, obj->array[hashKey.integer]);
+            obj->array[hashKey.integer] = value;
+            return;
+        }
+    }
+    
+    if (obj->indexSize) {
+        int32_t* slot = hashFindIndexSlot(obj, &hashKey);
+        if (*slot != HASH_INDEX_EMPTY) {
+            // existing key keeps its position
+            HashPair_t* pair = &obj->pairs[*slot];
+            gcWriteBarrier(obj, key);
+            gcDropRef(obj, pair->key);
+            gcDropRef(obj, pair->value);
+            pair->hashKey = hashKey;
+            pair->key = key;
+            pair->value = value;
+            return;
+        }
+    }
+
+    hashAppendPair(obj, &hashKey, key, value, obj->nextSeq++);
+
+    if (3 * obj->pairCnt > 2 * obj->indexSize) {
+        // hash part is full, good moment to rebalance both parts
+        hashRehash(obj);
+    } else {
+        *hashFindIndexSlot(obj, &hashKey) = obj->pairCnt - 1;
+    }
+}
+
+Object_t* hashGetValue(Hash_t* obj, Object_t* key) {
+    HashKey_t hashKey = objectGetHashKey(key);
+    if (isArrayKey(&hashKey) && hashKey.integer < obj->arraySize)
+        return obj->array[hashKey.integer];
+
+    if (!obj->indexSize) 
+        return NULL;
+    int32_t pos = *hashFindIndexSlot(obj, &hashKey);
+    return (pos != HASH_INDEX_EMPTY) ? obj->pairs[pos].value : NULL;
 }
 
-HashPair_t* hashGetPair(Hash_t* obj, Object_t* key) {
-    char* hashKey = objectGetHashKey(key); 
-    HashPair_t* ret = (HashPair_t*)hashMapGet(obj->pairs, hashKey);
-    free(hashKey);
-    return ret;
+uint32_t hashGetPairCount(Hash_t* obj) {
+    return obj->arrayCnt + obj->pairCnt;
+}
+
+static void hashAppendPair(Hash_t* obj, const HashKey_t* hashKey, Object_t* key, Object_t* value, uint32_t seq) {
+    if (obj->pairCnt == obj->pairCap) {
+        uint32_t prevCap = obj->pairCap;
+        obj->pairCap = obj->pairCap ? obj->pairCap * 2 : HASH_MIN_INDEX_SIZE / 2;
+        obj->pairs = reallocBuffer(obj->pairs, prevCap * sizeof(HashPair_t), obj->pairCap * sizeof(HashPair_t));
+    }
+
+    gcWriteBarrier(obj, key);
+    obj->pairs[obj->pairCnt] = (HashPair_t) {
+        .hashKey = *hashKey,
+        .key = key,
+        .value = value,
+        .seq = seq
+    };
+    obj->pairCnt++;
+}
+
+static int hashCompareEntries(const void* a, const void* b) {
+    uint32_t seqA = ((const HashEntry_t*)a)->seq;
+    uint32_t seqB = ((const HashEntry_t*)b)->seq;
+    return (seqA > seqB) - (seqA < seqB);
+}
+
+// Returns hashGetPairCount(obj) entries sorted by insertion, the caller
+// frees them.
+static HashEntry_t* hashGetOrderedEntries(Hash_t* obj) {
+    uint32_t cnt = hashGetPairCount(obj);
+    HashEntry_t* entries = mallocChk((cnt ? cnt : 1) * sizeof(HashEntry_t));
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < obj->arraySize; i++) {
+        if (obj->array[i]) 
+            entries[pos++] = (HashEntry_t) { .seq = obj->arraySeq[i], .arrayKey = i, .pair = NULL };
+    }
+    for (uint32_t i = 0; i < obj->pairCnt; i++) {
+        entries[pos++] = (HashEntry_t) { .seq = obj->pairs[i].seq, .arrayKey = 0, .pair = &obj->pairs[i] };
+    }
+    qsort(entries, cnt, sizeof(HashEntry_t), hashCompareEntries);
+    return entries;
+}
+
+// Returns the index slot holding key, or the empty slot where it belongs.
+static int32_t* hashFindIndexSlot(const Hash_t* obj, const HashKey_t* key) {
+    uint32_t mask = obj->indexSize - 1;
+    uint32_t slot = (uint32_t)key->hash & mask;
+    while (obj->index[slot] != HASH_INDEX_EMPTY) {
+        if (hashKeyEquals(&obj->pairs[obj->index[slot]].hashKey, key))
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return &obj->index[slot];
+}
+
+static void hashBuildIndex(Hash_t* obj, uint32_t indexSize) {
+    freeBuffer(obj->index, obj->indexSize * sizeof(int32_t));
+    obj->index = mallocBuffer(indexSize * sizeof(int32_t));
+    obj->indexSize = indexSize;
+    for (uint32_t i = 0; i < indexSize; i++)
+        obj->index[i] = HASH_INDEX_EMPTY;
+
+    uint32_t mask = indexSize - 1;
+    for (uint32_t i = 0; i < obj->pairCnt; i++) {
+        uint32_t slot = (uint32_t)obj->pairs[i].hashKey.hash & mask;
+        while (obj->index[slot] != HASH_INDEX_EMPTY)
+            slot = (slot + 1) & mask;
+        obj->index[slot] = i;
+    }
+}
+
+static void hashRehash(Hash_t* obj) {
+    uint32_t arraySize = hashComputeArraySize(obj);
+    if (arraySize != obj->arraySize) 
+        hashResizeArray(obj, arraySize);
+
+    // index only stores positions, rebuilding it never touches keys
+    uint32_t indexSize = HASH_MIN_INDEX_SIZE;
+    while (3 * obj->pairCnt > 2 * indexSize)
+        indexSize *= 2;
+    hashBuildIndex(obj, indexSize);
+}
+
+// Largest power of two n such that more than half of the keys [0, n)
+// are present (same rule as the Lua table array part).
+static uint32_t hashComputeArraySize(const Hash_t* obj) {
+    // nums[b] counts keys k with bit length b, i.e. 2^(b-1) <= k < 2^b
+    uint32_t nums[HASH_MAX_ARRAY_BITS + 1] = {0};
+    
+    for (uint32_t i = 0; i < obj->arraySize; i++) {
+        if (obj->array[i]) 
+            nums[i ? 64 - __builtin_clzl(i) : 0]++;
+    }
+    for (uint32_t i = 0; i < obj->pairCnt; i++) {
+        const HashKey_t* key = &obj->pairs[i].hashKey;
+        if (isArrayKey(key))
+            nums[key->integer ? 64 - __builtin_clzl(key->integer) : 0]++;
+    }
+
+    uint32_t arraySize = 0;
+    uint32_t cnt = 0;
+    for (uint32_t b = 0; b <= HASH_MAX_ARRAY_BITS; b++) {
+        cnt += nums[b];
+        if (cnt > (1u << b) / 2) 
+            arraySize = 1u << b;
+    }
+    if (arraySize && arraySize < HASH_MIN_ARRAY_SIZE)
+        arraySize = HASH_MIN_ARRAY_SIZE;
+    return arraySize;
+}
+
+// Moves integer keys between the two parts so that every key below
+// arraySize lives in the array part and every other one in the hash part.
+static void hashResizeArray(Hash_t* obj, uint32_t arraySize) {
+    Object_t** prevArray = obj->array;
+    uint32_t* prevSeq = obj->arraySeq;
+    uint32_t prevSize = obj->arraySize;
+
+    obj->array = arraySize ? mallocBuffer(arraySize * sizeof(Object_t*)) : NULL;
+    obj->arraySeq = arraySize ? mallocBuffer(arraySize * sizeof(uint32_t)) : NULL;
+    if (arraySize) 
+        memset(obj->array, 0, arraySize * sizeof(Object_t*));
+    obj->arraySize = arraySize;
+    obj->arrayCnt = 0;
+
+    // pull hash part keys that now fall inside the array, keep order of the rest
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < obj->pairCnt; i++) {
+        HashPair_t* pair = &obj->pairs[i];
+        if (isArrayKey(&pair->hashKey) && pair->hashKey.integer < arraySize) {
+            // the array part has no use for the key object
+            gcDropRef(obj, pair->key);
+            obj->array[pair->hashKey.integer] = pair->value;
+            obj->arraySeq[pair->hashKey.integer] = pair->seq;
+            obj->arrayCnt++;
+        } else {
+            obj->pairs[kept++] = *pair;
+        }
+    }
+    bool pairsChanged = (kept != obj->pairCnt);
+    obj->pairCnt = kept;
+
+    for (uint32_t i = 0; i < prevSize; i++) {
+        if (!prevArray[i]) 
+            continue;
+        if (i < arraySize) {
+            obj->array[i] = prevArray[i];
+            obj->arraySeq[i] = prevSeq[i];
+            obj->arrayCnt++;
+        } else {
+            // shrinking, key object has to be recreated for the hash part
+            Integer_t* key = createInteger(i);
+            HashKey_t hashKey = objectGetHashKey((Object_t*)key);
+            hashAppendPair(obj, &hashKey, (Object_t*)key, prevArray[i], prevSeq[i]);
+            pairsChanged = true;
+        }
+    }
+    freeBuffer(prevArray, prevSize * sizeof(Object_t*));
+    freeBuffer(prevSeq, prevSize * sizeof(uint32_t));
+
+    if (pairsChanged) {
+        uint32_t indexSize = HASH_MIN_INDEX_SIZE;
+        while (3 * obj->pairCnt > 2 * indexSize)
+            indexSize *= 2;
+        hashBuildIndex(obj, indexSize);
+    }
 }
 
 void gcCleanupHash(Hash_t** obj) {
     if(!(*obj)) return;
-    cleanupHashMap(&(*obj)->pairs, (HashMapElemCleanupFn_t) cleanupHashPair);
+    // the buffers count against the heap size, see gcHeapBytes
+    freeBuffer((*obj)->array, (*obj)->arraySize * sizeof(Object_t*));
+    freeBuffer((*obj)->arraySeq, (*obj)->arraySize * sizeof(uint32_t));
+    freeBuffer((*obj)->pairs, (*obj)->pairCap * sizeof(HashPair_t));
+    freeBuffer((*obj)->index, (*obj)->indexSize * sizeof(int32_t));
     gcFree(*obj);
     *obj = NULL; 
 }
 
-void gcMarkHash(Hash_t* obj) {
-    HashMapIter_t iter = createHashMapIter(obj->pairs);
-    HashMapEntry_t* entry = hashMapIterGetNext(obj->pairs, &iter);
-    while(entry){
-        HashPair_t* pair = (HashPair_t*)entry->value; 
-        if (!gcMarkedAsUsed(pair->key)) {
-            gcMarkUsed(pair->key);
-            gcMarkObject(pair->key);
-        }
-        
-        if (!gcMarkedAsUsed(pair->value)) {
-            gcMarkUsed(pair->value);
-            gcMarkObject(pair->value);
-        }
-        entry = hashMapIterGetNext(obj->pairs, &iter);
+void gcTraceHash(Hash_t* obj, GCSlotVisitorFn_t visit) {
+    for (uint32_t i = 0; i < obj->arraySize; i++) {
+        visit((void**)&obj->array[i]);
+    }
+
+    for (uint32_t i = 0; i < obj->pairCnt; i++) {
+        HashPair_t* pair = &obj->pairs[i];
+        visit((void**)&pair->key);
+        visit((void**)&pair->value);
     }
 }
 
@@ -554,7 +831,7 @@ void gcCleanupBuiltin(Builtin_t** obj) {
     *obj = NULL;
 }
 
-void gcMarkBuiltin(Builtin_t *obj) {
+void gcTraceBuiltin(Builtin_t *obj, GCSlotVisitorFn_t visit) {
     // no internal objects to mark 
 }
 
@@ -563,7 +840,7 @@ void gcMarkBuiltin(Builtin_t *obj) {
  ************************************/
 
 typedef void (*ObjectCleanupFn_t) (void**);
-typedef void (*ObjectGcMarkFn_t) (void*);
+typedef void (*ObjectGcTraceFn_t) (void*, GCSlotVisitorFn_t);
 
 static ObjectCleanupFn_t objectCleanupFns[_OBJECT_TYPE_CNT] = {
     [OBJECT_INTEGER]=(ObjectCleanupFn_t)gcCleanupInteger,
@@ -578,17 +855,17 @@ static ObjectCleanupFn_t objectCleanupFns[_OBJECT_TYPE_CNT] = {
     [OBJECT_HASH]=(ObjectCleanupFn_t)gcCleanupHash,
 };
 
-static ObjectGcMarkFn_t objectMarkFns[_OBJECT_TYPE_CNT] = {
-    [OBJECT_INTEGER]=(ObjectGcMarkFn_t)gcMarkInteger,
-    [OBJECT_BOOLEAN]=(ObjectGcMarkFn_t)gcMarkBoolean,
-    [OBJECT_STRING]=(ObjectGcMarkFn_t)gcMarkString,
-    [OBJECT_NULL]=(ObjectGcMarkFn_t)gcMarkNull,
-    [OBJECT_RETURN_VALUE]=(ObjectGcMarkFn_t)gcMarkReturnValue,
-    [OBJECT_ERROR]=(ObjectGcMarkFn_t)gcMarkError,
-    [OBJECT_FUNCTION]=(ObjectGcMarkFn_t)gcMarkFunction,
-    [OBJECT_BUILTIN]=(ObjectGcMarkFn_t)gcMarkBuiltin,
-    [OBJECT_ARRAY]=(ObjectGcMarkFn_t)gcMarkArray,
-    [OBJECT_HASH]=(ObjectGcMarkFn_t)gcMarkHash,
+static ObjectGcTraceFn_t objectTraceFns[_OBJECT_TYPE_CNT] = {
+    [OBJECT_INTEGER]=(ObjectGcTraceFn_t)gcTraceInteger,
+    [OBJECT_BOOLEAN]=(ObjectGcTraceFn_t)gcTraceBoolean,
+    [OBJECT_STRING]=(ObjectGcTraceFn_t)gcTraceString,
+    [OBJECT_NULL]=(ObjectGcTraceFn_t)gcTraceNull,
+    [OBJECT_RETURN_VALUE]=(ObjectGcTraceFn_t)gcTraceReturnValue,
+    [OBJECT_ERROR]=(ObjectGcTraceFn_t)gcTraceError,
+    [OBJECT_FUNCTION]=(ObjectGcTraceFn_t)gcTraceFunction,
+    [OBJECT_BUILTIN]=(ObjectGcTraceFn_t)gcTraceBuiltin,
+    [OBJECT_ARRAY]=(ObjectGcTraceFn_t)gcTraceArray,
+    [OBJECT_HASH]=(ObjectGcTraceFn_t)gcTraceHash,
 };
 
 
@@ -601,9 +878,47 @@ void gcCleanupObject(Object_t** obj) {
     }
 }
 
-void gcMarkObject(Object_t* obj) {
+// Calls visit on the address of every GC pointer held by obj.
+void gcTraceObject(Object_t* obj, GCSlotVisitorFn_t visit) {
     if (obj && 0 <= obj->type && obj->type < _OBJECT_TYPE_CNT) {
-        ObjectGcMarkFn_t markFn = objectMarkFns[obj->type];
-        if (markFn) markFn(obj);
+        ObjectGcTraceFn_t traceFn = objectTraceFns[obj->type];
+        if (traceFn) traceFn(obj, visit);
     }   
 }
+
+// Bytes of the buffers obj owns outside of its GC cell
+size_t gcObjectOwnedBytes(Object_t* obj) {
+    switch (obj->type) {
+        case OBJECT_STRING:
+            return strlen(((String_t*)obj)->value) + 1;
+        case OBJECT_ERROR:
+            return strlen(((Error_t*)obj)->message) + 1;
+        case OBJECT_ARRAY: {
+            Vector_t* elements = ((Array_t*)obj)->elements;
+            return elements ? sizeof(Vector_t) + elements->cap * sizeof(void*) : 0;
+        }
+        case OBJECT_HASH: {
+            Hash_t* hash = (Hash_t*)obj;
+            return hash->arraySize * (sizeof(Object_t*) + sizeof(uint32_t)) + hash->pairCap * sizeof(HashPair_t) +
+                   hash->indexSize * sizeof(int32_t);
+        }
+        default:
+            return 0;
+    }
+}
+
+// Scalars and arrays, the common short lived values, are freed once no
+// reference to them is left. Closures, environments and hashes are left
+// to tracing, which also collects cycles.
+bool gcIsRefCountedObject(Object_t* obj) {
+    switch (obj->type) {
+        case OBJECT_INTEGER:
+        case OBJECT_BOOLEAN:
+        case OBJECT_NULL:
+        case OBJECT_STRING:
+        case OBJECT_ARRAY:
+            return true;
+        default:
+            return false;
+    }
+}
@@ -41,9 +41,23 @@ Object_t* copyObject(Object_t* obj);
 
 char* objectInspect(Object_t* obj);
 ObjectType_t objectGetType(Object_t* obj);
-char* objectGetHashKey(Object_t* obj);
 bool objectIsHashable(Object_t* obj); 
 
+// Key used by Hash_t, built without allocating. String keys
+// borrow the char buffer of the String_t they were created from.
+typedef struct HashKey {
+    ObjectType_t type;
+    uint64_t hash;
+    union {
+        int64_t integer;
+        bool boolean;
+        const char* string;
+    };
+} HashKey_t;
+
+HashKey_t objectGetHashKey(Object_t* obj);
+bool hashKeyEquals(const HashKey_t* a, const HashKey_t* b);
+
 /************************************ 
  *     INTEGER OBJECT TYPE          *
  ************************************/
@@ -138,12 +152,12 @@ typedef struct Environment Environment_t;
 
 typedef struct Function {
     OBJECT_BASE_ATTRS;
-    Vector_t* parameters;
-    BlockStatement_t* body;
+    const FunctionLiteral_t* literal; // parameters, body and what the parser found about them
+    Arena_t* ast; // the literal lives here
     Environment_t* environment;
 } Function_t;
 
-Function_t* createFunction(Vector_t* params, BlockStatement_t* body, Environment_t* env);
+Function_t* createFunction(const FunctionLiteral_t* literal, Environment_t* env);
 Function_t* copyFunction(Function_t* obj);
 
 char* functionInspect(Function_t* obj);
@@ -172,23 +186,38 @@ void arrayAppend(Array_t* arr, Object_t* obj);
  ************************************/
 
 typedef struct HashPair {
+    HashKey_t hashKey;
     Object_t* key;
     Object_t* value;
+    uint32_t seq; // insertion sequence
 } HashPair_t;
 
-HashPair_t* createHashPair(Object_t* key, Object_t* value);
-
+// Compact dict layout: pairs are kept densely and a separate open
+// addressing index maps key hashes to pair positions. Dense non negative
+// integer keys are stored in the array part instead, indexed directly by
+// key (NULL marks a missing key). Every key gets an insertion sequence
+// number that survives moves between the parts, inspection follows it.
 typedef struct Hash {
     OBJECT_BASE_ATTRS;
-    HashMap_t* pairs;
+    Object_t** array;
+    uint32_t* arraySeq; // insertion sequence of each array slot
+    uint32_t arraySize;
+    uint32_t arrayCnt;
+    uint32_t nextSeq;
+    HashPair_t* pairs;
+    uint32_t pairCnt;
+    uint32_t pairCap;
+    int32_t* index;
+    uint32_t indexSize;
 } Hash_t;
 
 Hash_t* createHash();
 Hash_t* copyHash(Hash_t* obj);
 
 char* hashInspect(Hash_t* obj);
-void hashInsertPair(Hash_t* obj, HashPair_t* pair);
-HashPair_t* hashGetPair(Hash_t* obj, Object_t* key);
+void hashInsertPair(Hash_t* obj, Object_t* key, Object_t* value);
+Object_t* hashGetValue(Hash_t* obj, Object_t* key);
+uint32_t hashGetPairCount(Hash_t* obj);
 
 
 /************************************ 
@@ -3,6 +3,7 @@
 #include <string.h> 
 
 #include "parser.h"
+#include "analysis.h"
 #include "utils.h"
 
 /* Operator precedence levels */
@@ -83,6 +84,7 @@ Parser_t* createParser(Lexer_t* lexer) {
     Parser_t* parser = mallocChk(sizeof(Parser_t));
 
     parser->lexer = lexer;
+    parser->arena = lexer->arena;
     parser->curToken = parser->peekToken = NULL;
 
     memset(parser->prefixParseFns, 0, sizeof(PrefixParseFn_t) * _TOKEN_TYPE_CNT);
@@ -125,9 +127,8 @@ static void cleanupError(char** str) {
 void cleanupParser(Parser_t** parser) {
     if (!(*parser)) 
         return;
+    // Tokens live in the lexer arena, programs parsed from it hold their own reference
     cleanupLexer(&(*parser)->lexer);
-    cleanupToken(&(*parser)->peekToken);
-    cleanupToken(&(*parser)->curToken);
 
     cleanupVector(&(*parser)->errors, (VectorElemCleanupFn_t)cleanupError);
     
@@ -140,7 +141,7 @@ void cleanupParser(Parser_t** parser) {
 /* Core parsing logic */
 
 Program_t* parserParseProgram(Parser_t* parser) {
-    Program_t* program = createProgram();
+    Program_t* program = createProgram(parser->arena);
 
     while (!parserCurTokenIs(parser, TOKEN_EOF)) {
         Statement_t* stmt = parserParseStatement(parser);
@@ -167,16 +168,16 @@ static Statement_t* parserParseStatement(Parser_t* parser) {
 }
 
 static Statement_t* parserParseLetStatement(Parser_t* parser) {
-    LetStatement_t* stmt = createLetStatement(parser->curToken);
+    LetStatement_t* stmt = createLetStatement(parser->arena, parser->curToken);
 
     if (!parserExpectPeek(parser, TOKEN_IDENT)) {
-        goto cleanup;
+        return NULL;
     }
 
-    stmt->name = createIdentifier(parser->curToken, parser->curToken->literal);
+    stmt->name = createIdentifier(parser->arena, parser->curToken);
 
     if (!parserExpectPeek(parser, TOKEN_ASSIGN)) {
-        goto cleanup;
+        return NULL;
     }
 
     parserNextToken(parser);
@@ -189,15 +190,11 @@ static Statement_t* parserParseLetStatement(Parser_t* parser) {
     }
 
     return (Statement_t*)stmt;
-
-cleanup:
-    cleanupLetStatement(&stmt);
-    return NULL;
 }
 
 
 static Statement_t* parserParseReturnStatement(Parser_t* parser) {
-    ReturnStatement_t* stmt = createReturnStatement(parser->curToken);
+    ReturnStatement_t* stmt = createReturnStatement(parser->arena, parser->curToken);
     parserNextToken(parser);
 
     stmt->returnValue = parserParseExpression(parser, PREC_LOWEST);
@@ -212,7 +209,7 @@ static Statement_t* parserParseReturnStatement(Parser_t* parser) {
 
 
 static Statement_t* parserParseExpressionStatement(Parser_t* parser) {
-    ExpressionStatement_t* stmt = createExpressionStatement(parser->curToken);
+    ExpressionStatement_t* stmt = createExpressionStatement(parser->arena, parser->curToken);
 
     stmt->expression = parserParseExpression(parser, PREC_LOWEST);
 
@@ -226,7 +223,7 @@ static Statement_t* parserParseExpressionStatement(Parser_t* parser) {
 
 
 static BlockStatement_t* parserParseBlockStatement(Parser_t* parser) {
-    BlockStatement_t* block = createBlockStatement(parser->curToken);
+    BlockStatement_t* block = createBlockStatement(parser->arena, parser->curToken);
     parserNextToken(parser);
 
     while (!parserCurTokenIs(parser, TOKEN_RBRACE) && !parserCurTokenIs(parser, TOKEN_EOF)) {
@@ -266,16 +263,18 @@ static Expression_t* parserParseExpression(Parser_t* parser, PrecValue_t precede
 }
 
 static Expression_t* parserParseIdentifier(Parser_t* parser) {
-    return (Expression_t*)createIdentifier(parser->curToken, parser->curToken->literal);
+    return (Expression_t*)createIdentifier(parser->arena, parser->curToken);
 }
 
 static Expression_t* parserParseIntegerLiteral(Parser_t* parser) {
-    IntegerLiteral_t* lit = createIntegerLiteral(parser->curToken);
+    IntegerLiteral_t* lit = createIntegerLiteral(parser->arena, parser->curToken);
 
-    if (!strToInteger(lit->token->literal, &lit->value)) {
-        char* err = strFormat("Could not parser %s as integer", lit->token->literal);
+    // the digits end where the token ends, no need for a terminated copy
+    if (!strToInteger(tokenText(lit->token), &lit->value)) {
+        char* err = strFormat("%u:%u: Could not parser %.*s as integer", 
+                              lit->token->line, lit->token->col,
+                              (int)lit->token->length, tokenText(lit->token));
         parserAppendError(parser, err);
-        cleanupIntegerLiteral(&lit);
         return NULL;
     }
 
@@ -283,14 +282,14 @@ static Expression_t* parserParseIntegerLiteral(Parser_t* parser) {
 }
 
 static Expression_t* parserParseStringLiteral(Parser_t* parser) {
-    StringLiteral_t* lit = (StringLiteral_t*)createStringLiteral(parser->curToken);
-    lit->value = cloneString(parser->curToken->literal);
+    StringLiteral_t* lit = (StringLiteral_t*)createStringLiteral(parser->arena, parser->curToken);
+    lit->value = arenaCloneSubstring(parser->arena, tokenText(parser->curToken), parser->curToken->length);
     return (Expression_t*)lit;
 }
 
 static Expression_t* parserParsePrefixExpression(Parser_t* parser) {
-    PrefixExpression_t* expression = createPrefixExpresion(parser->curToken);
-    expression->operator = cloneString(parser->curToken->literal);
+    PrefixExpression_t* expression = createPrefixExpresion(parser->arena, parser->curToken);
+    expression->operator = arenaCloneSubstring(parser->arena, tokenText(parser->curToken), parser->curToken->length);
 
     parserNextToken(parser);
     expression->right = parserParseExpression(parser, PREC_PREFIX);
@@ -299,9 +298,9 @@ static Expression_t* parserParsePrefixExpression(Parser_t* parser) {
 }
 
 static Expression_t* parserParseInfixExpression(Parser_t* parser, Expression_t* left) {
-    InfixExpression_t* expression = createInfixExpresion(parser->curToken);
+    InfixExpression_t* expression = createInfixExpresion(parser->arena, parser->curToken);
     expression->left = left;
-    expression->operator = cloneString(parser->curToken->literal);
+    expression->operator = arenaCloneSubstring(parser->arena, tokenText(parser->curToken), parser->curToken->length);
     
     PrecValue_t precedence = parserCurPrecedence(parser);
     parserNextToken(parser);
@@ -311,7 +310,7 @@ static Expression_t* parserParseInfixExpression(Parser_t* parser, Expression_t*
 }
 
 static Expression_t* parserParseBoolean(Parser_t* parser) {
-    BooleanLiteral_t* bl = createBooleanLiteral(parser->curToken);
+    BooleanLiteral_t* bl = createBooleanLiteral(parser->arena, parser->curToken);
     bl->value = parserCurTokenIs(parser, TOKEN_TRUE);
     return (Expression_t*)bl;
 }
@@ -322,7 +321,6 @@ static Expression_t* parserParseGroupedExpression(Parser_t* parser) {
     Expression_t* exp = parserParseExpression(parser, PREC_LOWEST);
 
     if (!parserExpectPeek(parser, TOKEN_RPAREN)) {
-        cleanupExpression(&exp);
         return NULL;
     }
 
@@ -330,10 +328,9 @@ static Expression_t* parserParseGroupedExpression(Parser_t* parser) {
 }
 
 static Expression_t* parserParseIfExpression(Parser_t* parser) {
-    IfExpression_t* expression = createIfExpresion(parser->curToken);
+    IfExpression_t* expression = createIfExpresion(parser->arena, parser->curToken);
 
     if (!parserExpectPeek(parser, TOKEN_LPAREN)) {
-        cleanupIfExpression(&expression);
         return NULL;
     }
     
@@ -341,12 +338,10 @@ static Expression_t* parserParseIfExpression(Parser_t* parser) {
     expression->condition = parserParseExpression(parser, PREC_LOWEST);
 
     if (!parserExpectPeek(parser, TOKEN_RPAREN)) {
-        cleanupIfExpression(&expression);
         return NULL;
     }
 
     if (!parserExpectPeek(parser, TOKEN_LBRACE)) {
-        cleanupIfExpression(&expression);
         return NULL;
     }
     
@@ -356,7 +351,6 @@ static Expression_t* parserParseIfExpression(Parser_t* parser) {
         parserNextToken(parser);
         
         if (!parserExpectPeek(parser, TOKEN_LBRACE)) {
-            cleanupIfExpression(&expression);
             return NULL;
         }
 
@@ -368,21 +362,21 @@ static Expression_t* parserParseIfExpression(Parser_t* parser) {
 }
 
 static Expression_t* parserParseFunctionLiteral(Parser_t* parser) {
-    FunctionLiteral_t* expression = createFunctionLiteral(parser->curToken);
+    FunctionLiteral_t* expression = createFunctionLiteral(parser->arena, parser->curToken);
 
     if (!parserExpectPeek(parser, TOKEN_LPAREN)) {
-        cleanupFunctionLiteral(&expression);
         return NULL;
     }
 
     parserParseFunctionParameters(parser, expression);
 
     if (!parserExpectPeek(parser, TOKEN_LBRACE)) {
-        cleanupFunctionLiteral(&expression);
         return NULL;
     }
 
     expression->body = parserParseBlockStatement(parser);
+    // once per literal, not per closure created from it
+    analysisFunctionLiteral(expression);
 
     return (Expression_t*)expression;
 }
@@ -397,13 +391,13 @@ static void parserParseFunctionParameters(Parser_t* parser, FunctionLiteral_t* f
 
     parserNextToken(parser);
 
-    ident = createIdentifier(parser->curToken, parser->curToken->literal);
+    ident = createIdentifier(parser->arena, parser->curToken);
     functionLiteralAppendParameter(fl, ident);
 
     while (parserPeekTokenIs(parser, TOKEN_COMMA)) {
         parserNextToken(parser);
         parserNextToken(parser);
-        ident = createIdentifier(parser->curToken, parser->curToken->literal);
+        ident = createIdentifier(parser->arena, parser->curToken);
         functionLiteralAppendParameter(fl, ident);
     }
 
@@ -414,28 +408,26 @@ static void parserParseFunctionParameters(Parser_t* parser, FunctionLiteral_t* f
 
 
 static Expression_t* parserParseCallExpression(Parser_t* parser, Expression_t* function) {
-    CallExpression_t* callExpr = createCallExpression(parser->curToken);
+    CallExpression_t* callExpr = createCallExpression(parser->arena, parser->curToken);
     callExpr->function = function;
     callExpr->arguments = parserParseExpressionList(parser, TOKEN_RPAREN);
     if (!callExpr->arguments) {
-        cleanupExpression((Expression_t**)&callExpr);
         return NULL;
     }
     return (Expression_t*)callExpr;
 }
 
 static Expression_t* parserParseArrayLiteral(Parser_t* parser) {
-    ArrayLiteral_t* arrayExpr = createArrayLiteral(parser->curToken);
+    ArrayLiteral_t* arrayExpr = createArrayLiteral(parser->arena, parser->curToken);
     arrayExpr->elements = parserParseExpressionList(parser, TOKEN_RBRACKET);
     if (!arrayExpr->elements) {
-        cleanupExpression((Expression_t**)&arrayExpr);
         return NULL;
     }
     return (Expression_t*)arrayExpr;
 }
 
 static Vector_t* parserParseExpressionList(Parser_t* parser, TokenType_t end) {
-    Vector_t* list = createVector();
+    Vector_t* list = createArenaVector(parser->arena);
     if (parserPeekTokenIs(parser, end)){
         parserNextToken(parser);
         return list;
@@ -454,8 +446,8 @@ static Vector_t* parserParseExpressionList(Parser_t* parser, TokenType_t end) {
     }
 
     if (!parserExpectPeek(parser, end)) {
-        cleanupVector(&list, (VectorElemCleanupFn_t)cleanupExpression);
-        char* err = strFormat("Expression list missing terminator %s", tokenTypeToStr(end));
+        char* err = strFormat("%u:%u: Expression list missing terminator %s", 
+                              parser->peekToken->line, parser->peekToken->col, tokenTypeToStr(end));
         parserAppendError(parser, err);
         return NULL;
     }
@@ -464,14 +456,13 @@ static Vector_t* parserParseExpressionList(Parser_t* parser, TokenType_t end) {
 }
 
 static Expression_t* parserParseIndexExpression(Parser_t*parser, Expression_t* left) {
-    IndexExpression_t* exprIndex = createIndexExpression(parser->curToken);
+    IndexExpression_t* exprIndex = createIndexExpression(parser->arena, parser->curToken);
     parserNextToken(parser);
 
     exprIndex->left = left;
     exprIndex->right = parserParseExpression(parser, PREC_LOWEST);
 
     if (!parserExpectPeek(parser, TOKEN_RBRACKET)) {
-        cleanupIndexExpression(&exprIndex);
         return NULL;
     }
     
@@ -479,24 +470,19 @@ static Expression_t* parserParseIndexExpression(Parser_t*parser, Expression_t* l
 }
 
 static Expression_t* parserParseHashLiteral(Parser_t* parser) {
-    HashLiteral_t* hash = createHashLiteral(parser->curToken);
+    HashLiteral_t* hash = createHashLiteral(parser->arena, parser->curToken);
 
     while(!parserPeekTokenIs(parser, TOKEN_RBRACE)) {
         parserNextToken(parser);
 
         Expression_t* key = parserParseExpression(parser, PREC_LOWEST);
         if (!parserExpectPeek(parser, TOKEN_COLON)){
-            cleanupExpression(&key);
-            cleanupHashLiteral(&hash);
             return NULL;
         }
         parserNextToken(parser);
         Expression_t* value = parserParseExpression(parser, PREC_LOWEST);
 
         if(!parserPeekTokenIs(parser, TOKEN_RBRACE)&& !parserExpectPeek(parser, TOKEN_COMMA)) {
-            cleanupExpression(&key);
-            cleanupExpression(&value);
-            cleanupHashLiteral(&hash);
             return NULL;
         }
 
@@ -504,7 +490,6 @@ static Expression_t* parserParseHashLiteral(Parser_t* parser) {
     }
 
     if (!parserExpectPeek(parser, TOKEN_RBRACE)) {
-        cleanupHashLiteral(&hash);
         return NULL;
     }
 
@@ -531,8 +516,6 @@ static void parserRegisterInfix(Parser_t* parser, TokenType_t tokType, InfixPars
 /* Token manipulation functions */
 
 static void parserNextToken(Parser_t* parser) {
-    if (parser->curToken)
-        cleanupToken(&parser->curToken);
     parser->curToken = parser->peekToken;
     parser->peekToken = lexerNextToken(parser->lexer);
 }
@@ -569,7 +552,8 @@ uint32_t parserGetErrorCount(Parser_t* parser) {
 
 
 static void parserNoPrefixParseFnError(Parser_t* parser, TokenType_t tokType) {
-    char* msg = strFormat("No prefix parser function for %s found", tokenTypeToStr(tokType));
+    char* msg = strFormat("%u:%u: No prefix parser function for %s found", 
+                          parser->curToken->line, parser->curToken->col, tokenTypeToStr(tokType));
     parserAppendError(parser, msg);
 }
 
@@ -578,7 +562,8 @@ static void parserAppendError(Parser_t* parser, char* err) {
 }
 
 static void parserPeekError(Parser_t* parser, TokenType_t expTokenType) {
-    char* strBuffer = strFormat("Expected next token to be %s, got %s instead", 
+    char* strBuffer = strFormat("%u:%u: Expected next token to be %s, got %s instead", 
+                                parser->peekToken->line, parser->peekToken->col,
                                 tokenTypeToStr(expTokenType),   
                                 tokenTypeToStr(parser->peekToken->type));
     parserAppendError(parser, strBuffer);
@@ -11,6 +11,7 @@ typedef Expression_t* (*InfixParseFn_t) (Parser_t*, Expression_t*);
 
 typedef struct Parser {
     Lexer_t* lexer;
+    Arena_t* arena; // borrowed from the lexer
 
     Token_t* curToken;
     Token_t* peekToken;
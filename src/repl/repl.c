@@ -1,7 +1,10 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h> 
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h> 
+#include <errno.h>
+#include <signal.h>
 
 #include "../parser.h"
 #include "../lexer.h"
@@ -9,6 +12,7 @@
 #include "../evaluator.h"
 #include "../env.h"
 #include "../gc.h"
+#include "../hmap.h"
 
 #define PROMPT ">> "
 
@@ -49,8 +53,15 @@ void replMode() {
     Environment_t* env = createEnvironment(NULL);
     while (true) {
         printf("%s", PROMPT);
-        if(!fgets(inputBuffer, sizeof(inputBuffer), stdin))
-            break;
+        errno = 0;
+        if(!fgets(inputBuffer, sizeof(inputBuffer), stdin)) {
+            if (errno != EINTR)
+                break;
+            // interrupted by SIGUSR1 while idle, write the snapshot now
+            clearerr(stdin);
+            gcSafepoint();
+            continue;
+        }
         
         if (strcmp(inputBuffer, "quit\n") == 0) 
             break;
@@ -87,12 +98,23 @@ void fileExecMode(char* filename) {
 }
 
 
+static void heapDumpSignalHandler(int signo) {
+    (void)signo;
+    gcRequestHeapDump();
+}
+
 int main(int argc, char**argv) {
+    // kill -USR1 <pid> writes a heap snapshot, see CAPUCHIN_HEAP_DUMP
+    struct sigaction action = { .sa_handler = heapDumpSignalHandler };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+
     if (argc == 1) {
         // no parameters provided
         replMode();
     } else {    
         fileExecMode(argv[1]);
     }
+    cleanupInternPool();
     return 0;
 }
\ No newline at end of file
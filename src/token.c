@@ -4,28 +4,27 @@
 #include "utils.h"
 
 
-Token_t* createToken(TokenType_t type, const char* literal, uint16_t len) {
-    Token_t* token = mallocChk(sizeof(Token_t));
+Token_t* createToken(Arena_t* arena, TokenType_t type, const char* source, 
+                     uint32_t offset, uint32_t length, uint32_t line, uint32_t col) {
+    Token_t* token = arenaAlloc(arena, sizeof(Token_t));
 
-    token->type = type;    
-    token->literal = cloneSubstring(literal, len); 
-    if (token->literal == NULL)
-        return NULL;
-        
+    *token = (Token_t) {
+        .type = type,
+        .source = source,
+        .offset = offset,
+        .length = length,
+        .line = line,
+        .col = col
+    };
     return token;
 }
 
-Token_t* copyToken(const Token_t* tok) {
-    return createToken(tok->type, tok->literal, strlen(tok->literal));
+const char* tokenText(const Token_t* tok) {
+    return tok->source + tok->offset;
 }
 
-void cleanupToken(Token_t** token)
-{
-    if (!*token)
-        return;
-    free((*token)->literal);
-    free(*token);
-    *token = NULL;
+char* tokenToString(const Token_t* tok) {
+    return cloneSubstring(tokenText(tok), tok->length);
 }
 
 TokenType_t lookupIdent(const char* ident, uint32_t len)
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdint.h> 
+#include "utils.h"
 
 typedef enum TokenType{
     TOKEN_ILLEGAL, 
@@ -50,15 +51,25 @@ typedef enum TokenType{
     _TOKEN_TYPE_CNT
 } TokenType_t; 
 
+// The lexeme is not copied, tokens point into the source the lexer retains
 typedef struct Token {
     TokenType_t type;
-    char* literal; 
+    const char* source;
+    uint32_t offset; // start of the lexeme in source
+    uint32_t length;
+    uint32_t line; // 1 based position of the first char
+    uint32_t col;
 } Token_t;
 
 
-Token_t* createToken(TokenType_t type, const char* literal, uint16_t len);
-Token_t* copyToken(const Token_t* tok);
-void cleanupToken(Token_t** token);
+// Tokens live as long as the arena, there is no cleanup of single tokens
+Token_t* createToken(Arena_t* arena, TokenType_t type, const char* source, 
+                     uint32_t offset, uint32_t length, uint32_t line, uint32_t col);
+
+// Lexeme inside the source, not NUL terminated
+const char* tokenText(const Token_t* tok);
+// NUL terminated copy of the lexeme, caller frees
+char* tokenToString(const Token_t* tok);
 
 
 TokenType_t lookupIdent(const char* ident, uint32_t len);
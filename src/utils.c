@@ -1,14 +1,24 @@
+#define _GNU_SOURCE // mremap
+
 #include "utils.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 char* cloneString(const char* str) {
     return cloneSubstring(str, strlen(str));
 }
 
+void cleanupString(char** str) {
+    if (!(*str)) return;
+    free(*str);
+    *str = NULL;
+}
+
 char* cloneSubstring(const char* str, uint32_t len) {
     char* newStr = (char*) calloc(len + 1u, sizeof(char));
     if (newStr == NULL) {
@@ -30,6 +40,41 @@ bool strToInteger(const char* str, int64_t* val) {
     return true;
 }
 
+#define HASH_SEED 0x9e3779b97f4a7c15UL
+#define HASH_MUL 0xff51afd7ed558ccdUL
+
+// Word at a time string hash, reads 8 bytes per step and finishes with
+// the integer finalizer below.
+uint64_t hashString(const char* str) {
+    size_t len = strlen(str);
+    uint64_t hash = HASH_SEED ^ (uint64_t)len;
+    uint64_t word;
+
+    while (len >= sizeof(word)) {
+        memcpy(&word, str, sizeof(word));
+        hash = (hash ^ word) * HASH_MUL;
+        hash = (hash << 31) | (hash >> 33);
+        str += sizeof(word);
+        len -= sizeof(word);
+    }
+
+    word = 0;
+    memcpy(&word, str, len);
+    hash = (hash ^ word) * HASH_MUL;
+
+    return hashInteger(hash);
+}
+
+// Finalizer from MurmurHash3, spreads integer keys over all 64 bits.
+uint64_t hashInteger(uint64_t val) {
+    val ^= val >> 33;
+    val *= 0xff51afd7ed558ccdUL;
+    val ^= val >> 33;
+    val *= 0xc4ceb9fe1a85ec53UL;
+    val ^= val >> 33;
+    return val;
+}
+
 char* strFormat(const char* fmt, ...) {
     va_list argp, argp2;
  
@@ -51,4 +96,136 @@ void* mallocChk(size_t size) {
     void* ptr = malloc(size);
     if (!ptr) HANDLE_OOM();
     return ptr;
-}
\ No newline at end of file
+}
+
+
+static size_t pageAlign(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+// buffers may be freed by the background sweeper
+static uint64_t bufferBytes = 0;
+
+uint64_t bufferBytesInUse() {
+    return __atomic_load_n(&bufferBytes, __ATOMIC_RELAXED);
+}
+
+void* mallocBuffer(size_t size) {
+    __atomic_add_fetch(&bufferBytes, size, __ATOMIC_RELAXED);
+    if (size < LARGE_BUFFER_SIZE)
+        return mallocChk(size);
+
+    void* buf = mmap(NULL, pageAlign(size), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) HANDLE_OOM();
+    return buf;
+}
+
+void* reallocBuffer(void* buf, size_t oldSize, size_t newSize) {
+    if (!buf)
+        return mallocBuffer(newSize);
+
+    if ((oldSize < LARGE_BUFFER_SIZE) == (newSize < LARGE_BUFFER_SIZE))
+        __atomic_add_fetch(&bufferBytes, newSize - oldSize, __ATOMIC_RELAXED);
+    if (oldSize < LARGE_BUFFER_SIZE && newSize < LARGE_BUFFER_SIZE) {
+        buf = realloc(buf, newSize);
+        if (!buf) HANDLE_OOM();
+        return buf;
+    }
+    if (oldSize >= LARGE_BUFFER_SIZE && newSize >= LARGE_BUFFER_SIZE) {
+        // the kernel moves the pages, the contents are never copied
+        buf = mremap(buf, pageAlign(oldSize), pageAlign(newSize), MREMAP_MAYMOVE);
+        if (buf == MAP_FAILED) HANDLE_OOM();
+        return buf;
+    }
+
+    void* newBuf = mallocBuffer(newSize);
+    memcpy(newBuf, buf, oldSize < newSize ? oldSize : newSize);
+    freeBuffer(buf, oldSize);
+    return newBuf;
+}
+
+void freeBuffer(void* buf, size_t size) {
+    if (!buf) return;
+    __atomic_sub_fetch(&bufferBytes, size, __ATOMIC_RELAXED);
+    if (size < LARGE_BUFFER_SIZE)
+        free(buf);
+    else
+        munmap(buf, pageAlign(size));
+}
+
+#define ARENA_BLOCK_SIZE (16 * 1024)
+
+struct ArenaBlock {
+    ArenaBlock_t* next;
+    char data[];
+};
+
+Arena_t* createArena() {
+    Arena_t* arena = mallocChk(sizeof(Arena_t));
+    *arena = (Arena_t) {
+        .blocks = NULL,
+        .top = NULL,
+        .end = NULL,
+        .refCnt = 1
+    };
+    return arena;
+}
+
+Arena_t* arenaRetain(Arena_t* arena) {
+    __atomic_add_fetch(&arena->refCnt, 1, __ATOMIC_RELAXED);
+    return arena;
+}
+
+void cleanupArena(Arena_t** arena) {
+    if (!*arena) return;
+    if (__atomic_sub_fetch(&(*arena)->refCnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        ArenaBlock_t* block = (*arena)->blocks;
+        while (block) {
+            ArenaBlock_t* next = block->next;
+            free(block);
+            block = next;
+        }
+        free(*arena);
+    }
+    *arena = NULL;
+}
+
+void* arenaAlloc(Arena_t* arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    if ((size_t)(arena->end - arena->top) >= size) {
+        void* ptr = arena->top;
+        arena->top += size;
+        return ptr;
+    }
+
+    if (size > ARENA_BLOCK_SIZE / 4 && arena->blocks) {
+        // big requests get a block of their own behind the current one,
+        // the space left in the current block stays in use
+        ArenaBlock_t* block = mallocChk(sizeof(ArenaBlock_t) + size);
+        block->next = arena->blocks->next;
+        arena->blocks->next = block;
+        return block->data;
+    }
+
+    size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    ArenaBlock_t* block = mallocChk(sizeof(ArenaBlock_t) + blockSize);
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->top = block->data + size;
+    arena->end = block->data + blockSize;
+    return block->data;
+}
+
+char* arenaCloneSubstring(Arena_t* arena, const char* str, uint32_t len) {
+    char* newStr = arenaAlloc(arena, len + 1u);
+    if (len)
+        memcpy(newStr, str, len);
+    newStr[len] = '\0';
+    return newStr;
+}
+
+char* arenaCloneString(Arena_t* arena, const char* str) {
+    return arenaCloneSubstring(arena, str, strlen(str));
+}
@@ -7,12 +7,47 @@
 
 char* cloneString(const char* str);
 char* cloneSubstring(const char* str, uint32_t len);
+void cleanupString(char** str);
 
 char* strFormat(const char* fmt, ...);
 bool strToInteger(const char* str, int64_t* val);
 
+uint64_t hashString(const char* str);
+uint64_t hashInteger(uint64_t val);
+
 
 void* mallocChk(size_t size);
+
+// Buffers of at least LARGE_BUFFER_SIZE bytes get a mapping of their own,
+// they stay out of the malloc heap, grow without being copied and go back
+// to the OS once freed. The caller passes the buffer size back in.
+#define LARGE_BUFFER_SIZE (64 * 1024)
+void* mallocBuffer(size_t size);
+void* reallocBuffer(void* buf, size_t oldSize, size_t newSize);
+void freeBuffer(void* buf, size_t size);
+// Total size of the buffers allocated above and not freed yet
+uint64_t bufferBytesInUse();
+
+// Bump allocator for data that dies all at once, like the tokens and AST
+// of a program. Every reference holder calls cleanupArena, the last one
+// frees all blocks. References may be dropped from any thread.
+typedef struct ArenaBlock ArenaBlock_t;
+
+typedef struct Arena {
+    ArenaBlock_t* blocks;
+    char* top;
+    char* end;
+    uint32_t refCnt;
+} Arena_t;
+
+Arena_t* createArena();
+Arena_t* arenaRetain(Arena_t* arena);
+void cleanupArena(Arena_t** arena);
+
+void* arenaAlloc(Arena_t* arena, size_t size);
+char* arenaCloneSubstring(Arena_t* arena, const char* str, uint32_t len);
+char* arenaCloneString(Arena_t* arena, const char* str);
+
 #define HANDLE_OOM() {\
     perror("HMAP ERROR: Failed to allocate memory!");\
     exit(1);\
@@ -9,6 +9,18 @@ Vector_t* createVector() {
     vec->cap = 0u;
     vec->cnt = 0u;
     vec->buf = NULL;
+    vec->arena = NULL;
+    return vec;
+}
+
+Vector_t* createArenaVector(Arena_t* arena) {
+    Vector_t* vec = arenaAlloc(arena, sizeof(Vector_t));
+    *vec = (Vector_t) {
+        .cap = 0u,
+        .cnt = 0u,
+        .buf = NULL,
+        .arena = arena
+    };
     return vec;
 }
 
@@ -17,7 +29,7 @@ Vector_t* copyVector(Vector_t* vec, VectorElemCopyFn_t copyFn) {
         return NULL;
 
     Vector_t* newVec = createVector();
-    newVec->buf = mallocChk( sizeof(void*) * vec->cap);
+    newVec->buf = mallocBuffer(sizeof(void*) * vec->cap);
     newVec->cap = vec->cap;
     newVec->cnt = vec->cnt;
 
@@ -43,9 +55,13 @@ void cleanupVectorContents(Vector_t*vec, VectorElemCleanupFn_t cleanupFn) {
 void cleanupVector(Vector_t** vec, VectorElemCleanupFn_t cleanupFn) {
     if (!*vec )
         return;
+    if ((*vec)->arena) {
+        *vec = NULL;
+        return;
+    }
     
     cleanupVectorContents(*vec, cleanupFn);
-    free((*vec)->buf);
+    freeBuffer((*vec)->buf, sizeof(void*) * (*vec)->cap);
     (*vec)->buf = NULL;
     
     free(*vec);
@@ -56,18 +72,25 @@ void cleanupVector(Vector_t** vec, VectorElemCleanupFn_t cleanupFn) {
 void vectorAppend(Vector_t* vec, void* elem) {
     if (vec->cnt >= vec->cap)
     {
-        if (vec->buf != NULL) {
+        if (vec->arena) {
+            // the old buffer stays behind in the arena
+            vec->cap = (3u * vec->cap) / 2 + 1;
+            void** buf = arenaAlloc(vec->arena, sizeof(void*) * vec->cap);
+            if (vec->cnt)
+                memcpy(buf, vec->buf, sizeof(void*) * vec->cnt);
+            vec->buf = buf;
+        }
+        else if (vec->buf != NULL) {
             // no more space, reallocate
+            uint32_t oldCap = vec->cap;
             vec->cap = (3u * vec->cap) / 2 + 1;
-            vec->buf = (void*)realloc(vec->buf, sizeof(void*) * vec->cap);
-            if (!vec->buf) HANDLE_OOM();
+            vec->buf = reallocBuffer(vec->buf, sizeof(void*) * oldCap, sizeof(void*) * vec->cap);
         }
         else 
         {
             // initial allocation
             vec->cap = 1;
-            vec->buf = (void*)malloc(sizeof(void*) * vec->cap);
-            if (!vec->buf) HANDLE_OOM();
+            vec->buf = mallocBuffer(sizeof(void*) * vec->cap);
         }
     }
     vec->buf[vec->cnt] = elem;
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "utils.h"
 
 
 typedef void (*VectorElemCleanupFn_t) (void** elem);
@@ -12,10 +13,13 @@ typedef struct Vector {
     uint32_t cap;
     uint32_t cnt;
     void** buf;
+    Arena_t* arena; // owns the vector and its buffer if set
 } Vector_t;
 
 
 Vector_t* createVector();
+// Cleanup is a no-op, the memory goes away with the arena
+Vector_t* createArenaVector(Arena_t* arena);
 Vector_t* copyVector(Vector_t* vec, VectorElemCopyFn_t copyFn);
 void cleanupVectorContents(Vector_t*vec, VectorElemCleanupFn_t cleanupFn);
 void cleanupVector(Vector_t** vec, VectorElemCleanupFn_t cleanupFn);
@@ -0,0 +1,133 @@
+#include <stdlib.h> 
+
+#include "unity.h"
+#include "parser.h"
+#include "analysis.h"
+#include "utils.h"
+
+void setUp(void) {
+    // set stuff up here
+}
+
+void tearDown(void) {
+    // clean stuff up here
+}
+
+// Parses a single function literal expression statement.
+static Program_t* parseFunction(const char* input, FunctionLiteral_t** func) {
+    Lexer_t* lexer = createLexer(input);
+    Parser_t* parser = createParser(lexer);
+    Program_t* program = parserParseProgram(parser);
+    cleanupParser(&parser);
+
+    TEST_ASSERT_EQUAL_UINT32(1, programGetStatementCount(program));
+    ExpressionStatement_t* stmt = (ExpressionStatement_t*)programGetStatements(program)[0];
+    TEST_ASSERT_EQUAL_INT(STATEMENT_EXPRESSION, stmt->type);
+    TEST_ASSERT_EQUAL_INT(EXPRESSION_FUNCTION_LITERAL, stmt->expression->type);
+    *func = (FunctionLiteral_t*)stmt->expression;
+    return program;
+}
+
+void analysisTestFrameMayEscape() {
+    typedef struct TestCase{
+        const char* input;
+        bool expected;
+    }TestCase_t;
+
+    TestCase_t tests[] = {
+        {"fn(x) { x + 1 }", false},
+        {"fn(x, y) { let z = x * y; if (z > 1) { return z; } else { f(z, [1, 2], {1: 2}) } }", false},
+        {"fn(x) { fn(y) { x + y } }", true},
+        {"fn(x) { let g = fn() { x }; g() }", true},
+        {"fn(x) { if (x) { 1 } else { map([1], fn(y) { y }) } }", true},
+        {"fn(x) { {\"k\": fn() { 1 }} }", true},
+    };
+
+    uint32_t cnt = sizeof(tests) / sizeof(TestCase_t);
+    for (uint32_t i = 0; i < cnt; i++ ) {
+        FunctionLiteral_t* func = NULL;
+        Program_t* program = parseFunction(tests[i].input, &func);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(tests[i].expected, analysisFrameMayEscape(func->body), tests[i].input);
+        // the parser stores the result on the literal
+        TEST_ASSERT_EQUAL_INT_MESSAGE(tests[i].expected, func->frameEscapes, tests[i].input);
+        cleanupProgram(&program);
+    }
+}
+
+static void testNames(Vector_t* names, const char** expected, uint32_t expectedCnt) {
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expectedCnt, vectorGetCount(names), "Wrong name count");
+    char** buf = (char**)vectorGetBuffer(names);
+    for (uint32_t i = 0; i < expectedCnt; i++) {
+        TEST_ASSERT_EQUAL_STRING(expected[i], buf[i]);
+    }
+}
+
+void analysisTestFreeVariables() {
+    FunctionLiteral_t* func = NULL;
+    Program_t* program = parseFunction("fn(x) { let y = x + z; let w = fn(a) { a + y + v }; if (x) { let q = 1; q } else { len(w) } }", &func);
+    
+    // the parser analysed the literal and the nested one before it
+    const char* expected[] = {"z", "v", "q", "len"};
+    testNames(func->freeVariables, expected, 4);
+
+    Statement_t* letW = blockStatementGetStatements(func->body)[1];
+    FunctionLiteral_t* nested = (FunctionLiteral_t*)((LetStatement_t*)letW)->value;
+    const char* expectedNested[] = {"y", "v"};
+    testNames(nested->freeVariables, expectedNested, 2);
+
+    Vector_t* names = analysisFreeVariables(func);
+    testNames(names, expected, 4);
+
+    cleanupProgram(&program);
+}
+
+void analysisTestLetBindings() {
+    FunctionLiteral_t* func = NULL;
+    Program_t* program = parseFunction("fn(x) { let y = 1; let g = fn() { let inner = 2; inner }; if (x) { let y = 2; } }", &func);
+    
+    const char* expected[] = {"y", "g", "y"};
+    testNames(func->letBindings, expected, 3);
+    testNames(analysisLetBindings(func->arena, func->body), expected, 3);
+
+    cleanupProgram(&program);
+}
+
+static void testSlots(const Identifier_t* ident, int32_t paramSlot, int32_t captureSlot) {
+    TEST_ASSERT_EQUAL_INT_MESSAGE(paramSlot, ident->paramSlot, ident->value);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(captureSlot, ident->captureSlot, ident->value);
+}
+
+void analysisTestResolveSlots() {
+    FunctionLiteral_t* func = NULL;
+    Program_t* program = parseFunction("fn(x, y) { let x = y + z; fn(a) { a + x + w } }", &func);
+    
+    const char* expected[] = {"z", "w"};
+    testNames(func->freeVariables, expected, 2);
+
+    Statement_t** stmts = blockStatementGetStatements(func->body);
+    LetStatement_t* letX = (LetStatement_t*)stmts[0];
+    testSlots(letX->name, 0, -1);
+    InfixExpression_t* sum = (InfixExpression_t*)letX->value;
+    testSlots((Identifier_t*)sum->left, 1, -1);
+    testSlots((Identifier_t*)sum->right, -1, 0);
+
+    // identifiers of the nested literal index its own slots
+    FunctionLiteral_t* nested = (FunctionLiteral_t*)((ExpressionStatement_t*)stmts[1])->expression;
+    ExpressionStatement_t* body = (ExpressionStatement_t*)blockStatementGetStatements(nested->body)[0];
+    InfixExpression_t* outer = (InfixExpression_t*)body->expression;
+    InfixExpression_t* inner = (InfixExpression_t*)outer->left;
+    testSlots((Identifier_t*)inner->left, 0, -1);
+    testSlots((Identifier_t*)inner->right, -1, 0);
+    testSlots((Identifier_t*)outer->right, -1, 1);
+
+    cleanupProgram(&program);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(analysisTestFrameMayEscape);
+    RUN_TEST(analysisTestFreeVariables);
+    RUN_TEST(analysisTestLetBindings);
+    RUN_TEST(analysisTestResolveSlots);
+    return UNITY_END();
+}
@@ -12,12 +12,13 @@ void tearDown(void) {
 }
 
 void ast_create_test(void) {
-    Program_t* prog = createProgram();
+    Arena_t* arena = createArena();
+    Program_t* prog = createProgram(arena);
     const char* lt = "let";
     const char* name = "myVar";
 
-    LetStatement_t* ls = createLetStatement(createToken(TOKEN_IDENT, lt, 3u));
-    ls->name = createIdentifier(createToken(TOKEN_IDENT, name, 5u), name);
+    LetStatement_t* ls = createLetStatement(arena, createToken(arena, TOKEN_LET, lt, 0, 3u, 1, 1));
+    ls->name = createIdentifier(arena, createToken(arena, TOKEN_IDENT, name, 0, 5u, 1, 5));
     ls->value = NULL;
     programAppendStatement(prog, (Statement_t*)ls);
 
@@ -26,6 +27,7 @@ void ast_create_test(void) {
     TEST_ASSERT_EQUAL_STRING_MESSAGE("let myVar = ;", prog_str, "Invalid program string");
     
     cleanupProgram(&prog);
+    cleanupArena(&arena);
     free(prog_str);
 }
 
@@ -1,4 +1,8 @@
+#define _POSIX_C_SOURCE 200809L // setenv, mkdtemp
 #include <stdlib.h> 
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "unity.h"
 #include "evaluator.h"
@@ -6,6 +10,7 @@
 #include "ast.h"
 #include "utils.h"
 #include "gc.h"
+#include "sbuf.h"
 
 void setUp(void) {
     // set stuff up here
@@ -37,6 +42,7 @@ typedef struct GenericExpect {
 #define _NIL (GenericExpect_t){.type=EXPECT_NULL}
 
 Object_t* testEval(const char* input);
+Object_t* testEvalInEnv(const char* input, Environment_t* env);
 void testIntegerObject(Object_t* obj, int64_t expected);
 void testBooleanObject(Object_t* obj, bool expected);
 void testNullObject(Object_t* obj);
@@ -280,7 +286,7 @@ void evaluatorTestFunctionObject() {
     TEST_ASSERT_EQUAL_STRING_MESSAGE("x", identStr, "Wrong parameter name");
     free(identStr);
 
-    char* bodyStr = blockStatementToString(func->body);
+    char* bodyStr = blockStatementToString(func->literal->body);
     TEST_ASSERT_EQUAL_STRING_MESSAGE("\t(x + 2)", bodyStr, "Wrong function body");
     free(bodyStr);
 
@@ -300,6 +306,9 @@ void evaluatorTestFunctionApplication() {
         {"let add = fn(x, y) { x + y; }; add(5, 5);", 10},
         {"let add = fn(x, y) { x + y; }; add(5 + 5, add(5, 5));", 20},
         {"fn(x) { x; }(5)", 5},
+        {"let f = fn(x, y) { let x = x + 1; let z = 2; x * y + z; }; f(2, 3);", 11},
+        {"let x = 10; let f = fn(y) { x + y; }; f(1) + x;", 21},
+        {"let f = fn(x) { let g = fn() { x }; let x = 7; g(); }; f(1);", 7},
     };
 
     uint32_t cnt = sizeof(tests) / sizeof(TestCase_t);
@@ -323,6 +332,43 @@ void evalatorTestClosures() {
     gcFreeExtRef(evalRes);
 }
 
+void evaluatorTestFlatClosures() {
+    typedef struct {
+        const char* input;
+        int64_t expected;
+    } TestCase_t;
+
+    TestCase_t tests[] = {
+        // let bound recursion inside a frame
+        {"let f = fn(n) { let iter = fn(i, acc) { if (i > n) { acc } else { iter(i + 1, acc + i) } }; iter(1, 0) }; f(10);", 55},
+        // mutual recursion, second function is bound after the first is created
+        {"let f = fn(n) { let a = fn(i) { if (i == 0) { 1 } else { b(i - 1) } }; let b = fn(i) { if (i == 0) { 2 } else { a(i - 1) } }; a(n) }; f(3);", 2},
+        // globals are still resolved at call time
+        {"let x = 1; let f = fn() { x }; let x = 2; f();", 2},
+        // rebound parameter is shared with the closure
+        {"let f = fn(x) { let g = fn() { x }; let x = 7; g(); }; f(1);", 7},
+        {"let f = fn(x) { let g = fn() { fn() { x * 2 } }; g()(); }; f(4);", 8},
+    };
+
+    uint32_t cnt = sizeof(tests) / sizeof(TestCase_t);
+    for (uint32_t i = 0; i < cnt; i++ ) {
+        TestCase_t *tc = &tests[i];
+        Object_t* evalRes = testEval(tc->input);
+        testIntegerObject(evalRes, tc->expected);
+        gcFreeExtRef(evalRes);
+    }
+
+    // closure only keeps the captured value, not the frame of newAdder
+    Object_t* evalRes = testEval("let newAdder = fn(x) { let unused = [1, 2, 3]; fn(y) { x + y } }; newAdder(2);");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(OBJECT_FUNCTION, evalRes->type, "Object is not OBJECT_FUNCTION");
+    Environment_t* env = ((Function_t*)evalRes)->environment;
+    TEST_ASSERT_EQUAL_INT(ENVIRONMENT_CAPTURE, env->kind);
+    TEST_ASSERT_NULL(env->outer->outer);
+    TEST_ASSERT_NULL(environmentGet(env, "unused"));
+    testIntegerObject(environmentGet(env, "x"), 2);
+    gcFreeExtRef(evalRes);
+}
+
 void evaluatorTestStringLiteral() {
     const char* input ="\"Hello World!\"";
     Object_t* evaluated = testEval(input);
@@ -382,6 +428,49 @@ void evaluatorTestBuiltinFunctions() {
     } 
 }
 
+void evaluatorTestGcBuiltins() {
+    typedef struct TestCase {
+        const char* input;
+        GenericExpect_t expected;
+    } TestCase_t;
+
+    TestCase_t tests[] = {
+        {"gc_config({\"slice_us\": 700, \"growth_percent\": 150})[\"slice_us\"]", _INT(700)},
+        {"gc_config()[\"growth_percent\"]", _INT(150)},
+        {"gc_config({\"heap\": 1})", _STRING("unknown gc setting: heap")},
+        {"gc_config({\"slice_us\": -1})", _STRING("gc setting slice_us must be a non negative INTEGER")},
+        {"gc_config(1)", _STRING("argument to `gc_config` must be HASH, got INTEGER")},
+        {"gc_stats(1)", _STRING("wrong number of arguments. got=1, want=0")},
+    };
+
+    GCConfig_t config = gcGetConfig();
+    uint32_t cnt = sizeof(tests) / sizeof(TestCase_t);
+
+    for (uint32_t i = 0; i < cnt; i++ ) {
+        TestCase_t *tc = &tests[i];
+        Object_t* evalRes = testEval(tc->input);
+
+        switch(tc->expected.type) {
+            case EXPECT_INTEGER:
+                testIntegerObject(evalRes, tc->expected.il);
+                break;
+            case EXPECT_STRING:
+                testErrorObject(evalRes, tc->expected.sl);
+                break;
+            default:
+                TEST_ABORT();
+        }
+
+        gcFreeExtRef(evalRes);
+    } 
+    gcSetConfig(config);
+
+    gcForceRun();
+    Object_t* evalRes = testEval("gc_stats()[\"major_collections\"] > 0");
+    testBooleanObject(evalRes, true);
+    gcFreeExtRef(evalRes);
+}
+
 void evaluatorTestArrayIndexExpressions() {
     typedef struct TestCase {
         const char* input;
@@ -451,28 +540,27 @@ void evaluatorTestHashLiterals() {
     TEST_ASSERT_EQUAL_INT_MESSAGE(OBJECT_HASH, evaluated->type, "Object is not OBJECT_HASH");
     Hash_t* hash = (Hash_t*) evaluated;
     
-    HashMap_t* exp = createHashMap();
-    char* hk = objectGetHashKey((Object_t*)createString("one"));
-    hashMapInsert(exp, hk, createInteger(1)); free(hk);
-    hk = objectGetHashKey((Object_t*)createString("two"));
-    hashMapInsert(exp, hk, createInteger(2)); free(hk);
-    hk = objectGetHashKey((Object_t*)createString("three"));
-    hashMapInsert(exp, hk, createInteger(3)); free(hk);
-    hk = objectGetHashKey((Object_t*)createInteger(4));
-    hashMapInsert(exp, hk, createInteger(4)); free(hk); 
-    hk = objectGetHashKey((Object_t*)createBoolean(true));
-    hashMapInsert(exp, hk, createInteger(5)); free(hk);
-    hk = objectGetHashKey((Object_t*)createBoolean(false));
-    hashMapInsert(exp, hk, createInteger(6)); free(hk);
-
-    HashMapIter_t iter = createHashMapIter(exp);
-    HashMapEntry_t* expEntry = hashMapIterGetNext(exp, &iter); 
-    while(expEntry) {
-        HashPair_t* pair = hashMapGet(hash->pairs, expEntry->key);
-        testIntegerObject(pair->value, ((Integer_t*)expEntry->value)->value); 
-        expEntry = hashMapIterGetNext(exp, &iter);
+    typedef struct ExpectedPair {
+        Object_t* key;
+        int64_t value;
+    } ExpectedPair_t;
+
+    ExpectedPair_t exp[] = {
+        {(Object_t*)createString("one"), 1},
+        {(Object_t*)createString("two"), 2},
+        {(Object_t*)createString("three"), 3},
+        {(Object_t*)createInteger(4), 4},
+        {(Object_t*)createBoolean(true), 5},
+        {(Object_t*)createBoolean(false), 6},
+    };
+
+    uint32_t cnt = sizeof(exp) / sizeof(ExpectedPair_t);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(cnt, hashGetPairCount(hash), "Wrong number of pairs");
+    for (uint32_t i = 0; i < cnt; i++) {
+        Object_t* value = hashGetValue(hash, exp[i].key);
+        TEST_ASSERT_NOT_NULL_MESSAGE(value, "Missing hash pair");
+        testIntegerObject(value, exp[i].value);
     }
-    cleanupHashMap(&exp, NULL);
     gcFreeExtRef(evaluated);
 }
 
@@ -490,6 +578,11 @@ void TestHashIndexExpressions() {
         {"{5: 5}[5]", _INT(5)},
         {"{true: 5}[true]", _INT(5)},
         {"{false: 5}[false]", _INT(5)},
+        {"{1: 5, \"1\": 6}[1]", _INT(5)},
+        {"{1: 5, \"1\": 6}[\"1\"]", _INT(6)},
+        {"{true: 5, \"true\": 6, 1: 7}[true]", _INT(5)},
+        {"{1: 5}[\"1\"]", _NIL},
+        {"{\"a\": 1, \"a\": 2}[\"a\"]", _INT(2)},
     };
 
     uint32_t cnt = sizeof(tests) / sizeof(TestCase_t);
@@ -510,11 +603,256 @@ void TestHashIndexExpressions() {
     } 
 }
 
-Object_t* testEval(const char* input) {
+void evaluatorTestHashInspectOrder() {
+    const char* input = "let h = {\"b\": 1, \"a\": 2, 3: true}; {\"b\": h[\"b\"], \"a\": 5, 3: h[3], \"b\": 7}";
+    Object_t* evaluated = testEval(input);
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(OBJECT_HASH, evaluated->type, "Object is not OBJECT_HASH");
+    char* inspect = objectInspect(evaluated);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("{b:7, a:5, 3:true}", inspect, "Pairs not in insertion order");
+    free(inspect);
+
+    gcFreeExtRef(evaluated);
+}
+
+void evaluatorTestHashArrayPart() {
+    const char* input = "{0: \"a\", 1: \"b\", 2: \"c\", \"x\": 1, 10: 2, -1: 3}";
+    Object_t* evaluated = testEval(input);
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(OBJECT_HASH, evaluated->type, "Object is not OBJECT_HASH");
+    Hash_t* hash = (Hash_t*)evaluated;
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(3, hash->arrayCnt, "Dense keys not in array part");
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(3, hash->pairCnt, "Sparse keys not in hash part");
+    char* inspect = objectInspect(evaluated);
+    TEST_ASSERT_EQUAL_STRING("{0:a, 1:b, 2:c, x:1, 10:2, -1:3}", inspect);
+    free(inspect);
+    gcFreeExtRef(evaluated);
+
+    // both parts follow insertion order, whatever the key order
+    evaluated = testEval("{1: \"a\", \"x\": 1, 0: \"b\"}");
+    hash = (Hash_t*)evaluated;
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(2, hash->arrayCnt, "Dense keys not in array part");
+    inspect = objectInspect(evaluated);
+    TEST_ASSERT_EQUAL_STRING("{1:a, x:1, 0:b}", inspect);
+    free(inspect);
+    gcFreeExtRef(evaluated);
+
+    // keys inserted backwards start in the hash part and move over on rehash
+    Hash_t* rev = gcGetExtRef(createHash());
+    for (int64_t i = 63; i >= 0; i--) {
+        hashInsertPair(rev, (Object_t*)createInteger(i), (Object_t*)createInteger(i * 2));
+    }
+    TEST_ASSERT_EQUAL_UINT32(64, hashGetPairCount(rev));
+    TEST_ASSERT_TRUE_MESSAGE(rev->arrayCnt > 0, "Keys never moved to array part");
+    for (int64_t i = 0; i < 64; i++) {
+        Integer_t key = { .type = OBJECT_INTEGER, .value = i };
+        testIntegerObject(hashGetValue(rev, (Object_t*)&key), i * 2);
+    }
+    // moving between the parts keeps the order keys were inserted in
+    inspect = hashInspect(rev);
+    TEST_ASSERT_EQUAL_INT(0, strncmp(inspect, "{63:126, 62:124, 61:122", 23));
+    free(inspect);
+    Hash_t* copy = gcGetExtRef(copyHash(rev));
+    inspect = hashInspect(copy);
+    TEST_ASSERT_EQUAL_INT(0, strncmp(inspect, "{63:126, 62:124, 61:122", 23));
+    free(inspect);
+    gcFreeExtRef(copy);
+    gcFreeExtRef(rev);
+}
+
+void evaluatorTestSessionHeapCompaction() {
+    // every line releases its result like the REPL does, the garbage left
+    // by push scatters the survivors over mostly empty pages
+    const char* lines[] = {
+        "let build = fn(n, acc) { if (n == 0) { acc } else { build(n - 1, push(acc, {\"k\": n, \"s\": \"x\" + \"y\"})) } };",
+        "let a = build(1500, []);",
+        "let b = build(10, []);",
+    };
+    Environment_t* env = createEnvironment(NULL);
+    for (uint32_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        gcFreeExtRef(testEvalInEnv(lines[i], env));
+    }
+
+    Object_t* evaluated = testEvalInEnv("a[0][\"k\"] + a[700][\"k\"] + a[1499][\"k\"] + len(b)", env);
+    testIntegerObject(evaluated, 1500 + 800 + 1 + 10);
+    gcFreeExtRef(evaluated);
+
+    evaluated = testEvalInEnv("a[1234]", env);
+    char* inspect = objectInspect(evaluated);
+    TEST_ASSERT_EQUAL_STRING("{k:266, s:xy}", inspect);
+    free(inspect);
+    gcFreeExtRef(evaluated);
+    gcFreeExtRef(env);
+}
+
+void evaluatorTestHeapReturnedToOs() {
+    GCStats_t before = gcGetStats();
+    gcFreeExtRef(testEval("let build = fn(n, acc) { if (n == 0) { len(acc) } else { build(n - 1, push(acc, {\"k\": n})) } }; build(3000, [])"));
+    // the next collection finishes sweeping the garbage of the burst
+    gcForceRun();
+    gcForceRun();
+    GCStats_t after = gcGetStats();
+    TEST_ASSERT_TRUE(after.returnedBytes > before.returnedBytes);
+}
+
+void evaluatorTestRefCountReclaim() {
+    Environment_t* env = createEnvironment(NULL);
+    gcFreeExtRef(testEvalInEnv("let a = [1, 2, [3]]; let b = a; let c = [4, 5];", env));
+    // promotes the bindings, their references get counted
+    gcForceRun();
+
+    GCStats_t before = gcGetStats();
+    gcFreeExtRef(testEvalInEnv("let a = 0; let c = 0;", env));
+    // minor collection ahead of the next major one frees c, b keeps a alive
+    gcForceRun();
+    GCStats_t after = gcGetStats();
+    TEST_ASSERT_TRUE(after.refCountFreedBytes > before.refCountFreedBytes);
+
+    Object_t* evaluated = testEvalInEnv("b[2][0] + a", env);
+    testIntegerObject(evaluated, 3);
+    gcFreeExtRef(evaluated);
+    gcFreeExtRef(env);
+}
+
+void evaluatorTestHashArrayKeyRefCount() {
+    Environment_t* env = createEnvironment(NULL);
+    gcFreeExtRef(testEvalInEnv("let h = {\"a\": 1}; let ks = [0, 1, 2, 3];", env));
+    // promotes both, the array holds the only counted reference to each key
+    gcForceRun();
+
+    Hash_t* hash = (Hash_t*)testEvalInEnv("h", env);
+    Array_t* keys = (Array_t*)testEvalInEnv("ks", env);
+    Object_t** keyBuf = arrayGetElements(keys);
+    for (uint32_t i = 0; i < arrayGetElementCount(keys); i++) {
+        TEST_ASSERT_EQUAL_UINT32(1, gcGetRefCount(keyBuf[i]));
+        hashInsertPair(hash, keyBuf[i], (Object_t*)createInteger(i));
+    }
+    TEST_ASSERT_EQUAL_UINT32(4, hash->arrayCnt);
+
+    // dense keys land in the array part, which does not reference them
+    for (uint32_t i = 0; i < arrayGetElementCount(keys); i++) {
+        TEST_ASSERT_EQUAL_UINT32(1, gcGetRefCount(keyBuf[i]));
+    }
+    gcFreeExtRef(keys);
+    gcFreeExtRef(hash);
+    gcFreeExtRef(env);
+}
+
+void evaluatorTestHeapDump() {
+    Object_t* evaluated = testEval("heap_dump(\"test_heap.snapshot\")");
+    testErrorObject(evaluated, "heap_dump is disabled, CAPUCHIN_HEAP_DUMP_DIR is not set");
+    gcFreeExtRef(evaluated);
+
+    char dir[] = "/tmp/capuchin-heap-XXXXXX";
+    TEST_ASSERT_NOT_NULL_MESSAGE(mkdtemp(dir), "Could not create dump directory");
+    setenv("CAPUCHIN_HEAP_DUMP_DIR", dir, 1);
+    char* path = strFormat("%s/test_heap.snapshot", dir);
+    evaluated = testEval("let xs = [1, \"two\"]; heap_dump(\"test_heap.snapshot\")");
+    testNullObject(evaluated);
+    gcFreeExtRef(evaluated);
+
+    FILE* f = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Snapshot not written");
+    char line[256];
+    bool rootFound = false, arrayFound = false, bindingFound = false;
+    while (fgets(line, sizeof(line), f)) {
+        rootFound |= strncmp(line, "root ", 5) == 0;
+        arrayFound |= strncmp(line, "object ", 7) == 0 && strstr(line, " ARRAY ") != NULL;
+        bindingFound |= strncmp(line, "ref ", 4) == 0 && strstr(line, " xs\n") != NULL;
+    }
+    fclose(f);
+    remove(path);
+    free(path);
+    TEST_ASSERT_TRUE_MESSAGE(rootFound, "No root in snapshot");
+    TEST_ASSERT_TRUE_MESSAGE(arrayFound, "Array missing from snapshot");
+    TEST_ASSERT_TRUE_MESSAGE(bindingFound, "Binding name missing from snapshot");
+
+    evaluated = testEval("heap_dump(\"no/such/dir/test.snapshot\")");
+    testErrorObject(evaluated, "could not write heap dump to no/such/dir/test.snapshot");
+    gcFreeExtRef(evaluated);
+
+    const char* outside[] = {"/tmp/test.snapshot", "../test.snapshot", "objs/../../test.snapshot", ""};
+    for (uint32_t i = 0; i < sizeof(outside) / sizeof(outside[0]); i++) {
+        char* input = strFormat("heap_dump(\"%s\")", outside[i]);
+        char* expected = strFormat("heap dump path must stay inside CAPUCHIN_HEAP_DUMP_DIR, got %s", outside[i]);
+        evaluated = testEval(input);
+        testErrorObject(evaluated, expected);
+        gcFreeExtRef(evaluated);
+        free(input);
+        free(expected);
+    }
+    unsetenv("CAPUCHIN_HEAP_DUMP_DIR");
+    rmdir(dir);
+}
+
+void evaluatorTestQuotas() {
+    EvalLimits_t defaults = evalGetLimits();
+    const char* fib = "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(40)";
+
+    EvalLimits_t limits = defaults;
+    limits.maxSteps = 1000;
+    evalSetLimits(limits);
+    Object_t* evaluated = testEval(fib);
+    testErrorObject(evaluated, "step quota exceeded: 1000 steps");
+    gcFreeExtRef(evaluated);
+    // counted per evaluation, not per process
+    evaluated = testEval("let a = 1; a");
+    testIntegerObject(evaluated, 1);
+    gcFreeExtRef(evaluated);
+
+    limits = defaults;
+    limits.maxWallMs = 20;
+    evalSetLimits(limits);
+    evaluated = testEval(fib);
+    testErrorObject(evaluated, "time quota exceeded: 20 ms");
+    gcFreeExtRef(evaluated);
+
+    limits = defaults;
+    limits.maxHeapBytes = gcHeapBytes() + 4 * 1024 * 1024;
+    evalSetLimits(limits);
+    evaluated = testEval("let dup = fn(s, n) { if (n == 0) { s } else { dup(s + s, n - 1) } }; dup(\"abcd\", 40)");
+    TEST_ASSERT_EQUAL_INT(OBJECT_ERROR, evaluated->type);
+    TEST_ASSERT_EQUAL_INT(0, strncmp(((Error_t*)evaluated)->message, "heap quota exceeded", 19));
+    gcFreeExtRef(evaluated);
+
+    // hash pairs and index are buffers, small integer keys leave little on the GC heap
+    gcCollectAll();
+    limits.maxHeapBytes = gcHeapBytes() + 4 * 1024 * 1024;
+    evalSetLimits(limits);
+    Strbuf_t* sbuf = createStrbuf();
+    strbufWrite(sbuf, "let v = 1; let h = {");
+    for (int i = 0; i < 100000; i++) {
+        strbufConsume(sbuf, strFormat("%d: v, ", i * 1000));
+    }
+    strbufWrite(sbuf, "0: v}; h");
+    char* input = detachStrbuf(&sbuf);
+    evaluated = testEval(input);
+    free(input);
+    TEST_ASSERT_EQUAL_INT(OBJECT_ERROR, evaluated->type);
+    TEST_ASSERT_EQUAL_INT(0, strncmp(((Error_t*)evaluated)->message, "heap quota exceeded", 19));
+    gcFreeExtRef(evaluated);
+
+    // garbage does not count against the quota, only what stays live
+    gcCollectAll();
+    limits.maxHeapBytes = gcHeapBytes() + 600000;
+    evalSetLimits(limits);
+    evaluated = testEval("let loop = fn(n) { if (n == 0) { 0 } else { let a = [n, n, n, n, n, n, n, n]; loop(n - 1) } };"
+                         "let outer = fn(k) { if (k == 0) { 1 } else { loop(500); outer(k - 1) } }; outer(100)");
+    testIntegerObject(evaluated, 1);
+    gcFreeExtRef(evaluated);
+
+    // runaway recursion stops before the native stack overflows
+    evalSetLimits(defaults);
+    evaluated = testEval("let f = fn(x) { f(x + 1) }; f(0)");
+    TEST_ASSERT_EQUAL_INT(OBJECT_ERROR, evaluated->type);
+    TEST_ASSERT_EQUAL_INT(0, strncmp(((Error_t*)evaluated)->message, "stack quota exceeded", 20));
+    gcFreeExtRef(evaluated);
+}
+
+Object_t* testEvalInEnv(const char* input, Environment_t* env) {
     Lexer_t* lexer = createLexer(input);
     Parser_t* parser = createParser(lexer);
     Program_t* program = parserParseProgram(parser);
-    Environment_t* env = createEnvironment(NULL);
 
     Object_t* ret = evalProgram(program, env);
     if (ret->type == OBJECT_ERROR) {
@@ -522,6 +860,12 @@ Object_t* testEval(const char* input) {
     }
     cleanupProgram(&program);
     cleanupParser(&parser);
+    return ret;
+}
+
+Object_t* testEval(const char* input) {
+    Environment_t* env = createEnvironment(NULL);
+    Object_t* ret = testEvalInEnv(input, env);
     gcFreeExtRef(env);
     return ret; 
 }
@@ -564,12 +908,24 @@ int main(void) {
     RUN_TEST(evaluatorTestFunctionObject);
     RUN_TEST(evaluatorTestFunctionApplication);
     RUN_TEST(evalatorTestClosures);
+    RUN_TEST(evaluatorTestFlatClosures);
     RUN_TEST(evaluatorTestStringLiteral);
     RUN_TEST(evaluatorTestStringConcatenation);
     RUN_TEST(evaluatorTestBuiltinFunctions);
+    RUN_TEST(evaluatorTestGcBuiltins);
     RUN_TEST(evaluatorTestArrayliteral);
     RUN_TEST(evaluatorTestArrayIndexExpressions);
     RUN_TEST(evaluatorTestHashLiterals);
     RUN_TEST(TestHashIndexExpressions);
-    return UNITY_END();
+    RUN_TEST(evaluatorTestHashInspectOrder);
+    RUN_TEST(evaluatorTestHashArrayPart);
+    RUN_TEST(evaluatorTestSessionHeapCompaction);
+    RUN_TEST(evaluatorTestHeapReturnedToOs);
+    RUN_TEST(evaluatorTestRefCountReclaim);
+    RUN_TEST(evaluatorTestHashArrayKeyRefCount);
+    RUN_TEST(evaluatorTestHeapDump);
+    RUN_TEST(evaluatorTestQuotas);
+    int failures = UNITY_END();
+    cleanupInternPool();
+    return failures;
 }
\ No newline at end of file
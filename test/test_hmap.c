@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include "unity.h"
 #include "hmap.h"
 #include "utils.h"
@@ -35,7 +36,7 @@ void hashMapTestInsert() {
     hashMapInsert(map, "test3", cloneString("my value 3"));
 
     TEST_ASSERT_EQUAL_INT_MESSAGE(4, map->itemCnt, "Wrong item count");  
-    TEST_ASSERT_EQUAL_INT_MESSAGE(8, map->numBuckets, "Wrong number of buckets");  
+    TEST_ASSERT_EQUAL_INT_MESSAGE(4, map->capacity, "Wrong capacity");  
     TEST_ASSERT_EQUAL_STRING("my value", hashMapGet(map, "hello")); 
     TEST_ASSERT_EQUAL_STRING("my value 4", hashMapGet(map, "test1")); 
     TEST_ASSERT_EQUAL_STRING("my value 2", hashMapGet(map, "test2")); 
@@ -68,11 +69,120 @@ void hashMapTestSetInsert() {
     cleanupHashMap(&map, NULL);
 }
 
+void hashMapTestGrow() {
+    HashMap_t* map = createHashMap();
+    char key[32];
+
+    for (int i = 0; i < 1000; i++) {
+        sprintf(key, "key%d", i);
+        hashMapInsert(map, key, strFormat("value%d", i));
+    }
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1000, map->itemCnt, "Wrong item count");  
+    TEST_ASSERT_EQUAL_INT_MESSAGE(2048, map->capacity, "Wrong capacity");  
+    for (int i = 0; i < 1000; i++) {
+        sprintf(key, "key%d", i);
+        char* expected = strFormat("value%d", i);
+        TEST_ASSERT_EQUAL_STRING(expected, hashMapGet(map, key)); 
+        free(expected);
+    }
+    TEST_ASSERT_NULL_MESSAGE(hashMapGet(map, "key1000"), "Unexpected value");
+
+    uint32_t cnt = 0;
+    HashMapIter_t iter = createHashMapIter(map);
+    while (hashMapIterGetNext(map, &iter)) 
+        cnt++;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1000, cnt, "Wrong iteration count");  
+
+    cleanupHashMap(&map, (HashMapElemCleanupFn_t)cleanupStr);
+}
+
+void hashMapTestIncrementalResize() {
+    HashMap_t* map = createHashMap();
+    char key[32];
+    bool sawMigration = false;
+
+    for (int i = 0; i < 5000; i++) {
+        sprintf(key, "key%d", i);
+        hashMapInsert(map, key, strFormat("value%d", i));
+        sawMigration |= (map->oldCtrl != NULL);
+
+        // older keys must stay visible while being moved
+        sprintf(key, "key%d", i / 2);
+        char* expected = strFormat("value%d", i / 2);
+        TEST_ASSERT_EQUAL_STRING(expected, hashMapGet(map, key)); 
+        free(expected);
+    }
+    TEST_ASSERT_TRUE_MESSAGE(sawMigration, "Resize was not incremental");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(5000, map->itemCnt, "Wrong item count");  
+
+    uint32_t cnt = 0;
+    HashMapIter_t iter = createHashMapIter(map);
+    while (hashMapIterGetNext(map, &iter)) 
+        cnt++;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(5000, cnt, "Wrong iteration count");  
+
+    cleanupHashMap(&map, (HashMapElemCleanupFn_t)cleanupStr);
+}
+
+void hashMapTestGetDuringIteration() {
+    HashMap_t* map = createHashMap();
+    char key[32];
+    int i = 0;
+    // stop right after a resize started, old table items still pending
+    while (!map->oldCtrl) {
+        sprintf(key, "key%d", i);
+        hashMapInsert(map, key, strFormat("%d", i));
+        i++;
+    }
+    uint32_t itemCnt = map->itemCnt;
+
+    // lookups between steps must not move entries under the iterator
+    uint8_t* seen = calloc(itemCnt, 1);
+    uint32_t cnt = 0;
+    HashMapIter_t iter = createHashMapIter(map);
+    HashMapEntry_t* entry;
+    while ((entry = hashMapIterGetNext(map, &iter))) {
+        int idx = atoi(entry->value);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(0, seen[idx], "Entry visited twice");
+        seen[idx] = 1;
+        cnt++;
+
+        for (uint32_t j = 0; j < itemCnt; j++) {
+            sprintf(key, "key%u", j);
+            TEST_ASSERT_NOT_NULL(hashMapGet(map, key));
+        }
+    }
+    TEST_ASSERT_TRUE_MESSAGE(map->oldCtrl != NULL, "Lookups migrated entries");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(itemCnt, cnt, "Wrong iteration count");
+
+    free(seen);
+    cleanupHashMap(&map, (HashMapElemCleanupFn_t)cleanupStr);
+}
+
+void hashMapTestInternPool() {
+    const char* a = internString("intern");
+    char other[] = "intern";
+    TEST_ASSERT_TRUE_MESSAGE(a == internString(other), "Equal strings not shared");
+
+    // the pool starts over after cleanup
+    cleanupInternPool();
+    const char* b = internString("intern");
+    TEST_ASSERT_EQUAL_STRING("intern", b);
+    TEST_ASSERT_TRUE_MESSAGE(b == internString(other), "Equal strings not shared");
+}
+
 // not needed when using generate_test_runner.rb
 int main(void) {
    UNITY_BEGIN();
    RUN_TEST(hashMapTestBasic);
    RUN_TEST(hashMapTestInsert);
    RUN_TEST(hashMapTestSetInsert);
-   return UNITY_END();
+   RUN_TEST(hashMapTestGrow);
+   RUN_TEST(hashMapTestIncrementalResize);
+   RUN_TEST(hashMapTestGetDuringIteration);
+   RUN_TEST(hashMapTestInternPool);
+   int failures = UNITY_END();
+   cleanupInternPool();
+   return failures;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <malloc.h>
 #include "unity.h"
 #include "lexer.h"
 #include "token.h"
@@ -12,12 +13,23 @@ void tearDown(void) {
     // clean stuff up here
 }
 
+typedef struct ExpToken {
+    TokenType_t type;
+    const char* literal;
+} ExpToken_t;
+
+static void checkTokenLiteral(const char* exp, const Token_t* tok, const char* msg) {
+    char* literal = tokenToString(tok);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(exp, literal, msg);
+    free(literal);
+}
+
 void lexer_simple_test(void) {
     char input[] = "=+(){},;";
 
     Lexer_t* lexer = createLexer(input);
 
-    static Token_t expToken[] = {
+    static ExpToken_t expToken[] = {
         {TOKEN_ASSIGN, "="},
         {TOKEN_PLUS, "+"},
         {TOKEN_LPAREN, "("},
@@ -29,7 +41,7 @@ void lexer_simple_test(void) {
         {TOKEN_EOF, ""},
     };
 
-    int32_t numTests = sizeof(expToken) / sizeof(Token_t);
+    int32_t numTests = sizeof(expToken) / sizeof(ExpToken_t);
     Token_t* tok;
 
     char msg[30];
@@ -40,7 +52,7 @@ void lexer_simple_test(void) {
         TEST_ASSERT_NOT_NULL_MESSAGE(tok, msg);
 
         TEST_ASSERT_EQUAL_INT_MESSAGE(expToken[i].type, tok->type , msg); 
-        TEST_ASSERT_EQUAL_STRING_MESSAGE(expToken[i].literal, tok->literal, msg);
+        checkTokenLiteral(expToken[i].literal, tok, msg);
     }
 
 }
@@ -57,7 +69,7 @@ void lexer_test_monkey1(void) {
 
     Lexer_t* lexer = createLexer(input);
 
-    static Token_t expToken[] = {
+    static ExpToken_t expToken[] = {
         {TOKEN_LET, "let"},
         {TOKEN_IDENT, "five"},
         {TOKEN_ASSIGN, "="},
@@ -97,7 +109,7 @@ void lexer_test_monkey1(void) {
         {TOKEN_EOF, ""}
     };
 
-    int32_t numTests = sizeof(expToken) / sizeof(Token_t);
+    int32_t numTests = sizeof(expToken) / sizeof(ExpToken_t);
     Token_t* tok;
 
     char msg[30];
@@ -108,7 +120,7 @@ void lexer_test_monkey1(void) {
         TEST_ASSERT_NOT_NULL_MESSAGE(tok, msg);
 
         TEST_ASSERT_EQUAL_INT_MESSAGE(expToken[i].type, tok->type , msg); 
-        TEST_ASSERT_EQUAL_STRING_MESSAGE(expToken[i].literal, tok->literal, msg);
+        checkTokenLiteral(expToken[i].literal, tok, msg);
     }
 }
 
@@ -140,7 +152,7 @@ void lexer_test_monkey2(void) {
 
     Lexer_t* lexer = createLexer(input);
 
-    static Token_t expToken[] = {
+    static ExpToken_t expToken[] = {
         {TOKEN_LET, "let"},
 		{TOKEN_IDENT, "five"},
 		{TOKEN_ASSIGN, "="},
@@ -230,7 +242,7 @@ void lexer_test_monkey2(void) {
         {TOKEN_EOF, ""},
     };
 
-    int32_t numTests = sizeof(expToken) / sizeof(Token_t);
+    int32_t numTests = sizeof(expToken) / sizeof(ExpToken_t);
     Token_t* tok;
 
     char msg[30];
@@ -241,12 +253,42 @@ void lexer_test_monkey2(void) {
         TEST_ASSERT_NOT_NULL_MESSAGE(tok, msg);
 
         TEST_ASSERT_EQUAL_STRING_MESSAGE(tokenTypeToStr(expToken[i].type), tokenTypeToStr(tok->type) , msg); 
-        TEST_ASSERT_EQUAL_STRING_MESSAGE(expToken[i].literal, tok->literal, msg);
+        checkTokenLiteral(expToken[i].literal, tok, msg);
     }
 }
 
 
+void lexer_position_test(void) {
+    Lexer_t* lexer = createLexer("let a = 1;\n  a + \"xy\";\n\n}");
+
+    static const struct {
+        TokenType_t type;
+        uint32_t line, col;
+    } expPos[] = {
+        {TOKEN_LET, 1, 1},
+        {TOKEN_IDENT, 1, 5},
+        {TOKEN_ASSIGN, 1, 7},
+        {TOKEN_INT, 1, 9},
+        {TOKEN_SEMICOLON, 1, 10},
+        {TOKEN_IDENT, 2, 3},
+        {TOKEN_PLUS, 2, 5},
+        {TOKEN_STRING, 2, 8},
+        {TOKEN_SEMICOLON, 2, 11},
+        {TOKEN_RBRACE, 4, 1},
+        {TOKEN_EOF, 4, 2},
+    };
+
+    char msg[30];
+    for (uint32_t i = 0; i < sizeof(expPos) / sizeof(expPos[0]); i++) {
+        sprintf(msg, "Test_%u", i);
 
+        Token_t* tok = lexerNextToken(lexer);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(expPos[i].type, tok->type, msg);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(expPos[i].line, tok->line, msg);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(expPos[i].col, tok->col, msg);
+    }
+    cleanupLexer(&lexer);
+}
 
 
 // not needed when using generate_test_runner.rb
@@ -255,5 +297,6 @@ int main(void) {
     RUN_TEST(lexer_simple_test);
     RUN_TEST(lexer_test_monkey1);
     RUN_TEST(lexer_test_monkey2);
+    RUN_TEST(lexer_position_test);
     return UNITY_END();
 }
\ No newline at end of file
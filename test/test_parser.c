@@ -1,4 +1,5 @@
 #include <stdlib.h> 
+#include <string.h>
 
 #include "unity.h"
 #include "parser.h"
@@ -33,6 +34,7 @@ void testIntegerLiteral(Expression_t* exp, int64_t value);
 void testBooleanLiteral(Expression_t* exp, bool value);
 void testIdentifier(Expression_t *exp, const char* value);
 void checkParserErrors(Parser_t* parser);
+void checkTokenLiteral(const char* exp, const Token_t* tok, const char* msg);
 
 void setUp(void) {
     // set stuff up here
@@ -92,6 +94,9 @@ void parserTestInvalidLetStatement(void) {
     
     Program_t* program = parserParseProgram(parser);
 
+    // errors point at the offending token
+    TEST_ASSERT_TRUE_MESSAGE(parserGetErrorCount(parser) > 0, "Parser has no errors!");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, strncmp("1:8: ", parserGetErrors(parser)[0], 5), "Check error position!");
 
     cleanupParser(&parser);
     cleanupProgram(&program);
@@ -118,7 +123,9 @@ void parserTestReturnStatements() {
     for (int i = 0 ; i < num_tests; i++) {
         Statement_t* s = statements[i];
         TEST_ASSERT_EQUAL_INT_MESSAGE(STATEMENT_RETURN, s->type, "Check statement type!");
-        TEST_ASSERT_EQUAL_STRING_MESSAGE("return", statementTokenLiteral(s), "Check statement literal!");
+        char* lit = statementTokenLiteral(s);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE("return", lit, "Check statement literal!");
+        free(lit);
     }
     
     cleanupParser(&parser);
@@ -426,7 +433,7 @@ void parserTestIdentifierExpression() {
     Identifier_t* ident = (Identifier_t*)es->expression;
 
     TEST_ASSERT_EQUAL_STRING_MESSAGE("foobar", ident->value, "Check ident value");
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("foobar", ident->token->literal, "Check literal value");
+    checkTokenLiteral("foobar", ident->token, "Check literal value");
 
     cleanupParser(&parser);
     cleanupProgram(&prog);
@@ -762,13 +769,15 @@ void parserTestParsingIndexExpressions() {
 } 
 
 void testLetStatement(Statement_t* s, const char* name) {
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("let", statementTokenLiteral(s), "Check statement literal!");
+    char* lit = statementTokenLiteral(s);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("let", lit, "Check statement literal!");
+    free(lit);
     
     TEST_ASSERT_EQUAL_INT_MESSAGE(STATEMENT_LET, s->type, "Check statement type!");
     LetStatement_t* letStmt = (LetStatement_t*) s;
 
     TEST_ASSERT_EQUAL_STRING_MESSAGE(name, letStmt->name->value, "Check name value!");
-    TEST_ASSERT_EQUAL_STRING_MESSAGE(name, letStmt->name->token->literal, "Check name literal!");
+    checkTokenLiteral(name, letStmt->name->token, "Check name literal!");
 }
 
 
@@ -803,7 +812,7 @@ void testIdentifier(Expression_t *exp, const char* value) {
     Identifier_t* id = (Identifier_t*)exp;
 
     TEST_ASSERT_EQUAL_STRING_MESSAGE(value, id->value, "Check identifier value");
-    TEST_ASSERT_EQUAL_STRING_MESSAGE(value, id->token->literal, "Check identifeier literal");
+    checkTokenLiteral(value, id->token, "Check identifeier literal");
 }
 
 
@@ -814,7 +823,7 @@ void testIntegerLiteral(Expression_t* exp, int64_t value) {
     TEST_ASSERT_EQUAL_INT_MESSAGE(value, il->value, "Check ident value");
 
     char* lit = strFormat("%d", value);
-    TEST_ASSERT_EQUAL_STRING_MESSAGE(lit, il->token->literal, "Check literal value");
+    checkTokenLiteral(lit, il->token, "Check literal value");
     free(lit);
 }
 
@@ -823,7 +832,7 @@ void testBooleanLiteral(Expression_t* exp, bool value) {
     BooleanLiteral_t* bl = (BooleanLiteral_t*)exp;
 
     TEST_ASSERT_EQUAL_INT_MESSAGE(value, bl->value, "Check identifier value");
-    TEST_ASSERT_EQUAL_STRING_MESSAGE( (value ? "true" : "false"), bl->token->literal, "Check identifeier literal");
+    checkTokenLiteral((value ? "true" : "false"), bl->token, "Check identifeier literal");
 }
 
 
@@ -838,6 +847,12 @@ void checkParserErrors(Parser_t* parser) {
     TEST_ASSERT_EQUAL_UINT32_MESSAGE(0u, errCnt, "Parser has errors!");
 }
 
+void checkTokenLiteral(const char* exp, const Token_t* tok, const char* msg) {
+    char* literal = tokenToString(tok);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(exp, literal, msg);
+    free(literal);
+}
+
 // not needed when using generate_test_runner.rb
 int main(void) {
     UNITY_BEGIN();
@@ -1,41 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "unity.h"
 #include "token.h"
 
+static Arena_t* arena = NULL;
 
 void setUp(void) {
-    // set stuff up here
+    arena = createArena();
 }
 
 void tearDown(void) {
-    // clean stuff up here
+    cleanupArena(&arena);
+}
+
+static void checkTokenLiteral(const char* exp, const Token_t* tok, const char* msg) {
+    char* literal = tokenToString(tok);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(exp, literal, msg);
+    free(literal);
 }
 
 void token_create_test(void) {
-    Token_t* tok = createToken(TOKEN_EOF, NULL, 0);
+    Token_t* tok = createToken(arena, TOKEN_EOF, "", 0, 0, 1, 1);
     TEST_ASSERT_NOT_NULL(tok);
-    cleanupToken(&tok);
+    checkTokenLiteral("", tok, "Token literal check");
 }
 
 
 void token_create_test_2(void) {
-    Token_t* tok = createToken(TOKEN_ASSIGN, "=", 1u);
+    Token_t* tok = createToken(arena, TOKEN_ASSIGN, "=", 0, 1u, 3, 7);
 
     TEST_ASSERT_EQUAL_INT_MESSAGE(TOKEN_ASSIGN, tok->type, "Token type check");
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("=", tok->literal, "Token literal check");
-    cleanupToken(&tok);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(3, tok->line, "Token line check");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(7, tok->col, "Token col check");
+    checkTokenLiteral("=", tok, "Token literal check");
 }
 
 
 
 void token_create_test_3(void) {
-    Token_t* tok = createToken(TOKEN_ASSIGN, "123456", 3);
+    const char* source = "let x = 123456;";
+    Token_t* tok = createToken(arena, TOKEN_INT, source, 8, 3, 1, 9);
 
-    TEST_ASSERT_EQUAL_INT_MESSAGE(TOKEN_ASSIGN, tok->type, "Token type check");
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("123", tok->literal, "Token literal check");
-    cleanupToken(&tok);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(TOKEN_INT, tok->type, "Token type check");
+    TEST_ASSERT_TRUE_MESSAGE(tokenText(tok) == source + 8, "Token points into the source");
+    checkTokenLiteral("123", tok, "Token literal check");
 }
 
 
+void token_arena_test(void) {
+    // enough tokens to spill over several arena blocks
+    Token_t* toks[4096];
+    char lit[16];
+    for (uint32_t i = 0; i < 4096; i++) {
+        sprintf(lit, "tok%u", i);
+        const char* source = arenaCloneString(arena, lit);
+        toks[i] = createToken(arena, TOKEN_IDENT, source, 0, strlen(lit), 1, 1);
+    }
+    for (uint32_t i = 0; i < 4096; i++) {
+        sprintf(lit, "tok%u", i);
+        checkTokenLiteral(lit, toks[i], "Token literal check");
+    }
+
+    // a large source gets its own block and later small allocations still fit
+    char big[8192];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    const char* bigSource = arenaCloneSubstring(arena, big, sizeof(big) - 1);
+    Token_t* small = createToken(arena, TOKEN_ASSIGN, "=", 0, 1u, 1, 1);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, strcmp(big, bigSource), "Source copy check");
+    checkTokenLiteral("=", small, "Token literal check");
+}
 
 
 // not needed when using generate_test_runner.rb
@@ -44,5 +79,6 @@ int main(void) {
     RUN_TEST(token_create_test);
     RUN_TEST(token_create_test_2);
     RUN_TEST(token_create_test_3);
+    RUN_TEST(token_arena_test);
     return UNITY_END();
 }
\ No newline at end of file
@@ -20,6 +20,10 @@ static char* copyStr(char* str) {
     return cloneString(str);
 }
 
+static void* copyPtr(void* ptr) {
+    return ptr;
+}
+
 void vectorTestBasic() {
     Vector_t* vec = createVector();
     cleanupVector(&vec, (VectorElemCleanupFn_t)cleanupStr);    
@@ -68,6 +72,25 @@ void vectorTestCopy() {
 
 }
 
+void vectorTestLargeBuffer() {
+    // grows from the malloc heap into its own mapping
+    Vector_t* vec = createVector();
+    uint32_t cnt = 4 * LARGE_BUFFER_SIZE / sizeof(void*);
+    for (uintptr_t i = 0; i < cnt; i++) {
+        vectorAppend(vec, (void*)i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(cnt, vectorGetCount(vec));
+    TEST_ASSERT_TRUE(vec->cap * sizeof(void*) >= LARGE_BUFFER_SIZE);
+    for (uintptr_t i = 0; i < cnt; i++) {
+        TEST_ASSERT_EQUAL_PTR((void*)i, vec->buf[i]);
+    }
+
+    Vector_t* newVec = copyVector(vec, copyPtr);
+    TEST_ASSERT_EQUAL_UINT32(cnt, vectorGetCount(newVec));
+    TEST_ASSERT_EQUAL_PTR((void*)(uintptr_t)(cnt - 1), newVec->buf[cnt - 1]);
+    cleanupVector(&newVec, NULL);
+    cleanupVector(&vec, NULL);
+}
 
 // not needed when using generate_test_runner.rb
 int main(void) {
@@ -75,5 +98,6 @@ int main(void) {
    RUN_TEST(vectorTestBasic);
    RUN_TEST(vectorTestInsert);
    RUN_TEST(vectorTestCopy);
+   RUN_TEST(vectorTestLargeBuffer);
    return UNITY_END();
 }
\ No newline at end of file